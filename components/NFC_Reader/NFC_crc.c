@@ -0,0 +1,130 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "NFC_crc.h"
+
+#ifdef ESP_PLATFORM
+#include <esp_timer.h>
+#include "esp_rom_crc.h"
+#endif
+
+#define CRCBENCHKB 64
+
+#ifndef ESP_PLATFORM
+static uint32_t sCrc32Table[256];
+static uint16_t sCrc16Table[256];
+static bool sCrcTablesReady = false;
+
+/**************************************************************************/
+/*!
+    @brief  Naplní tabulky pro výpočet CRC mimo ESP32 (bez ROM funkcí)
+*/
+/**************************************************************************/
+static void NFC_CrcTables(void)
+{
+  for (uint32_t i = 0; i < 256; ++i)
+  {
+    uint32_t iCrc32 = i;
+    uint16_t iCrc16 = i;
+    for (int j = 0; j < 8; ++j)
+    {
+      iCrc32 = (iCrc32 & 1) ? (iCrc32 >> 1) ^ 0xEDB88320 : iCrc32 >> 1;
+      iCrc16 = (iCrc16 & 1) ? (iCrc16 >> 1) ^ 0x8408 : iCrc16 >> 1;
+    }
+    sCrc32Table[i] = iCrc32;
+    sCrc16Table[i] = iCrc16;
+  }
+  sCrcTablesReady = true;
+}
+#endif
+
+/**************************************************************************/
+/*!
+    @brief  CRC32, na ESP32 ROM funkcí esp_rom_crc32_le, jinak tabulkou
+
+    @param  aCrc      Výsledek předchozí části, 0 na začátku
+    @param  aData     Data
+    @param  aLen      Délka dat
+
+    @returns CRC32 dosud zpracovaných dat
+*/
+/**************************************************************************/
+uint32_t NFC_Crc32(uint32_t aCrc, const uint8_t *aData, size_t aLen)
+{
+#ifdef ESP_PLATFORM
+  return esp_rom_crc32_le(aCrc, aData, aLen);
+#else
+  if (!sCrcTablesReady)
+  {
+    NFC_CrcTables();
+  }
+  aCrc = ~aCrc;
+  for (size_t i = 0; i < aLen; ++i)
+  {
+    aCrc = sCrc32Table[(aCrc ^ aData[i]) & 0xFF] ^ (aCrc >> 8);
+  }
+  return ~aCrc;
+#endif
+}
+
+/**************************************************************************/
+/*!
+    @brief  CRC16, na ESP32 ROM funkcí esp_rom_crc16_le, jinak tabulkou
+
+    @param  aCrc      Výsledek předchozí části, 0 na začátku
+    @param  aData     Data
+    @param  aLen      Délka dat
+
+    @returns CRC16 dosud zpracovaných dat
+*/
+/**************************************************************************/
+uint16_t NFC_Crc16(uint16_t aCrc, const uint8_t *aData, size_t aLen)
+{
+#ifdef ESP_PLATFORM
+  return esp_rom_crc16_le(aCrc, aData, aLen);
+#else
+  if (!sCrcTablesReady)
+  {
+    NFC_CrcTables();
+  }
+  aCrc = ~aCrc;
+  for (size_t i = 0; i < aLen; ++i)
+  {
+    aCrc = sCrc16Table[(aCrc ^ aData[i]) & 0xFF] ^ (aCrc >> 8);
+  }
+  return ~aCrc;
+#endif
+}
+
+/**************************************************************************/
+/*!
+    @brief  Změří a vypíše cenu CRC32 a CRC16 na 1 KB dat
+*/
+/**************************************************************************/
+void NFC_CrcBenchmark(void)
+{
+#ifdef ESP_PLATFORM
+  static uint8_t iData[1024];
+  uint32_t iCrc32 = 0;
+  uint16_t iCrc16 = 0;
+  for (size_t i = 0; i < sizeof(iData); ++i)
+  {
+    iData[i] = i;
+  }
+  int64_t iStart = esp_timer_get_time();
+  for (int i = 0; i < CRCBENCHKB; ++i)
+  {
+    iCrc32 = NFC_Crc32(iCrc32, iData, sizeof(iData));
+  }
+  int64_t iTime32 = esp_timer_get_time() - iStart;
+  iStart = esp_timer_get_time();
+  for (int i = 0; i < CRCBENCHKB; ++i)
+  {
+    iCrc16 = NFC_Crc16(iCrc16, iData, sizeof(iData));
+  }
+  int64_t iTime16 = esp_timer_get_time() - iStart;
+  printf("[NFC_CrcBenchmark] CRC32: %lld us/KB (%08lx), CRC16: %lld us/KB (%04x)\n", iTime32 / CRCBENCHKB, iCrc32, iTime16 / CRCBENCHKB, iCrc16);
+#endif
+}
@@ -0,0 +1,27 @@
+/* ==========================================
+    NFC_crc - Kontrolni soucty dat na NFC Čipu
+    Copyright (c) 2023 Luboš Chmelař
+    [Licence]
+========================================== */
+#ifndef NFC_crc_H
+#define NFC_crc_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+
+  // CRC32 (IEEE 802.3, LE) a CRC16 (CCITT, LE) jako ROM funkce ESP32:
+  // aCrc je vysledek predchoziho volani (0 na zacatku), lze tedy pocitat po castech
+  uint32_t NFC_Crc32(uint32_t aCrc, const uint8_t *aData, size_t aLen);
+  uint16_t NFC_Crc16(uint16_t aCrc, const uint8_t *aData, size_t aLen);
+  void NFC_CrcBenchmark(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,253 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "NFC_keys.h"
+
+typedef struct
+{
+  uint8_t sKey[6];
+  bool sDiversify;   // klic karty se odvozuje pres sDiversifyFunc
+  uint16_t sHits[2]; // uspesne autentizace klicem A / B
+} TKeyEntry;
+
+typedef struct
+{
+  uint8_t sUid[7];
+  uint8_t sUidLength; // 0 - volny zaznam
+  uint8_t sSector;
+  uint8_t sKey;  // index do sKeys
+  uint8_t sType; // NFC_KEY_A / NFC_KEY_B
+  uint32_t sUsed;
+} TKeyMemo;
+
+// vychozi klic z vyroby, verejny klic NDEF sektoru, klic MAD
+static TKeyEntry sKeys[NFC_KEYS_MAX] = {
+    {{0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF}, false, {0, 0}},
+    {{0xD3, 0xF7, 0xD3, 0xF7, 0xD3, 0xF7}, false, {0, 0}},
+    {{0xA0, 0xA1, 0xA2, 0xA3, 0xA4, 0xA5}, false, {0, 0}},
+};
+static size_t sNumOfKeys = 3;
+static TKeyDiversify sDiversifyFunc = NULL;
+static TKeyMemo sMemo[NFC_KEYS_LRU];
+static uint32_t sMemoClock = 0;
+
+/**************************************************************************/
+/*!
+    @brief  Najde zapamatovaný klíč pro UID a sektor
+
+    @returns Pointer na záznam, NULL - Není zapamatovaný
+*/
+/**************************************************************************/
+static TKeyMemo *NFC_KeysFind(const uint8_t *aUid, uint8_t aUidLength, uint8_t aSector)
+{
+  for (size_t i = 0; i < NFC_KEYS_LRU; ++i)
+  {
+    if (sMemo[i].sUidLength == aUidLength && sMemo[i].sSector == aSector && memcmp(sMemo[i].sUid, aUid, aUidLength) == 0)
+    {
+      return &sMemo[i];
+    }
+  }
+  return NULL;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Doplní kandidáta do seznamu, diverzifikovaný klíč se odvodí
+
+    @returns Nový počet kandidátů
+*/
+/**************************************************************************/
+static size_t NFC_KeysPut(TClassicKey *aKeys, size_t aCount, size_t aIndex, uint8_t aType, const uint8_t *aUid, uint8_t aUidLength, uint8_t aSector)
+{
+  if (sKeys[aIndex].sDiversify)
+  {
+    if (sDiversifyFunc == NULL)
+    {
+      return aCount;
+    }
+    sDiversifyFunc(sKeys[aIndex].sKey, aUid, aUidLength, aSector, aKeys[aCount].sKey);
+  }
+  else
+  {
+    memcpy(aKeys[aCount].sKey, sKeys[aIndex].sKey, 6);
+  }
+  aKeys[aCount].sType = aType;
+  return aCount + 1;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Přidá klíč (např. klíč provozu) do seznamu zkoušených klíčů
+
+    @param  aKey        6 bytů klíče
+    @param  aDiversify  True - Klíč karty se odvodí funkcí z NFC_KeysSetDiversify
+
+    @returns True - Pokud se klíč přidal (nebo už v seznamu je)
+*/
+/**************************************************************************/
+bool NFC_KeysAdd(const uint8_t *aKey, bool aDiversify)
+{
+  for (size_t i = 0; i < sNumOfKeys; ++i)
+  {
+    if (memcmp(sKeys[i].sKey, aKey, 6) == 0 && sKeys[i].sDiversify == aDiversify)
+    {
+      return true;
+    }
+  }
+  if (sNumOfKeys >= NFC_KEYS_MAX)
+  {
+    return false;
+  }
+  memcpy(sKeys[sNumOfKeys].sKey, aKey, 6);
+  sKeys[sNumOfKeys].sDiversify = aDiversify;
+  sKeys[sNumOfKeys].sHits[NFC_KEY_A] = 0;
+  sKeys[sNumOfKeys].sHits[NFC_KEY_B] = 0;
+  ++sNumOfKeys;
+  return true;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Nastaví funkci pro diverzifikaci klíčů podle UID karty
+
+    @param  aDiversify  Funkce, NULL - diverzifikované klíče se nezkouší
+*/
+/**************************************************************************/
+void NFC_KeysSetDiversify(TKeyDiversify aDiversify)
+{
+  sDiversifyFunc = aDiversify;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Seřadí klíče v pořadí, ve kterém se mají zkoušet. Zapamatovaný
+            klíč karty a sektoru je první, ostatní podle počtu úspěchů.
+
+    @param  aUid        UID karty
+    @param  aUidLength  Délka UID
+    @param  aSector     Sektor
+    @param  aKeys       Výstup
+    @param  aMax        Velikost aKeys, stačí 2 * NFC_KEYS_MAX
+
+    @returns Počet kandidátů
+*/
+/**************************************************************************/
+size_t NFC_KeysCandidates(const uint8_t *aUid, uint8_t aUidLength, uint8_t aSector, TClassicKey *aKeys, size_t aMax)
+{
+  size_t iCount = 0;
+  bool iUsed[NFC_KEYS_MAX][2] = {{false}};
+  TKeyMemo *iMemo = NFC_KeysFind(aUid, aUidLength, aSector);
+  if (iMemo != NULL && iMemo->sKey < sNumOfKeys && aMax > 0)
+  {
+    iCount = NFC_KeysPut(aKeys, iCount, iMemo->sKey, iMemo->sType, aUid, aUidLength, aSector);
+    iUsed[iMemo->sKey][iMemo->sType] = true;
+  }
+  // vyber podle poctu uspechu, pri shode drive pridany klic a klic A
+  while (iCount < aMax)
+  {
+    int iBest = -1;
+    uint8_t iBestType = NFC_KEY_A;
+    for (size_t i = 0; i < sNumOfKeys; ++i)
+    {
+      for (uint8_t iType = NFC_KEY_A; iType <= NFC_KEY_B; ++iType)
+      {
+        if (!iUsed[i][iType] && (iBest < 0 || sKeys[i].sHits[iType] > sKeys[iBest].sHits[iBestType]))
+        {
+          iBest = i;
+          iBestType = iType;
+        }
+      }
+    }
+    if (iBest < 0)
+    {
+      break;
+    }
+    iUsed[iBest][iBestType] = true;
+    iCount = NFC_KeysPut(aKeys, iCount, iBest, iBestType, aUid, aUidLength, aSector);
+  }
+  return iCount;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Zapamatuje si klíč, kterým se sektor karty autentizoval.
+            Při plné tabulce se přepíše nejdéle nepoužitý záznam.
+
+    @param  aUid        UID karty
+    @param  aUidLength  Délka UID
+    @param  aSector     Sektor
+    @param  aKey        Klíč, který prošel (z NFC_KeysCandidates)
+*/
+/**************************************************************************/
+void NFC_KeysRemember(const uint8_t *aUid, uint8_t aUidLength, uint8_t aSector, const TClassicKey *aKey)
+{
+  size_t iIndex = sNumOfKeys;
+  for (size_t i = 0; i < sNumOfKeys; ++i)
+  {
+    uint8_t iKey[6];
+    if (sKeys[i].sDiversify && sDiversifyFunc != NULL)
+    {
+      sDiversifyFunc(sKeys[i].sKey, aUid, aUidLength, aSector, iKey);
+    }
+    else if (!sKeys[i].sDiversify)
+    {
+      memcpy(iKey, sKeys[i].sKey, 6);
+    }
+    else
+    {
+      continue;
+    }
+    if (memcmp(iKey, aKey->sKey, 6) == 0)
+    {
+      iIndex = i;
+      break;
+    }
+  }
+  if (iIndex == sNumOfKeys || aUidLength > sizeof(sMemo[0].sUid))
+  {
+    return;
+  }
+  if (sKeys[iIndex].sHits[aKey->sType] < UINT16_MAX)
+  {
+    ++sKeys[iIndex].sHits[aKey->sType];
+  }
+  TKeyMemo *iMemo = NFC_KeysFind(aUid, aUidLength, aSector);
+  if (iMemo == NULL)
+  {
+    iMemo = &sMemo[0];
+    for (size_t i = 1; i < NFC_KEYS_LRU && iMemo->sUidLength != 0; ++i)
+    {
+      if (sMemo[i].sUidLength == 0 || sMemo[i].sUsed < iMemo->sUsed)
+      {
+        iMemo = &sMemo[i];
+      }
+    }
+    memcpy(iMemo->sUid, aUid, aUidLength);
+    iMemo->sUidLength = aUidLength;
+    iMemo->sSector = aSector;
+  }
+  iMemo->sKey = iIndex;
+  iMemo->sType = aKey->sType;
+  iMemo->sUsed = ++sMemoClock;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Zapomene klíč sektoru karty, např. když přestal platit
+
+    @param  aUid        UID karty
+    @param  aUidLength  Délka UID
+    @param  aSector     Sektor
+*/
+/**************************************************************************/
+void NFC_KeysForget(const uint8_t *aUid, uint8_t aUidLength, uint8_t aSector)
+{
+  TKeyMemo *iMemo = NFC_KeysFind(aUid, aUidLength, aSector);
+  if (iMemo != NULL)
+  {
+    iMemo->sUidLength = 0;
+  }
+}
@@ -0,0 +1,43 @@
+/* ==========================================
+    NFC_keys - Klíče sektorů Mifare Classic
+    Copyright (c) 2023 Luboš Chmelař
+    [Licence]
+========================================== */
+#ifndef NFC_keys_H
+#define NFC_keys_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#define NFC_KEYS_MAX 8  // klicu v seznamu
+#define NFC_KEYS_LRU 32 // zapamatovanych dvojic (UID, sektor)
+#define NFC_KEY_A 0
+#define NFC_KEY_B 1
+
+  // Klic pro pn532_mifareclassic_AuthenticateBlock
+  typedef struct
+  {
+    uint8_t sKey[6];
+    uint8_t sType; // NFC_KEY_A / NFC_KEY_B
+  } TClassicKey;
+
+  // Odvozeni klice karty ze zakladniho klice (diverzifikace podle UID)
+  typedef void (*TKeyDiversify)(const uint8_t *aBase, const uint8_t *aUid, uint8_t aUidLength, uint8_t aSector, uint8_t *aKey);
+
+  bool NFC_KeysAdd(const uint8_t *aKey, bool aDiversify);
+  void NFC_KeysSetDiversify(TKeyDiversify aDiversify);
+  size_t NFC_KeysCandidates(const uint8_t *aUid, uint8_t aUidLength, uint8_t aSector, TClassicKey *aKeys, size_t aMax);
+  void NFC_KeysRemember(const uint8_t *aUid, uint8_t aUidLength, uint8_t aSector, const TClassicKey *aKey);
+  void NFC_KeysForget(const uint8_t *aUid, uint8_t aUidLength, uint8_t aSector);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
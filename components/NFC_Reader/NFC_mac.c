@@ -0,0 +1,181 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <esp_timer.h>
+#include "mbedtls/md.h"
+
+#include "NFC_mac.h"
+
+#define MACBENCHRUNS 100
+#define MACBENCHLEN 256 // vetsi nez data NTAG216
+
+typedef struct
+{
+  mbedtls_md_context_t sCtx; // klic uz je zpracovany (ipad/opad)
+  uint8_t sKey[NFC_MAC_MAXKEY];
+  size_t sKeyLen;
+  bool sReady;
+} TMacKey;
+
+static TMacKey sKeys[NFC_MAC_KEYCACHE];
+static TMacKey *sActiveKey = NULL;
+static size_t sNextKey = 0;
+
+/**************************************************************************/
+/*!
+    @brief  Nastaví klíč pro výpočet MAC. Klíč, který už v cache je, se
+            jen vybere; nový nahradí nejstarší záznam.
+
+    @param  aKey      Klíč
+    @param  aKeyLen   Délka klíče, nejvýš NFC_MAC_MAXKEY
+
+    @returns True - Pokud je klíč připravený
+*/
+/**************************************************************************/
+bool NFC_MacSetKey(const uint8_t *aKey, size_t aKeyLen)
+{
+  if (aKeyLen == 0 || aKeyLen > NFC_MAC_MAXKEY)
+  {
+    return false;
+  }
+  for (size_t i = 0; i < NFC_MAC_KEYCACHE; ++i)
+  {
+    if (sKeys[i].sReady && sKeys[i].sKeyLen == aKeyLen && memcmp(sKeys[i].sKey, aKey, aKeyLen) == 0)
+    {
+      sActiveKey = &sKeys[i];
+      return true;
+    }
+  }
+  TMacKey *iKey = &sKeys[sNextKey];
+  sNextKey = (sNextKey + 1) % NFC_MAC_KEYCACHE;
+  if (iKey->sReady)
+  {
+    mbedtls_md_free(&iKey->sCtx);
+  }
+  iKey->sReady = false;
+  if (sActiveKey == iKey)
+  {
+    sActiveKey = NULL;
+  }
+  mbedtls_md_init(&iKey->sCtx);
+  if (mbedtls_md_setup(&iKey->sCtx, mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), 1) != 0 ||
+      mbedtls_md_hmac_starts(&iKey->sCtx, aKey, aKeyLen) != 0)
+  {
+    mbedtls_md_free(&iKey->sCtx);
+    return false;
+  }
+  memcpy(iKey->sKey, aKey, aKeyLen);
+  iKey->sKeyLen = aKeyLen;
+  iKey->sReady = true;
+  sActiveKey = iKey;
+  return true;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Spočítá MAC z UID karty a dat aktuálním klíčem
+
+    @param  aUid        UID karty
+    @param  aUidLength  Délka UID
+    @param  aData       Data karty
+    @param  aLen        Délka dat
+    @param  aMac        Výstup, NFC_MAC_SIZE bytů
+
+    @returns True - Pokud se MAC spočítal
+*/
+/**************************************************************************/
+bool NFC_MacCompute(const uint8_t *aUid, uint8_t aUidLength, const uint8_t *aData, size_t aLen, uint8_t *aMac)
+{
+  uint8_t iFull[32];
+  if (sActiveKey == NULL)
+  {
+    return false;
+  }
+  // reset jen vrati kontext do stavu po zpracovani klice
+  if (mbedtls_md_hmac_reset(&sActiveKey->sCtx) != 0 ||
+      mbedtls_md_hmac_update(&sActiveKey->sCtx, aUid, aUidLength) != 0 ||
+      mbedtls_md_hmac_update(&sActiveKey->sCtx, aData, aLen) != 0 ||
+      mbedtls_md_hmac_finish(&sActiveKey->sCtx, iFull) != 0)
+  {
+    return false;
+  }
+  memcpy(aMac, iFull, NFC_MAC_SIZE);
+  return true;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Ověří MAC uložený na kartě. Porovnává se v konstantním čase.
+
+    @param  aUid        UID karty
+    @param  aUidLength  Délka UID
+    @param  aData       Data karty
+    @param  aLen        Délka dat
+    @param  aMac        MAC přečtený z karty, NFC_MAC_SIZE bytů
+
+    @returns True - Pokud MAC sedí
+*/
+/**************************************************************************/
+bool NFC_MacVerify(const uint8_t *aUid, uint8_t aUidLength, const uint8_t *aData, size_t aLen, const uint8_t *aMac)
+{
+  uint8_t iMac[NFC_MAC_SIZE];
+  uint8_t iDiff = 0;
+  if (!NFC_MacCompute(aUid, aUidLength, aData, aLen, iMac))
+  {
+    return false;
+  }
+  for (size_t i = 0; i < NFC_MAC_SIZE; ++i)
+  {
+    iDiff |= iMac[i] ^ aMac[i];
+  }
+  return iDiff == 0;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Změří a vypíše cenu MAC s jednou zpracovaným klíčem (jako
+            z cache) a se zpracováním klíče při každém výpočtu. Běží na
+            vlastním kontextu, cache klíčů ani aktivní klíč nemění. Pro
+            srovnání se softwarovým SHA stačí přeložit s vypnutým
+            CONFIG_MBEDTLS_HARDWARE_SHA.
+*/
+/**************************************************************************/
+void NFC_MacBenchmark(void)
+{
+  static const uint8_t iKey[] = "NFC_MacBenchmark";
+  static uint8_t iData[MACBENCHLEN];
+  uint8_t iUid[7] = {0x04, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66};
+  uint8_t iFull[32];
+  mbedtls_md_context_t iCtx;
+  mbedtls_md_init(&iCtx);
+  if (mbedtls_md_setup(&iCtx, mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), 1) != 0 ||
+      mbedtls_md_hmac_starts(&iCtx, iKey, sizeof(iKey) - 1) != 0)
+  {
+    mbedtls_md_free(&iCtx);
+    return;
+  }
+  int64_t iStart = esp_timer_get_time();
+  for (int i = 0; i < MACBENCHRUNS; ++i)
+  {
+    // stejne jako NFC_MacCompute s klicem z cache
+    mbedtls_md_hmac_reset(&iCtx);
+    mbedtls_md_hmac_update(&iCtx, iUid, sizeof(iUid));
+    mbedtls_md_hmac_update(&iCtx, iData, sizeof(iData));
+    mbedtls_md_hmac_finish(&iCtx, iFull);
+  }
+  int64_t iCached = esp_timer_get_time() - iStart;
+  iStart = esp_timer_get_time();
+  for (int i = 0; i < MACBENCHRUNS; ++i)
+  {
+    mbedtls_md_hmac_starts(&iCtx, iKey, sizeof(iKey) - 1);
+    mbedtls_md_hmac_update(&iCtx, iUid, sizeof(iUid));
+    mbedtls_md_hmac_update(&iCtx, iData, sizeof(iData));
+    mbedtls_md_hmac_finish(&iCtx, iFull);
+  }
+  int64_t iFresh = esp_timer_get_time() - iStart;
+  mbedtls_md_free(&iCtx);
+  printf("[NFC_MacBenchmark] MAC %d B: %lld us s klicem z cache, %lld us se zpracovanim klice\n", MACBENCHLEN, iCached / MACBENCHRUNS, iFresh / MACBENCHRUNS);
+}
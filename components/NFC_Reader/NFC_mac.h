@@ -0,0 +1,32 @@
+/* ==========================================
+    NFC_mac - Autentizace dat na NFC Čipu
+    Copyright (c) 2023 Luboš Chmelař
+    [Licence]
+========================================== */
+#ifndef NFC_mac_H
+#define NFC_mac_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#define NFC_MAC_SIZE 8      // zkraceny HMAC-SHA256, dve stranky karty
+#define NFC_MAC_KEYCACHE 4  // pocet klicu s pripravenym HMAC kontextem
+#define NFC_MAC_MAXKEY 64   // delsi klic by HMAC stejne nejdriv hashoval
+
+  // HMAC-SHA256(klic, UID | data) zkraceny na NFC_MAC_SIZE bytu, SHA pocita hardware ESP32
+  bool NFC_MacSetKey(const uint8_t *aKey, size_t aKeyLen);
+  bool NFC_MacCompute(const uint8_t *aUid, uint8_t aUidLength, const uint8_t *aData, size_t aLen, uint8_t *aMac);
+  bool NFC_MacVerify(const uint8_t *aUid, uint8_t aUidLength, const uint8_t *aData, size_t aLen, const uint8_t *aMac);
+  void NFC_MacBenchmark(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,183 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <esp_timer.h>
+#include "sdkconfig.h"
+
+#include "NFC_multi.h"
+
+#define MULTIRETRIES 1 // MxRtyPassiveActivation, bez karty se InListPassiveTarget hned vrati
+#define MULTIACKWAIT 50
+#define MULTIRFWAIT 100
+
+/**************************************************************************/
+/*!
+    @brief  Připraví prázdnou skupinu čteček
+
+    @param  aMulti    Pointer na skupinu
+    @param  aOnCard   Funkce volaná pro každou nalezenou kartu, nebo NULL
+    @param  aCtx      Parametr pro aOnCard
+*/
+/**************************************************************************/
+void NFC_MultiInit(TNFCMulti *aMulti, TNFCMultiCard aOnCard, void *aCtx)
+{
+  memset(aMulti, 0, sizeof(*aMulti));
+  aMulti->sOnCard = aOnCard;
+  aMulti->sCtx = aCtx;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Přidá do skupiny modul nastavený přes NFC_init. Moduly na
+            jedné sběrnici se liší jen SS pinem. Moduly se stejným slotem
+            mají pole zapnuté současně, sousední antény patří do různých
+            slotů.
+
+    @param  aMulti    Pointer na skupinu
+    @param  aNFC      Pointer na NFC strukturu modulu
+    @param  aSlot     Časový slot RF pole
+
+    @returns Číslo čtečky, -1 - skupina je plná
+*/
+/**************************************************************************/
+int NFC_MultiAdd(TNFCMulti *aMulti, pn532_t *aNFC, uint8_t aSlot)
+{
+  static const char *TAGin = "NFC_MultiAdd";
+  if (aMulti->sCount >= NFC_MULTI_MAX)
+  {
+    return -1;
+  }
+  TNFCReader *iReader = &aMulti->sReaders[aMulti->sCount];
+  memset(iReader, 0, sizeof(*iReader));
+  iReader->sNFC = aNFC;
+  iReader->sSlot = aSlot;
+  if (!pn532_setPassiveActivationRetries(aNFC, MULTIRETRIES) || !pn532_setRFField(aNFC, false))
+  {
+    printf("[%s] Ctecka %u neodpovida.\n", TAGin, aMulti->sCount);
+  }
+  if (aSlot >= aMulti->sSlots)
+  {
+    aMulti->sSlots = aSlot + 1;
+  }
+  aMulti->sUsed = ++aMulti->sCount;
+  return aMulti->sCount - 1;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Jedno kolo hledání karet na všech čtečkách. Sloty se střídají:
+            moduly slotu dostanou InListPassiveTarget a hledají kartu
+            současně, čtení odpovědi jednoho modulu po sběrnici se
+            překrývá s RF výměnou ostatních. Na konci slotu se jejich pole
+            vypne, aby nerušilo sousední antény.
+
+    @param  aMulti    Pointer na skupinu
+
+    @returns Počet nalezených karet
+*/
+/**************************************************************************/
+uint8_t NFC_MultiPoll(TNFCMulti *aMulti)
+{
+  int64_t iStart = esp_timer_get_time();
+  uint8_t iFound = 0;
+  for (uint8_t iSlot = 0; iSlot < aMulti->sSlots; ++iSlot)
+  {
+    for (uint8_t i = 0; i < aMulti->sUsed; ++i)
+    {
+      TNFCReader *iReader = &aMulti->sReaders[i];
+      if (iReader->sSlot == iSlot)
+      {
+        iReader->sPolling = pn532_startListPassiveTargets(iReader->sNFC, PN532_MIFARE_ISO14443A, 1, MULTIACKWAIT);
+      }
+    }
+    for (uint8_t i = 0; i < aMulti->sUsed; ++i)
+    {
+      TNFCReader *iReader = &aMulti->sReaders[i];
+      pn532_target_t iTarget;
+      if (iReader->sSlot != iSlot || !iReader->sPolling)
+      {
+        continue;
+      }
+      iReader->sPolling = false;
+      if (pn532_finishListPassiveTargets(iReader->sNFC, &iTarget, MULTIRFWAIT) == 0)
+      {
+        continue;
+      }
+      ++iReader->sCards;
+      ++aMulti->sCards;
+      ++iFound;
+      NFC_SessionAttach(&iReader->sSession, iReader->sNFC, &iTarget, 1);
+      if (aMulti->sOnCard)
+      {
+        aMulti->sOnCard(i, &iReader->sSession, aMulti->sCtx);
+      }
+    }
+    // karty slotu tim ztrati napajeni, relace plati jen v aOnCard
+    for (uint8_t i = 0; i < aMulti->sUsed; ++i)
+    {
+      if (aMulti->sReaders[i].sSlot == iSlot)
+      {
+        pn532_setRFField(aMulti->sReaders[i].sNFC, false);
+        aMulti->sReaders[i].sSession.sActive = false;
+      }
+    }
+  }
+  ++aMulti->sRounds;
+  aMulti->sTime += esp_timer_get_time() - iStart;
+  return iFound;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Vypíše propustnost skupiny: karty za sekundu celkem a po
+            čtečkách, délku jednoho kola
+
+    @param  aMulti    Pointer na skupinu
+*/
+/**************************************************************************/
+void NFC_MultiReport(TNFCMulti *aMulti)
+{
+  static const char *TAGin = "NFC_MultiReport";
+  int64_t iTime = aMulti->sTime ? aMulti->sTime : 1;
+  uint32_t iRounds = aMulti->sRounds ? aMulti->sRounds : 1;
+  printf("[%s] %u ctecek, %u slotu: %lu kol po %lld us, %lu karet, %lld karet/s.\n", TAGin, aMulti->sUsed, aMulti->sSlots,
+         aMulti->sRounds, iTime / iRounds, aMulti->sCards, (int64_t)aMulti->sCards * 1000000 / iTime);
+  for (uint8_t i = 0; i < aMulti->sUsed; ++i)
+  {
+    printf("[%s] Ctecka %u (slot %u): %lu karet, %lld karet/s.\n", TAGin, i, aMulti->sReaders[i].sSlot,
+           aMulti->sReaders[i].sCards, (int64_t)aMulti->sReaders[i].sCards * 1000000 / iTime);
+  }
+}
+
+/**************************************************************************/
+/*!
+    @brief  Změří propustnost pro 1..sCount čteček: pro každý počet
+            proběhne aRounds kol a vypíše se NFC_MultiReport
+
+    @param  aMulti    Pointer na skupinu
+    @param  aRounds   Počet kol pro každý počet čteček
+*/
+/**************************************************************************/
+void NFC_MultiBenchmark(TNFCMulti *aMulti, uint32_t aRounds)
+{
+  for (uint8_t iUsed = 1; iUsed <= aMulti->sCount; ++iUsed)
+  {
+    aMulti->sUsed = iUsed;
+    aMulti->sRounds = 0;
+    aMulti->sCards = 0;
+    aMulti->sTime = 0;
+    for (uint8_t i = 0; i < aMulti->sCount; ++i)
+    {
+      aMulti->sReaders[i].sCards = 0;
+    }
+    for (uint32_t i = 0; i < aRounds; ++i)
+    {
+      NFC_MultiPoll(aMulti);
+    }
+    NFC_MultiReport(aMulti);
+  }
+  aMulti->sUsed = aMulti->sCount;
+}
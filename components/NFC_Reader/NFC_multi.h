@@ -0,0 +1,58 @@
+/* ==========================================
+    NFC_multi - Několik modulů PN532 jako jedna čtečka
+    Copyright (c) 2023 Luboš Chmelař
+    [Licence]
+========================================== */
+#ifndef NFC_multi_H
+#define NFC_multi_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "NFC_reader.h"
+
+#define NFC_MULTI_MAX 4
+
+  // Volá se pro každou nalezenou kartu, dokud je RF pole modulu zapnuté
+  typedef void (*TNFCMultiCard)(uint8_t aReader, TNFCSession *aSession, void *aCtx);
+
+  typedef struct
+  {
+    pn532_t *sNFC;
+    uint8_t sSlot;        // casovy slot RF pole, sousedni anteny maji ruzne sloty
+    TNFCSession sSession; // relace s posledni nalezenou kartou
+    bool sPolling;        // InListPassiveTarget odeslan, ceka se na odpoved
+    uint32_t sCards;      // pocet nalezenych karet
+  } TNFCReader;
+
+  // Moduly na jedne sbernici (vlastni SS) nebo na vice sbernicich, obsluhuje je jedna uloha
+  typedef struct
+  {
+    TNFCReader sReaders[NFC_MULTI_MAX];
+    uint8_t sCount;
+    uint8_t sUsed;  // obsluhuje se prvnich sUsed ctecek (NFC_MultiBenchmark)
+    uint8_t sSlots; // pocet casovych slotu RF pole
+    TNFCMultiCard sOnCard;
+    void *sCtx;
+    uint32_t sRounds;
+    uint32_t sCards;
+    int64_t sTime; // us v NFC_MultiPoll
+  } TNFCMulti;
+
+  void NFC_MultiInit(TNFCMulti *aMulti, TNFCMultiCard aOnCard, void *aCtx);
+  int NFC_MultiAdd(TNFCMulti *aMulti, pn532_t *aNFC, uint8_t aSlot);
+  uint8_t NFC_MultiPoll(TNFCMulti *aMulti);
+  void NFC_MultiReport(TNFCMulti *aMulti);
+  void NFC_MultiBenchmark(TNFCMulti *aMulti, uint32_t aRounds);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -11,15 +11,50 @@
 #include "freertos/timers.h"
 
 #include <esp_log.h>
+#include <esp_timer.h>
 #include "sdkconfig.h"
 
 #include "NFC_reader.h"
+#include "NFC_crc.h"
+#include "NFC_mac.h"
+#include "NFC_keys.h"
 #include "pn532.h"
 
 #define OFFSETDATA 8
 #define PAGESIZE 4
+#define READWINDOW (4 * PAGESIZE) // jeden READ vraci 4 stranky
 #define MAXERRORREADING 5
 #define TIMEOUTCHECKCARD 200
+#define DIRTYWORD(page) ((page) / 32)
+#define DIRTYBIT(page) (1UL << ((page) % 32))
+#define MAXPAGES 256 // stranky karty se adresuji jednim bytem
+#define WRITEBENCHSTRUCTS 4 // 4 struktury po 5 B = 20 B na 5 strankach
+#define CLASSICBLOCK 16      // Mifare Classic cte a zapisuje po 16 B blocich
+#define CLASSICFIRSTBLOCK 4  // sektor 0 nese vyrobni blok, data jsou od sektoru 1
+#define CLASSICLASTBLOCK 255 // Mifare Classic 4K
+// typ karty podle pn532_detectTag, pokud se nepodari rozpoznat, podle delky UID
+#define ISCLASSIC(session) ((session)->sTag.type >= PN532_TAG_CLASSIC_MINI || ((session)->sTag.type == PN532_TAG_UNKNOWN && (session)->sUidLength == 4))
+#define ISTYPE2(session) ((session)->sTag.type != PN532_TAG_UNKNOWN ? (session)->sTag.type < PN532_TAG_CLASSIC_MINI : (session)->sUidLength == 7)
+
+#ifdef CONFIG_NFC_TEARPROOF
+#define TEARPROOF 1 // data ve dvou slotech s poradovym cislem a CRC
+#else
+#define TEARPROOF 0
+#endif
+
+#ifdef CONFIG_NFC_IMAGE_CRC
+#define IMAGECRC 1 // za daty jedna stranka s CRC32 dat
+#else
+#define IMAGECRC 0
+#endif
+
+#ifdef CONFIG_NFC_MAC
+#define IMAGEMAC 1 // za daty (a CRC) MAC pres UID a data
+#else
+#define IMAGEMAC 0
+#endif
+#define MACPAGES (NFC_MAC_SIZE / PAGESIZE)
+#define TRAILERPAGES (IMAGECRC + IMAGEMAC * MACPAGES)
 
 #define NFC_READER_ALL_DEBUG_EN 0
 #define NFC_READER_DEBUG_EN 1
@@ -61,6 +96,25 @@
 #define _STRINGIFY(s) #s
 #define STRINGIFY(s) _STRINGIFY(s)
 
+static bool NFC_SessionReadPage(TNFCSession *aSession, uint8_t aPage, uint8_t *aData);
+static pn532_write_status_t NFC_SessionWritePage(TNFCSession *aSession, uint8_t aPage, uint8_t *aData);
+static size_t NFC_NumOfPages(TCardInfo *aCardInfo);
+static bool NFC_Alloc(TCardInfo *aCardInfo, size_t aCapacity);
+static size_t NFC_ImageSize(TCardInfo *aCardInfo);
+static size_t NFC_TagCapacity(TNFCSession *aSession);
+static void NFC_SessionDetect(TNFCSession *aSession);
+static bool NFC_SessionUse(TNFCSession *aSession);
+static size_t NFC_WritePages(TNFCSession *aSession, TCardInfo *aCardInfo, const uint32_t *aPages, TPageStatus *aPageStatus);
+static bool NFC_ReadPages(TNFCSession *aSession, uint8_t aFirstPage, size_t aPages, uint8_t *aBuffer, size_t *aReads, uint32_t *aCrc, size_t aCrcLen);
+static void NFC_SelectSlot(TNFCSession *aSession, TCardInfo *aCardInfo, const uint8_t *aRaw);
+static uint8_t NFC_CommitImage(TNFCSession *aSession, TCardInfo *aCardInfo, const uint8_t *aImage, TPageStatus *aPageStatus);
+static int16_t NFC_ClassicNextBlock(TNFCSession *aSession, int16_t aBlock);
+static int16_t NFC_ClassicBlock(TNFCSession *aSession, size_t aIndex);
+static bool NFC_ClassicReadBlock(TNFCSession *aSession, uint8_t aBlock, uint8_t *aData);
+static pn532_write_status_t NFC_ClassicWriteBlock(TNFCSession *aSession, uint8_t aBlock, uint8_t *aData);
+static bool NFC_ClassicReadBytes(TNFCSession *aSession, size_t aBytes, uint8_t *aBuffer, size_t *aReads, uint32_t *aCrc, size_t aCrcLen);
+static size_t NFC_ClassicWritePages(TNFCSession *aSession, TCardInfo *aCardInfo, const uint32_t *aPages, TPageStatus *aPageStatus, size_t *aWritten);
+
 /**************************************************************************/
 /*!
     @brief  Inicializace PN532 desky a vytvoření pole struktur TDataNFC, podle velikosti NFC Čipu
@@ -82,12 +136,52 @@ bool NFC_init(pn532_t *aNFC, size_t aCapacity, TCardInfo *aCardInfo, uint8_t aCl
   NFC_READER_DEBUG(TAGin, "Inicializuji kartu:\n");
   aCardInfo->sSize = aCapacity;
   NFC_READER_ALL_DEBUG(TAGin, "Velikost pameti je %zu. \n", aCardInfo->sSize);
+#if defined(CONFIG_PN532_HSU)
+  if (!pn532_hsu_init(aNFC, CONFIG_PN532_HSU_PORT, CONFIG_PN532_HSU_TX, CONFIG_PN532_HSU_RX))
+  {
+    NFC_READER_DEBUG(TAGin, "Nelze nastavit UART.\n");
+    return false;
+  }
+#elif defined(CONFIG_PN532_HW_SPI)
+  if (!pn532_spi_init_hw(aNFC, CONFIG_PN532_SPI_HOST, aClk, aMiso, aMosi, aSs, CONFIG_PN532_SPI_CLOCK_KHZ * 1000))
+  {
+    NFC_READER_DEBUG(TAGin, "Nelze nastavit hardwarove SPI.\n");
+    return false;
+  }
+#else
   pn532_spi_init(aNFC, aClk, aMiso, aMosi, aSs);
+#endif
+#if defined(CONFIG_PN532_IRQ) && CONFIG_PN532_IRQ >= 0
+  if (!pn532_irq_init(aNFC, CONFIG_PN532_IRQ))
+  {
+    NFC_READER_DEBUG(TAGin, "IRQ pin nelze pouzit, ctu stav pres SPI.\n");
+  }
+#endif
   pn532_begin(aNFC);
 
-  size_t NumOfBlocks = aCapacity / TDataNFC_Size;
-  aCardInfo->sNumOfBlocks = NumOfBlocks;
-  (aCardInfo->sDataNFC) = (TDataNFC *)malloc(TDataNFC_Size * NumOfBlocks);
+  aCardInfo->sDataNFC = NULL;
+  aCardInfo->sCardImage = NULL;
+  aCardInfo->sSpareImage = NULL;
+  aCardInfo->sDirtyPages = NULL;
+  aCardInfo->sNumOfBlocks = 0;
+  // aCapacity 0: pamet se alokuje podle karty v NFC_LoadNFC
+  if (aCapacity != 0 && !NFC_Alloc(aCardInfo, aCapacity))
+  {
+    NFC_READER_DEBUG(TAGin, "Nedostatek pameti.\n");
+    return false;
+  }
+#if defined(CONFIG_NFC_MAC)
+  if (strlen(CONFIG_NFC_MAC_KEY) == 0)
+  {
+    NFC_READER_DEBUG(TAGin, "MAC je zapnuty, ale klic (CONFIG_NFC_MAC_KEY) neni nastaveny.\n");
+    return false;
+  }
+  if (!NFC_MacSetKey((const uint8_t *)CONFIG_NFC_MAC_KEY, strlen(CONFIG_NFC_MAC_KEY)))
+  {
+    NFC_READER_DEBUG(TAGin, "Nelze pripravit klic pro MAC.\n");
+    return false;
+  }
+#endif
 
   uint32_t versiondata = pn532_getFirmwareVersion(aNFC);
   if (!versiondata)
@@ -96,172 +190,1023 @@ bool NFC_init(pn532_t *aNFC, size_t aCapacity, TCardInfo *aCardInfo, uint8_t aCl
     return false;
   }
   // Got ok data, print it out!
-  NFC_READER_DEBUG(TAGin, "Našla se deska PN5 %lu.\n", (versiondata >> 24) & 0xFF);
+  NFC_READER_DEBUG(TAGin, "Našla se deska PN5%lx.\n", (versiondata >> 24) & 0xFF);
   NFC_READER_ALL_DEBUG(TAGin, "Firmware ver. %lu.%lu. \n", (versiondata >> 16) & 0xFF, (versiondata >> 8) & 0xFF);
+#if defined(CONFIG_PN532_HSU)
+  if (CONFIG_PN532_HSU_BAUD != PN532_HSU_BAUDRATE)
+  {
+    // doba jedne vymeny (GetFirmwareVersion) pred a po zmene rychlosti
+    int64_t iStart = esp_timer_get_time();
+    pn532_getFirmwareVersion(aNFC);
+    int64_t iSlow = esp_timer_get_time() - iStart;
+    if (!pn532_hsu_setbaudrate(aNFC, CONFIG_PN532_HSU_BAUD))
+    {
+      NFC_READER_DEBUG(TAGin, "PN532 neprijal rychlost %d Bd.\n", CONFIG_PN532_HSU_BAUD);
+      return false;
+    }
+    iStart = esp_timer_get_time();
+    pn532_getFirmwareVersion(aNFC);
+    int64_t iFast = esp_timer_get_time() - iStart;
+    NFC_READER_ALL_DEBUG(TAGin, "Vymena trva %lld us pri %d Bd, %lld us pri %d Bd.\n", iSlow, PN532_HSU_BAUDRATE, iFast, CONFIG_PN532_HSU_BAUD);
+  }
+#endif
   pn532_SAMConfig(aNFC);
   return true;
 }
 
 /**************************************************************************/
 /*!
-    @brief  Zaplnění TDataNFC struktury daty z NFC čipu
+    @brief  Otevře relaci s kartou: vybere kartu (InListPassiveTarget) a
+            zapamatuje si její UID. Další operace běží v této relaci bez
+            nového výběru karty.
 
-    @param  aNFC      Pointer na NFC
-    @param  aDataNFC  Pointer na pole TDataNFC struktur
-    @param  anumOfNFCStruct       Číslo struktury, kterou chceme načíst z NFC Čipu
+    @param  aSession  Pointer na relaci
+    @param  aNFC      Pointer na NFC strukturu
+    @param  aTimeout  Doba čekání na kartu v ms, 0 - čeká se neomezeně
 
-    @returns Chybový kód(0 - Nacteno správně, 1 - Nelze číst z MifareUltralight čipu)//TODO
+    @returns True - Pokud se karta vybrala
 */
 /**************************************************************************/
-uint8_t NFC_GetStructData(pn532_t *aNFC, TDataNFC *aDataNFC, uint16_t anumOfNFCStruct)
+bool NFC_SessionOpen(TNFCSession *aSession, pn532_t *aNFC, uint16_t aTimeout)
 {
-  static const char *TAGin = "NFC_GetStructData";
+  static const char *TAGin = "NFC_SessionOpen";
+  aSession->sNFC = aNFC;
+  aSession->sDataPage = OFFSETDATA;
+  aSession->sActive = false;
+  aSession->sAuthSector = -1;
+  aSession->sTargets = 1;
   NFC_READER_DEBUG(TAGin, "Cekam na kartu ISO14443A Card: ");
   fflush(stdout);
-  uint8_t success;
-  uint8_t uid[] = {0, 0, 0, 0, 0, 0, 0}; // Buffer to store the returned UID
-  uint8_t uidLength;                     // Length of the UID (4 or 7 bytes depending on ISO14443A card type)
-
-  // Wait for an ISO14443A type cards (Mifare, etc.).  When one is found
-  // 'uid' will be populated with the UID, and uidLength will indicate
-  // if the uid is 4 bytes (Mifare Classic) or 7 bytes (Mifare Ultralight)
-  success = pn532_readPassiveTargetID(aNFC, PN532_MIFARE_ISO14443A, uid, &uidLength, 0);
+  if (!pn532_readPassiveTargetID(aNFC, PN532_MIFARE_ISO14443A, aSession->sUid, &aSession->sUidLength, aTimeout))
+  {
+    NFC_READER_DEBUG("", "Vyprsel cas cekani na kartu\n");
+    return false;
+  }
   NFC_READER_DEBUG("", "Karta Prilozena\n");
-  if (success)
+  NFC_SessionDetect(aSession);
+  return true;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Vybere najednou až PN532_MAXTARGETS karet v poli (např. dvě
+            karty v peněžence) a otevře pro každou vlastní relaci. Operace
+            s relací si svou kartu vyberou samy, obě karty lze číst i
+            zapisovat bez nového přiložení.
+
+    @param  aSessions Pole aMax relací
+    @param  aMax      Nejvýše karet, 1..PN532_MAXTARGETS
+    @param  aNFC      Pointer na NFC strukturu
+    @param  aTimeout  Doba čekání na kartu v ms, 0 - čeká se neomezeně
+
+    @returns Počet otevřených relací, 0 - žádná karta
+*/
+/**************************************************************************/
+uint8_t NFC_SessionOpenAll(TNFCSession *aSessions, uint8_t aMax, pn532_t *aNFC, uint16_t aTimeout)
+{
+  static const char *TAGin = "NFC_SessionOpenAll";
+  pn532_target_t iTargets[PN532_MAXTARGETS];
+  if (aMax == 0)
+  {
+    return 0;
+  }
+  if (aMax > PN532_MAXTARGETS)
+  {
+    aMax = PN532_MAXTARGETS;
+  }
+  uint8_t iCount = pn532_listPassiveTargets(aNFC, PN532_MIFARE_ISO14443A, aMax, iTargets, aTimeout);
+  for (uint8_t i = 0; i < iCount; ++i)
+  {
+    NFC_SessionAttach(&aSessions[i], aNFC, &iTargets[i], iCount);
+  }
+  NFC_READER_DEBUG(TAGin, "Prilozeno karet: %u\n", iCount);
+  return iCount;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Otevře relaci s kartou, kterou už PN532 vybral
+            (pn532_listPassiveTargets, pn532_finishListPassiveTargets)
+
+    @param  aSession  Pointer na relaci
+    @param  aNFC      Pointer na NFC strukturu
+    @param  aTarget   Vybraná karta
+    @param  aTargets  Kolik karet se vybíralo najednou (MaxTg)
+
+    @returns True - Pokud se určil typ karty
+*/
+/**************************************************************************/
+bool NFC_SessionAttach(TNFCSession *aSession, pn532_t *aNFC, const pn532_target_t *aTarget, uint8_t aTargets)
+{
+  aSession->sNFC = aNFC;
+  aSession->sDataPage = OFFSETDATA;
+  aSession->sActive = false;
+  aSession->sAuthSector = -1;
+  aSession->sTargets = aTargets;
+  memcpy(aSession->sUid, aTarget->uid, aTarget->uidLen);
+  aSession->sUidLength = aTarget->uidLen;
+  NFC_SessionDetect(aSession);
+  return aSession->sActive;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Otevře relaci s kartou, kterou najde PN532 sám (InAutoPoll).
+            Procesor mezitím spí, s IRQ nebo HSU bez provozu na sběrnici.
+
+    @param  aSession  Pointer na relaci
+    @param  aNFC      Pointer na NFC strukturu
+    @param  aRounds   Počet kol hledání, PN532_AUTOPOLL_ENDLESS - bez omezení
+    @param  aPeriod   Perioda hledání karty v násobcích 150 ms (1..15)
+    @param  aTimeout  Doba čekání na kartu v ms, 0 - čeká se neomezeně
+
+    @returns True - Pokud se karta našla a vybrala
+*/
+/**************************************************************************/
+bool NFC_SessionAutoPoll(TNFCSession *aSession, pn532_t *aNFC, uint8_t aRounds, uint8_t aPeriod, uint16_t aTimeout)
+{
+  static const char *TAGin = "NFC_SessionAutoPoll";
+  aSession->sNFC = aNFC;
+  aSession->sDataPage = OFFSETDATA;
+  aSession->sActive = false;
+  aSession->sAuthSector = -1;
+  aSession->sTargets = 1;
+  if (!pn532_inAutoPoll(aNFC, aRounds, aPeriod, aSession->sUid, &aSession->sUidLength, aTimeout))
+  {
+    return false;
+  }
+  NFC_READER_DEBUG(TAGin, "Karta Prilozena\n");
+  NFC_SessionDetect(aSession);
+  return true;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Po výběru karty určí její typ a rozložení paměti
+
+    @param  aSession  Pointer na relaci s právě vybranou kartou
+*/
+/**************************************************************************/
+static void NFC_SessionDetect(TNFCSession *aSession)
+{
+  static const char *TAGin = "NFC_SessionDetect";
+  if (!NFC_SessionUse(aSession))
+  {
+    return;
+  }
+  aSession->sActive = true;
+  if (!pn532_detectTag(aSession->sNFC, &aSession->sTag))
+  {
+    // karta muze byt po neuspesnem GET_VERSION v IDLE
+    NFC_READER_DEBUG(TAGin, "Typ karty se nepodarilo urcit, ridim se delkou UID.\n");
+    aSession->sActive = false;
+  }
+}
+
+/**************************************************************************/
+/*!
+    @brief  Znovu vybere kartu relace, když přestala odpovídat, a ověří,
+            že jde o stejnou kartu
+
+    @param  aSession  Pointer na relaci
+
+    @returns True - Pokud je na čtečce stejná karta
+*/
+/**************************************************************************/
+bool NFC_SessionReactivate(TNFCSession *aSession)
+{
+  static const char *TAGin = "NFC_SessionReactivate";
+  aSession->sActive = false;
+  // novy vyber karty rusi autentizaci sektoru Mifare Classic
+  aSession->sAuthSector = -1;
+  if (aSession->sUidLength == 0)
+  {
+    return false;
+  }
+  NFC_READER_ALL_DEBUG(TAGin, "Znovu vybiram kartu.\n");
+  // vyberou se znovu vsechny karty relaci, druha karta zustane dostupna
+  if (pn532_listPassiveTargets(aSession->sNFC, PN532_MIFARE_ISO14443A, aSession->sTargets, NULL, TIMEOUTCHECKCARD) == 0)
+  {
+    return false;
+  }
+  if (!pn532_selectTarget(aSession->sNFC, aSession->sUid, aSession->sUidLength))
+  {
+    NFC_READER_DEBUG(TAGin, "Na ctecce je jina karta.\n");
+    return false;
+  }
+  aSession->sSelectCount = pn532_selectCount(aSession->sNFC);
+  aSession->sActive = true;
+  return true;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Nastaví kartu relace jako aktivní cíl PN532 (při dvou kartách
+            v poli). Po práci s jinou kartou neplatí autentizace sektoru.
+
+    @param  aSession  Pointer na relaci
+
+    @returns True - Pokud je karta mezi vybranými, jinak ji příští
+             operace vybere znovu
+*/
+/**************************************************************************/
+static bool NFC_SessionUse(TNFCSession *aSession)
+{
+  if (aSession->sUidLength == 0 || !pn532_selectTarget(aSession->sNFC, aSession->sUid, aSession->sUidLength))
   {
+    aSession->sActive = false;
+    return false;
+  }
+  if (aSession->sSelectCount != pn532_selectCount(aSession->sNFC))
+  {
+    aSession->sAuthSector = -1;
+    aSession->sSelectCount = pn532_selectCount(aSession->sNFC);
+  }
+  return true;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Ukončí relaci a uvolní kartu (InRelease)
+
+    @param  aSession  Pointer na relaci
+*/
+/**************************************************************************/
+void NFC_SessionClose(TNFCSession *aSession)
+{
+  static const char *TAGin = "NFC_SessionClose";
+  NFC_SessionUse(aSession);
+  if (aSession->sActive && !pn532_inRelease(aSession->sNFC))
+  {
+    NFC_READER_ALL_DEBUG(TAGin, "InRelease selhal.\n");
+  }
+  aSession->sActive = false;
+  aSession->sUidLength = 0;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Přečte 4 stránky v relaci, při chybě kartu znovu vybere
+
+    @param  aSession  Pointer na relaci
+    @param  aPage     První čtená stránka
+    @param  aData     Pole na 4 * PAGESIZE bytů
 
-    if (uidLength == 4)
+    @returns True - Pokud se stránky přečetly
+*/
+/**************************************************************************/
+static bool NFC_SessionReadPage(TNFCSession *aSession, uint8_t aPage, uint8_t *aData)
+{
+  NFC_SessionUse(aSession);
+  for (size_t i = 0; i < MAXERRORREADING; ++i)
+  {
+    if ((aSession->sActive || NFC_SessionReactivate(aSession)) && pn532_mifareultralight_ReadPage(aSession->sNFC, aPage, aData))
     {
-      NFC_READER_ALL_DEBUG(TAGin, "Jedná se o Mifare Classic kartu (4 byte UID)");
+      return true;
+    }
+    // po chybe je tag v IDLE, pristi pokus ho znovu vybere
+    aSession->sActive = false;
+  }
+  return false;
+}
 
-      // Now we need to try to authenticate it for read/write access
-      // Try with the factory default KeyA: 0xFF 0xFF 0xFF 0xFF 0xFF 0xFF
-      ESP_LOGI(TAGin, "Trying to authenticate block 4 with default KEYA value");
-      uint8_t keya[6] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+/**************************************************************************/
+/*!
+    @brief  Zapíše jednu stránku v relaci, při výpadku kartu znovu vybere.
+            NAK od karty se neopakuje, karta zápis odmítla.
 
-      success = pn532_mifareclassic_AuthenticateBlock(aNFC, uid, uidLength, 4, 0, keya);
+    @param  aSession  Pointer na relaci
+    @param  aPage     Zapisovaná stránka
+    @param  aData     PAGESIZE bytů
 
-      if (success)
-      {
-        ESP_LOGI(TAGin, "Sector 1 (Blocks 4..7) has been authenticated");
-        uint8_t data[16];
+    @returns Odpověď karty na poslední pokus (PN532_WRITE_ACK - zapsáno)
+*/
+/**************************************************************************/
+static pn532_write_status_t NFC_SessionWritePage(TNFCSession *aSession, uint8_t aPage, uint8_t *aData)
+{
+  pn532_write_status_t iStatus = PN532_WRITE_TIMEOUT;
+  NFC_SessionUse(aSession);
+  for (size_t i = 0; i < MAXERRORREADING; ++i)
+  {
+    if (!aSession->sActive && !NFC_SessionReactivate(aSession))
+    {
+      iStatus = PN532_WRITE_TIMEOUT;
+      continue;
+    }
+    iStatus = pn532_mifareultralight_WritePageStatus(aSession->sNFC, aPage, aData);
+    if (iStatus == PN532_WRITE_ACK)
+    {
+      return iStatus;
+    }
+    // po chybe je tag v IDLE
+    aSession->sActive = false;
+    if (iStatus == PN532_WRITE_NAK)
+    {
+      return iStatus;
+    }
+  }
+  return iStatus;
+}
 
-        success = pn532_mifareclassic_ReadDataBlock(aNFC, 4, data);
-        if (success)
-        {
-          // Data seems to have been read ... spit it out
-          ESP_LOGI(TAGin, "Reading Block 4:");
-          for (int i = 0; i < 16; ++i)
-          {
-            ESP_LOGI(TAGin, "%d", data[i]);
-          }
-
-          // Wait a bit before reading the card again
-          // vTaskDelay(1000 / portTICK_PERIOD_MS);
-        }
-        else
-        {
-          ESP_LOGI(TAGin, "Ooops ... unable to read the requested block.  Try another key?");
-          return 2; // Cannot read requested block
-        }
+/**************************************************************************/
+/*!
+    @brief  Zaplnění TDataNFC struktury daty z NFC čipu
+
+    @param  aSession  Pointer na relaci s kartou
+    @param  aDataNFC  Pointer na pole TDataNFC struktur
+    @param  anumOfNFCStruct       Číslo struktury, kterou chceme načíst z NFC Čipu
+
+    @returns Chybový kód(0 - Nacteno správně, 1 - Nelze číst z MifareUltralight čipu, 2 - Nelze číst z Mifare Classic čipu, 5 - Karta není přiložena)
+*/
+/**************************************************************************/
+uint8_t NFC_GetStructData(TNFCSession *aSession, TDataNFC *aDataNFC, uint16_t anumOfNFCStruct)
+{
+  static const char *TAGin = "NFC_GetStructData";
+
+  if (!aSession->sActive && !NFC_SessionReactivate(aSession))
+  {
+    // PN532 probably timed out waiting for a card
+    NFC_READER_DEBUG(TAGin, "Vyprsel cas cekani na kartu");
+    return 5;
+  }
+
+  if (ISCLASSIC(aSession))
+  {
+    NFC_READER_ALL_DEBUG(TAGin, "Jedná se o Mifare Classic kartu\n");
+
+    // struktura muze zasahovat do dvou bloku, trailery sektoru se preskakuji
+    uint8_t data[((sizeof(TDataNFC) + CLASSICBLOCK - 1) / CLASSICBLOCK + 1) * CLASSICBLOCK];
+    size_t iOffset = TDataNFC_Size * anumOfNFCStruct;
+    size_t iBlocks = (iOffset % CLASSICBLOCK + TDataNFC_Size + CLASSICBLOCK - 1) / CLASSICBLOCK;
+    for (size_t i = 0; i < iBlocks; ++i)
+    {
+      int16_t iBlock = NFC_ClassicBlock(aSession, iOffset / CLASSICBLOCK + i);
+      if (iBlock < 0 || !NFC_ClassicReadBlock(aSession, iBlock, data + i * CLASSICBLOCK))
+      {
+        NFC_READER_DEBUG(TAGin, "Nelze cist z karty!\n");
+        return 2;
       }
-      else
+    }
+    memcpy(aDataNFC, data + iOffset % CLASSICBLOCK, TDataNFC_Size);
+    NFC_READER_DEBUG(TAGin, "Nacteno!\n");
+    return 0;
+  }
+  else if (ISTYPE2(aSession))
+  {
+    NFC_READER_ALL_DEBUG(TAGin, "Jedná se o Mifare Ultralight / NTAG tag\n");
+
+    uint8_t data[4 * PAGESIZE]; // READ vraci 4 stranky
+    if (NFC_SessionReadPage(aSession, ((TDataNFC_Size * anumOfNFCStruct) / PAGESIZE) + aSession->sDataPage, data))
+    {
+      NFC_READER_ALL_DEBUG(TAGin, "Sektor: %X:    ", ((TDataNFC_Size * anumOfNFCStruct) / PAGESIZE) + aSession->sDataPage);
+      // Data seems to have been read ... spit it out
+      for (int j = 0; j < TDataNFC_Size; ++j)
       {
-        ESP_LOGI(TAGin, "Ooops ... authentication failed: Try another key?");
-        return 3;
+        NFC_READER_ALL_DEBUG("", "%d:%x  ", j, data[j + (TDataNFC_Size * anumOfNFCStruct) % PAGESIZE]);
+        ((uint8_t *)aDataNFC)[j] = data[j + (TDataNFC_Size * anumOfNFCStruct) % PAGESIZE];
       }
+      NFC_READER_ALL_DEBUG("", "\n");
     }
-    else if (uidLength == 7)
+    else
     {
-      // We probably have a Mifare Ultralight card ...
-      NFC_READER_ALL_DEBUG(TAGin, "Jedná se o Mifare Ultralight tag (7 byte UID)\n");
-      // ESP_LOGI(TAG, "Reading page ");
-      // ESP_LOGI(TAG,  "%d\n",i );
+      NFC_READER_DEBUG(TAGin, "Nelze cist z karty!\n");
+      return 1;
+    }
+
+    NFC_READER_DEBUG(TAGin, "Nacteno!\n");
 
-      uint8_t data[TDataNFC_Size];
-      success = pn532_mifareultralight_ReadPage(aNFC, ((TDataNFC_Size * anumOfNFCStruct) / PAGESIZE) + OFFSETDATA, data);
-      if (success)
+    return 0;
+  }
+  return 0;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Načteni Cele editovatelné části do NFC Čipu
+
+    Běží v otevřené relaci, karta se tedy znovu nevybírá. NTAG21x / Ultralight EV1 se přečte pomocí
+    FAST_READ na co nejméně výměn, starší karty po 16 B oknech (jeden READ
+    = 4 stránky). Data jdou přímo do aCardInfo->sDataNFC a opakuje se jen
+    okno, které se nepodařilo přečíst.
+
+    @param  aSession  Pointer na otevřenou relaci s kartou
+    @param  aCardInfo Pointer na TCardInfo strukturu
+
+    @returns True - Pokud se Data načetla
+*/
+/**************************************************************************/
+bool NFC_LoadNFC(TNFCSession *aSession, TCardInfo *aCardInfo)
+{
+  static const char *TAGin = "NFC_LoadNFC";
+  int64_t iStart = esp_timer_get_time();
+  NFC_READER_DEBUG(TAGin, "Nacitam vsechny data z karty\n");
+  if (!aSession->sActive && !NFC_SessionReactivate(aSession))
+  {
+    NFC_READER_DEBUG(TAGin, "Vyprsel cas cekani na kartu.\n");
+    return false;
+  }
+  NFC_saveUID(aCardInfo, aSession->sUid, aSession->sUidLength);
+  if (!ISTYPE2(aSession) && (!ISCLASSIC(aSession) || TEARPROOF))
+  {
+    NFC_READER_DEBUG(TAGin, "Hromadne cteni umi jen Mifare Ultralight / NTAG a Mifare Classic (bez odolneho zapisu).\n");
+    return false;
+  }
+  if (aCardInfo->sDataNFC == NULL)
+  {
+    // NFC_init s nulovou kapacitou: velikost podle karty
+    if (aSession->sTag.type == PN532_TAG_UNKNOWN || !NFC_Alloc(aCardInfo, NFC_TagCapacity(aSession)))
+    {
+      NFC_READER_DEBUG(TAGin, "Nelze urcit velikost dat z karty.\n");
+      return false;
+    }
+    NFC_READER_DEBUG(TAGin, "Na karte je misto pro %zu struktur.\n", aCardInfo->sNumOfBlocks);
+  }
+  else if (aSession->sTag.type != PN532_TAG_UNKNOWN && NFC_NumOfPages(aCardInfo) * PAGESIZE > NFC_TagCapacity(aSession))
+  {
+    NFC_READER_DEBUG(TAGin, "Data se na kartu nevejdou.\n");
+    return false;
+  }
+
+  size_t iPages = NFC_NumOfPages(aCardInfo);
+  size_t iReads = 0;
+  if (TEARPROOF)
+  {
+    // oba sloty jednim ctenim, obnova po pretrzenem zapisu je soucasti nacteni
+    size_t iRawPages = 2 * (iPages + 1);
+    uint8_t *iRaw = (uint8_t *)malloc(((iRawPages * PAGESIZE + READWINDOW - 1) / READWINDOW) * READWINDOW);
+    if (iRaw == NULL)
+    {
+      return false;
+    }
+    if (!NFC_ReadPages(aSession, OFFSETDATA, iRawPages, iRaw, &iReads, NULL, 0))
+    {
+      NFC_READER_DEBUG(TAGin, STRINGIFY(MAXERRORREADING) "x se nepodarilo nacist hodnotu.\n");
+      free(iRaw);
+      return false;
+    }
+    NFC_SelectSlot(aSession, aCardInfo, iRaw);
+    free(iRaw);
+  }
+  else
+  {
+    uint32_t iCrc;
+    bool iRead;
+    if (ISCLASSIC(aSession))
+    {
+      iRead = NFC_ClassicReadBytes(aSession, (iPages + TRAILERPAGES) * PAGESIZE, (uint8_t *)aCardInfo->sDataNFC, &iReads, &iCrc, iPages * PAGESIZE);
+    }
+    else
+    {
+      iRead = NFC_ReadPages(aSession, OFFSETDATA, iPages + TRAILERPAGES, (uint8_t *)aCardInfo->sDataNFC, &iReads, &iCrc, iPages * PAGESIZE);
+    }
+    if (!iRead)
+    {
+      NFC_READER_DEBUG(TAGin, STRINGIFY(MAXERRORREADING) "x se nepodarilo nacist hodnotu.\n");
+      return false;
+    }
+    if (IMAGECRC)
+    {
+      const uint8_t *iStored = (uint8_t *)aCardInfo->sDataNFC + iPages * PAGESIZE;
+      aCardInfo->sCrcValid = iCrc == (iStored[0] | (iStored[1] << 8) | (iStored[2] << 16) | ((uint32_t)iStored[3] << 24));
+      if (!aCardInfo->sCrcValid)
       {
-        NFC_READER_ALL_DEBUG(TAGin, "Sektor: %X:    ", ((TDataNFC_Size * anumOfNFCStruct) / PAGESIZE) + OFFSETDATA);
-        // Data seems to have been read ... spit it out
-        for (int j = 0; j < TDataNFC_Size; ++j)
-        {
-          NFC_READER_ALL_DEBUG("", "%d:%x  ", j, data[j + (TDataNFC_Size * anumOfNFCStruct) % PAGESIZE]);
-          ((uint8_t *)aDataNFC)[j] = data[j + (TDataNFC_Size * anumOfNFCStruct) % PAGESIZE];
-        }
-        NFC_READER_ALL_DEBUG("", "\n");
+        NFC_READER_DEBUG(TAGin, "CRC dat nesedi, data na karte jsou poskozena!\n");
       }
-      else
+    }
+    if (IMAGEMAC)
+    {
+      const uint8_t *iStored = (uint8_t *)aCardInfo->sDataNFC + (iPages + IMAGECRC) * PAGESIZE;
+      aCardInfo->sMacValid = NFC_MacVerify(aSession->sUid, aSession->sUidLength, (uint8_t *)aCardInfo->sDataNFC, iPages * PAGESIZE, iStored);
+      if (!aCardInfo->sMacValid)
       {
-        NFC_READER_DEBUG(TAGin, "Nelze cist z karty!\n");
-        return 1;
+        NFC_READER_DEBUG(TAGin, "MAC dat nesedi, data na karte nejsou pravá!\n");
       }
+    }
+    aSession->sDataPage = OFFSETDATA;
+    // nactena data jsou ted znamy obsah karty, nic neni ke zapisu; cely
+    // precteny buffer i s CRC/MAC a zbytkem bloku, Mifare Classic z nej
+    // sklada posledni blok pri zapisu
+    memcpy(aCardInfo->sCardImage, aCardInfo->sDataNFC, NFC_ImageSize(aCardInfo));
+  }
+  memset(aCardInfo->sDirtyPages, 0, (DIRTYWORD(iPages) + 1) * sizeof(uint32_t));
 
-      NFC_READER_DEBUG(TAGin, "Nacteno!\n");
+  for (size_t i = 0; i < aCardInfo->sNumOfBlocks; ++i)
+  {
+    NFC_READER_ALL_DEBUG(TAGin, "Nactena data %d: ", i);
+    for (size_t j = 0; j < TDataNFC_Size; ++j)
+    {
+      NFC_READER_ALL_DEBUG("", "%x ", ((uint8_t *)&aCardInfo->sDataNFC[i])[j]);
+    }
+    NFC_READER_ALL_DEBUG("", "\n");
+  }
+  NFC_READER_DEBUG(TAGin, "Karta nactena za %lld us (%zu vymen).\n", esp_timer_get_time() - iStart, iReads);
+  return true;
+}
 
-      return 0;
+/**************************************************************************/
+/*!
+    @brief  Přečte souvislý rozsah stránek na co nejméně výměn: FAST_READ,
+            u karet bez něj po 16 B oknech
+
+    @param  aSession  Pointer na relaci s kartou
+    @param  aFirstPage První čtená stránka
+    @param  aPages    Počet stránek
+    @param  aBuffer   Cíl, zaokrouhlený nahoru na celá READ okna
+    @param  aReads    Vrací počet výměn
+    @param  aCrc      Vrací CRC32 prvních aCrcLen bytů, nebo NULL
+    @param  aCrcLen   Počet bytů, přes které se CRC počítá
+
+    CRC se počítá po každé výměně z právě přijatých dat, žádný další
+    průchod přes načtená data není potřeba.
+
+    @returns True - Pokud se vše přečetlo
+*/
+/**************************************************************************/
+static bool NFC_ReadPages(TNFCSession *aSession, uint8_t aFirstPage, size_t aPages, uint8_t *aBuffer, size_t *aReads, uint32_t *aCrc, size_t aCrcLen)
+{
+  static const char *TAGin = "NFC_ReadPages";
+  size_t iBytes = aPages * PAGESIZE;
+  size_t iOffset = 0;
+  bool iFast = aSession->sTag.type == PN532_TAG_UNKNOWN || aSession->sTag.fastread;
+  *aReads = 0;
+  if (!NFC_SessionUse(aSession) && !NFC_SessionReactivate(aSession))
+  {
+    return false;
+  }
+  if (aCrc)
+  {
+    *aCrc = 0;
+  }
+  while (iOffset < iBytes)
+  {
+    uint8_t iPage = aFirstPage + iOffset / PAGESIZE;
+    size_t iChunk;
+    if (iFast)
+    {
+      iChunk = iBytes - iOffset;
+      if (iChunk > PN532_FASTREAD_MAXPAGES * PAGESIZE)
+      {
+        iChunk = PN532_FASTREAD_MAXPAGES * PAGESIZE;
+      }
+      if (!pn532_ntag2xx_FastRead(aSession->sNFC, iPage, iPage + iChunk / PAGESIZE - 1, aBuffer + iOffset))
+      {
+        // karta bez FAST_READ odpovi NAK a prejde do IDLE, zbytek po READ oknech
+        aSession->sActive = false;
+        iFast = false;
+        continue;
+      }
     }
+    else
+    {
+      NFC_READER_ALL_DEBUG(TAGin, "Nacítam okno od %d stranky: \n", iPage);
+      if (!NFC_SessionReadPage(aSession, iPage, aBuffer + iOffset))
+      {
+        return false;
+      }
+      iChunk = READWINDOW;
+    }
+    ++*aReads;
+    if (aCrc && iOffset < aCrcLen)
+    {
+      *aCrc = NFC_Crc32(*aCrc, aBuffer + iOffset, iChunk < aCrcLen - iOffset ? iChunk : aCrcLen - iOffset);
+    }
+    iOffset += iChunk;
+  }
+  return true;
+}
+
+/**************************************************************************/
+/*!
+    @brief  CRC hlavičky slotu přes pořadové číslo a data slotu
+
+    @param  aSeq      Pořadové číslo zápisu
+    @param  aData     Data slotu
+    @param  aLen      Délka dat
+*/
+/**************************************************************************/
+static uint16_t NFC_SlotCrc(uint16_t aSeq, const uint8_t *aData, size_t aLen)
+{
+  uint8_t iSeq[2] = {aSeq & 0xFF, aSeq >> 8};
+  uint16_t iCrc = NFC_Crc16(0, iSeq, sizeof(iSeq));
+  return NFC_Crc16(iCrc, aData, aLen);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Vybere z obou načtených slotů platný slot s nejnovějším
+            pořadovým číslem a převezme jeho data. Slot s přetrženým
+            zápisem má špatné CRC a prohraje.
+
+    Slot s zabírá stránky OFFSETDATA + s * (N + 1) až + N, první je
+    hlavička (pořadové číslo LE, CRC LE), za ní N stránek dat.
+
+    @param  aSession  Pointer na relaci s kartou
+    @param  aCardInfo Pointer na TCardInfo strukturu
+    @param  aRaw      Obsah obou slotů tak, jak je na kartě
+*/
+/**************************************************************************/
+static void NFC_SelectSlot(TNFCSession *aSession, TCardInfo *aCardInfo, const uint8_t *aRaw)
+{
+  static const char *TAGin = "NFC_SelectSlot";
+  size_t iPages = NFC_NumOfPages(aCardInfo);
+  size_t iLen = iPages * PAGESIZE;
+  bool iValid[2];
+  uint16_t iSeq[2];
+  for (uint8_t iSlot = 0; iSlot < 2; ++iSlot)
+  {
+    const uint8_t *iHeader = aRaw + iSlot * (iPages + 1) * PAGESIZE;
+    iSeq[iSlot] = iHeader[0] | (iHeader[1] << 8);
+    uint16_t iCrc = iHeader[2] | (iHeader[3] << 8);
+    iValid[iSlot] = NFC_SlotCrc(iSeq[iSlot], iHeader + PAGESIZE, iLen) == iCrc;
+    NFC_READER_ALL_DEBUG(TAGin, "Slot %d: poradi %d, %s\n", iSlot, iSeq[iSlot], iValid[iSlot] ? "platny" : "neplatny");
+  }
+
+  uint8_t iActive;
+  if (iValid[0] && iValid[1])
+  {
+    iActive = (int16_t)(iSeq[1] - iSeq[0]) > 0 ? 1 : 0;
+  }
+  else if (iValid[0] || iValid[1])
+  {
+    iActive = iValid[1] ? 1 : 0;
   }
   else
   {
-    // PN532 probably timed out waiting for a card
-    NFC_READER_DEBUG(TAGin, "Vyprsel cas cekani na kartu");
-    return 5;
+    // prazdna karta: prvni zapis pujde do slotu 0
+    NFC_READER_DEBUG(TAGin, "Karta nema platny zaznam, zacinam od nuly.\n");
+    aCardInfo->sCrcValid = false;
+    aCardInfo->sSlot = 1;
+    aCardInfo->sSeq = 0;
+    aCardInfo->sSlotKnown = 1 << 0;
+    memset(aCardInfo->sDataNFC, 0, iLen);
+    memset(aCardInfo->sCardImage, 0, iLen);
+    memcpy(aCardInfo->sSpareImage, aRaw + PAGESIZE, iLen);
+    aSession->sDataPage = OFFSETDATA + (iPages + 1) + 1;
+    return;
   }
+  uint8_t iSpare = 1 - iActive;
+  if (!iValid[iSpare])
+  {
+    NFC_READER_DEBUG(TAGin, "Slot %d je poskozeny (preruseny zapis), platny je slot %d.\n", iSpare, iActive);
+  }
+  aCardInfo->sCrcValid = true;
+  aCardInfo->sSlot = iActive;
+  aCardInfo->sSeq = iSeq[iActive];
+  aCardInfo->sSlotKnown = (1 << 0) | (1 << 1);
+  memcpy(aCardInfo->sDataNFC, aRaw + (iActive * (iPages + 1) + 1) * PAGESIZE, iLen);
+  memcpy(aCardInfo->sCardImage, aCardInfo->sDataNFC, iLen);
+  memcpy(aCardInfo->sSpareImage, aRaw + (iSpare * (iPages + 1) + 1) * PAGESIZE, iLen);
+  aSession->sDataPage = OFFSETDATA + iActive * (iPages + 1) + 1;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Zapíše obraz dat transakčně do neaktivního slotu
+
+    Nejdřív se zapíšou datové stránky, které se od obsahu neaktivního slotu
+    liší, hlavička s novým pořadovým číslem a CRC až nakonec. Přerušený
+    zápis tak nikdy nepoškodí aktivní slot a po načtení vyhraje vždy
+    nejnovější platný slot. Navíc oproti zápisu na místo stojí jen zápis
+    hlavičky.
+
+    @param  aSession    Pointer na relaci s kartou
+    @param  aCardInfo   Pointer na TCardInfo strukturu
+    @param  aImage      Nový obsah dat (NFC_NumOfPages stránek)
+    @param  aPageStatus Pole NFC_NumOfPages výsledků po stránkách, nebo NULL
+
+    @returns 0 - Zapsáno, 3 - Zápis se nedokončil, platí předchozí slot
+*/
+/**************************************************************************/
+static uint8_t NFC_CommitImage(TNFCSession *aSession, TCardInfo *aCardInfo, const uint8_t *aImage, TPageStatus *aPageStatus)
+{
+  static const char *TAGin = "NFC_CommitImage";
+  size_t iPages = NFC_NumOfPages(aCardInfo);
+  uint8_t iTarget = 1 - aCardInfo->sSlot;
+  uint8_t iBase = OFFSETDATA + iTarget * (iPages + 1);
+  bool iKnown = aCardInfo->sSlotKnown & (1 << iTarget);
+  size_t iWritten = 0;
+  int64_t iStart = esp_timer_get_time();
+
+  for (size_t iPage = 0; iPage < iPages; ++iPage)
+  {
+    const uint8_t *iData = aImage + iPage * PAGESIZE;
+    uint8_t *iSpare = aCardInfo->sSpareImage + iPage * PAGESIZE;
+    if (iKnown && memcmp(iData, iSpare, PAGESIZE) == 0)
+    {
+      if (aPageStatus)
+        aPageStatus[iPage] = NFC_PAGE_SKIPPED;
+      continue;
+    }
+    pn532_write_status_t iStatus = NFC_SessionWritePage(aSession, iBase + 1 + iPage, (uint8_t *)iData);
+    if (iStatus != PN532_WRITE_ACK)
+    {
+      if (aPageStatus)
+        aPageStatus[iPage] = (iStatus == PN532_WRITE_NAK) ? NFC_PAGE_NAK : NFC_PAGE_TIMEOUT;
+      aCardInfo->sSlotKnown &= ~(1 << iTarget);
+      NFC_READER_DEBUG(TAGin, "Zapis do slotu %d prerusen, plati slot %d.\n", iTarget, aCardInfo->sSlot);
+      return 3;
+    }
+    memcpy(iSpare, iData, PAGESIZE);
+    ++iWritten;
+    if (aPageStatus)
+      aPageStatus[iPage] = NFC_PAGE_WRITTEN;
+  }
+
+  uint16_t iSeq = aCardInfo->sSeq + 1;
+  uint16_t iCrc = NFC_SlotCrc(iSeq, aImage, iPages * PAGESIZE);
+  uint8_t iHeader[PAGESIZE] = {iSeq & 0xFF, iSeq >> 8, iCrc & 0xFF, iCrc >> 8};
+  if (NFC_SessionWritePage(aSession, iBase, iHeader) != PN532_WRITE_ACK)
+  {
+    // hlavicka mohla byt zapsana cela, nebo vubec; rozhodne CRC pri nacteni
+    aCardInfo->sSlotKnown &= ~(1 << iTarget);
+    NFC_READER_DEBUG(TAGin, "Hlavicku slotu %d nelze zapsat.\n", iTarget);
+    return 3;
+  }
+
+  // cilovy slot je ted aktivni, predchozi aktivni je novy nahradni
+  uint8_t *iOld = aCardInfo->sCardImage;
+  aCardInfo->sCardImage = aCardInfo->sSpareImage;
+  aCardInfo->sSpareImage = iOld;
+  aCardInfo->sSlotKnown |= 1 << iTarget;
+  aCardInfo->sSlot = iTarget;
+  aCardInfo->sSeq = iSeq;
+  aSession->sDataPage = iBase + 1;
+  for (size_t iPage = 0; iPage < iPages; ++iPage)
+  {
+    if (memcmp((uint8_t *)aCardInfo->sDataNFC + iPage * PAGESIZE, aCardInfo->sCardImage + iPage * PAGESIZE, PAGESIZE) == 0)
+    {
+      aCardInfo->sDirtyPages[DIRTYWORD(iPage)] &= ~DIRTYBIT(iPage);
+    }
+  }
+  NFC_READER_DEBUG(TAGin, "Slot %d (poradi %d): %zu stranek + hlavicka za %lld us.\n", iTarget, iSeq, iWritten, esp_timer_get_time() - iStart);
   return 0;
 }
 
 /**************************************************************************/
 /*!
-    @brief  Načteni Cele editovatelné části do NFC Čipu
+    @brief  Další datový blok Mifare Classic, trailery sektorů se přeskakují
 
-    @param  aNFC      Pointer na NFC strukturu
-    @param  aCardInfo Pointer na TCardInfo strukturu
+    @param  aSession  Pointer na relaci s kartou
+    @param  aBlock    Předchozí datový blok
 
-    @returns True - Pokud se Data načetla
+    @returns Číslo bloku, -1 - Za koncem karty
 */
 /**************************************************************************/
-bool NFC_LoadNFC(pn532_t *aNFC, TCardInfo *aCardInfo)
+static int16_t NFC_ClassicNextBlock(TNFCSession *aSession, int16_t aBlock)
 {
-  static const char *TAGin = "NFC_LoadNFC";
-  size_t errorCounter = 0;
-  NFC_READER_DEBUG(TAGin, "Nacitam vsechny data z karty\n");
-  uint8_t iUid[] = {0, 0, 0, 0, 0, 0, 0};
-  uint8_t iUidLength;
-  NFC_getUID(aNFC,iUid,&iUidLength);
-  NFC_saveUID(aCardInfo,iUid,iUidLength);
-  TDataNFC idataNFC1;
-  for (size_t i = 0; i < aCardInfo->sNumOfBlocks; ++i)
+  do
+  {
+    ++aBlock;
+  } while (aBlock <= CLASSICLASTBLOCK && pn532_mifareclassic_IsTrailerBlock(aSession->sNFC, aBlock));
+  return aBlock <= CLASSICLASTBLOCK ? aBlock : -1;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Číslo bloku Mifare Classic, ve kterém leží aIndex-tý blok dat
+
+    @param  aSession  Pointer na relaci s kartou
+    @param  aIndex    Pořadí bloku v datech (od 0)
+
+    @returns Číslo bloku, -1 - Za koncem karty
+*/
+/**************************************************************************/
+static int16_t NFC_ClassicBlock(TNFCSession *aSession, size_t aIndex)
+{
+  int16_t iBlock = CLASSICFIRSTBLOCK;
+  for (; iBlock >= 0 && aIndex > 0; --aIndex)
+  {
+    iBlock = NFC_ClassicNextBlock(aSession, iBlock);
+  }
+  return iBlock;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Autentizuje sektor bloku, pokud už není autentizovaný v této
+            relaci. Autentizace platí do další autentizace nebo chyby.
+
+    Klíče se zkouší v pořadí z NFC_KeysCandidates, známá karta tedy
+    projde prvním pokusem. Každý neúspěšný pokus stojí nový výběr karty.
+
+    @param  aSession  Pointer na relaci s kartou
+    @param  aBlock    Blok v sektoru
+
+    @returns True - Pokud je sektor přístupný
+*/
+/**************************************************************************/
+static bool NFC_ClassicAuth(TNFCSession *aSession, uint8_t aBlock)
+{
+  static const char *TAGin = "NFC_ClassicAuth";
+  int16_t iSector = aBlock < 128 ? aBlock / 4 : 32 + (aBlock - 128) / 16;
+  NFC_SessionUse(aSession);
+  if (aSession->sActive && aSession->sAuthSector == iSector)
   {
-    NFC_READER_ALL_DEBUG(TAGin, "Nacítam data z %d stranky: \n", i);
+    return true;
+  }
+  if (!aSession->sActive && !NFC_SessionReactivate(aSession))
+  {
+    return false;
+  }
+  TClassicKey iKeys[2 * NFC_KEYS_MAX];
+  size_t iCount = NFC_KeysCandidates(aSession->sUid, aSession->sUidLength, iSector, iKeys, 2 * NFC_KEYS_MAX);
+  for (size_t i = 0; i < iCount; ++i)
+  {
+    if (!aSession->sActive && !NFC_SessionReactivate(aSession))
+    {
+      return false;
+    }
+    NFC_READER_ALL_DEBUG(TAGin, "Autentizuji sektor %d klicem %c (%zu. pokus)\n", iSector, iKeys[i].sType == NFC_KEY_A ? 'A' : 'B', i + 1);
+    if (pn532_mifareclassic_AuthenticateBlock(aSession->sNFC, aSession->sUid, aSession->sUidLength, aBlock, iKeys[i].sType, iKeys[i].sKey))
+    {
+      NFC_KeysRemember(aSession->sUid, aSession->sUidLength, iSector, &iKeys[i]);
+      aSession->sAuthSector = iSector;
+      return true;
+    }
+    // po neuspesne autentizaci je karta v HALT
+    aSession->sActive = false;
+  }
+  NFC_READER_DEBUG(TAGin, "Zadny klic nepasuje na sektor %d.\n", iSector);
+  NFC_KeysForget(aSession->sUid, aSession->sUidLength, iSector);
+  return false;
+}
 
-    if (NFC_GetStructData(aNFC, &idataNFC1, i) != 0)
+/**************************************************************************/
+/*!
+    @brief  Přečte blok Mifare Classic v relaci, při chybě kartu znovu vybere
+
+    @param  aSession  Pointer na relaci s kartou
+    @param  aBlock    Číslo bloku
+    @param  aData     Pole na CLASSICBLOCK bytů
+
+    @returns True - Pokud se blok přečetl
+*/
+/**************************************************************************/
+static bool NFC_ClassicReadBlock(TNFCSession *aSession, uint8_t aBlock, uint8_t *aData)
+{
+  for (size_t i = 0; i < MAXERRORREADING; ++i)
+  {
+    // autentizace sama zkousi vsechny klice, jeji selhani se neopakuje
+    if (!NFC_ClassicAuth(aSession, aBlock))
+    {
+      return false;
+    }
+    if (pn532_mifareclassic_ReadDataBlock(aSession->sNFC, aBlock, aData))
+    {
+      return true;
+    }
+    aSession->sActive = false;
+  }
+  return false;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Zapíše blok Mifare Classic v relaci, při výpadku kartu znovu
+            vybere. NAK od karty se neopakuje, karta zápis odmítla.
+
+    @param  aSession  Pointer na relaci s kartou
+    @param  aBlock    Číslo bloku, nesmí být trailer sektoru
+    @param  aData     CLASSICBLOCK bytů
+
+    @returns Odpověď karty na poslední pokus (PN532_WRITE_ACK - zapsáno)
+*/
+/**************************************************************************/
+static pn532_write_status_t NFC_ClassicWriteBlock(TNFCSession *aSession, uint8_t aBlock, uint8_t *aData)
+{
+  pn532_write_status_t iStatus = PN532_WRITE_TIMEOUT;
+  for (size_t i = 0; i < MAXERRORREADING; ++i)
+  {
+    // autentizace sama zkousi vsechny klice, jeji selhani se neopakuje
+    if (!NFC_ClassicAuth(aSession, aBlock))
+    {
+      // karta, ktera se da znovu vybrat, jen nema pasujici klic
+      return NFC_SessionReactivate(aSession) ? PN532_WRITE_NAK : PN532_WRITE_TIMEOUT;
+    }
+    iStatus = pn532_mifareclassic_WriteDataBlockStatus(aSession->sNFC, aBlock, aData);
+    if (iStatus == PN532_WRITE_ACK)
+    {
+      return iStatus;
+    }
+    // po chybe je karta v HALT a autentizace neplati
+    aSession->sActive = false;
+    if (iStatus == PN532_WRITE_NAK)
+    {
+      return iStatus;
+    }
+  }
+  return iStatus;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Přečte data z Mifare Classic od bloku CLASSICFIRSTBLOCK po
+            celých sektorech; každý sektor se autentizuje jen jednou.
+
+    @param  aSession  Pointer na relaci s kartou
+    @param  aBytes    Počet bytů dat
+    @param  aBuffer   Cíl, zaokrouhlený nahoru na celé bloky
+    @param  aReads    Vrací počet přečtených bloků
+    @param  aCrc      Vrací CRC32 prvních aCrcLen bytů, nebo NULL
+    @param  aCrcLen   Počet bytů, přes které se CRC počítá
+
+    @returns True - Pokud se vše přečetlo
+*/
+/**************************************************************************/
+static bool NFC_ClassicReadBytes(TNFCSession *aSession, size_t aBytes, uint8_t *aBuffer, size_t *aReads, uint32_t *aCrc, size_t aCrcLen)
+{
+  int16_t iBlock = CLASSICFIRSTBLOCK;
+  *aReads = 0;
+  if (aCrc)
+  {
+    *aCrc = 0;
+  }
+  for (size_t iOffset = 0; iOffset < aBytes; iOffset += CLASSICBLOCK, iBlock = NFC_ClassicNextBlock(aSession, iBlock))
+  {
+    if (iBlock < 0 || !NFC_ClassicReadBlock(aSession, iBlock, aBuffer + iOffset))
+    {
+      return false;
+    }
+    ++*aReads;
+    if (aCrc && iOffset < aCrcLen)
+    {
+      *aCrc = NFC_Crc32(*aCrc, aBuffer + iOffset, CLASSICBLOCK < aCrcLen - iOffset ? CLASSICBLOCK : aCrcLen - iOffset);
+    }
+  }
+  return true;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Zapíše označené stránky na Mifare Classic po celých blocích.
+            Neoznačené stránky bloku se doplní z sCardImage, takže se na
+            kartě nezmění.
+
+    @param  aSession    Pointer na relaci s kartou
+    @param  aCardInfo   Pointer na TCardInfo strukturu
+    @param  aPages      Bitmapa stránek k zápisu
+    @param  aPageStatus Pole NFC_NumOfPages výsledků po stránkách, nebo NULL
+    @param  aWritten    Vrací počet zapsaných stránek
+
+    @returns Počet stránek, které se nepodařilo zapsat
+*/
+/**************************************************************************/
+static size_t NFC_ClassicWritePages(TNFCSession *aSession, TCardInfo *aCardInfo, const uint32_t *aPages, TPageStatus *aPageStatus, size_t *aWritten)
+{
+  static const char *TAGin = "NFC_ClassicWritePages";
+  size_t iPages = NFC_NumOfPages(aCardInfo);
+  size_t iFailed = 0;
+  int16_t iBlock = CLASSICFIRSTBLOCK;
+  *aWritten = 0;
+  for (size_t iFirst = 0; iFirst < iPages; iFirst += CLASSICBLOCK / PAGESIZE, iBlock = NFC_ClassicNextBlock(aSession, iBlock))
+  {
+    size_t iEnd = iFirst + CLASSICBLOCK / PAGESIZE < iPages ? iFirst + CLASSICBLOCK / PAGESIZE : iPages;
+    uint8_t iData[CLASSICBLOCK];
+    bool iDirty = false;
+    memcpy(iData, aCardInfo->sCardImage + iFirst * PAGESIZE, CLASSICBLOCK);
+    for (size_t iPage = iFirst; iPage < iEnd; ++iPage)
+    {
+      if (aPages[DIRTYWORD(iPage)] & DIRTYBIT(iPage))
+      {
+        memcpy(iData + (iPage - iFirst) * PAGESIZE, (uint8_t *)aCardInfo->sDataNFC + iPage * PAGESIZE, PAGESIZE);
+        iDirty = true;
+      }
+      else if (aPageStatus)
+      {
+        aPageStatus[iPage] = NFC_PAGE_SKIPPED;
+      }
+    }
+    if (!iDirty)
     {
-      ++errorCounter;
-      if (errorCounter == MAXERRORREADING)
-      { // NFC_READER_DEBUG("",MAXERRORREADING );
-        NFC_READER_DEBUG(TAGin, STRINGIFY(MAXERRORREADING) "x se nepodarilo nacist hodnotu.\n");
-        return false;
+      continue;
+    }
+    pn532_write_status_t iStatus = iBlock >= 0 ? NFC_ClassicWriteBlock(aSession, iBlock, iData) : PN532_WRITE_NAK;
+    bool iOk = iStatus == PN532_WRITE_ACK;
+    if (iOk)
+    {
+      memcpy(aCardInfo->sCardImage + iFirst * PAGESIZE, iData, CLASSICBLOCK);
+      NFC_READER_ALL_DEBUG(TAGin, "Zapsan blok %d\n", iBlock);
+    }
+    for (size_t iPage = iFirst; iPage < iEnd; ++iPage)
+    {
+      if (!(aPages[DIRTYWORD(iPage)] & DIRTYBIT(iPage)))
+      {
+        continue;
+      }
+      if (iOk)
+      {
+        aCardInfo->sDirtyPages[DIRTYWORD(iPage)] &= ~DIRTYBIT(iPage);
+        ++*aWritten;
       }
       else
       {
-        --i;
-        continue;
+        ++iFailed;
       }
+      if (aPageStatus)
+        aPageStatus[iPage] = iOk ? NFC_PAGE_WRITTEN : (iStatus == PN532_WRITE_NAK) ? NFC_PAGE_NAK : NFC_PAGE_TIMEOUT;
     }
-    errorCounter = 0;
-    aCardInfo->sDataNFC[i] = idataNFC1;
-
-    NFC_READER_ALL_DEBUG(TAGin, "Nactena data: ");
-    for (size_t j = 0; j < TDataNFC_Size; ++j)
-    {
-      NFC_READER_ALL_DEBUG("", "%x ", ((uint8_t *)&idataNFC1)[j]);
-    }
-    NFC_READER_ALL_DEBUG("", "\n\n");
-
-    // NFC_READER_ALL_DEBUG(TAGin, "Nactena Data %d: %x %x %x %x", i, idataNFC1, ((uint8_t *)&idataNFC1)[1], ((uint8_t *)&idataNFC1)[2], ((uint8_t *)&idataNFC1)[3]);
   }
-  return true;
+  return iFailed;
 }
 
 /**************************************************************************/
@@ -291,21 +1236,21 @@ void NFC_PrintData(TCardInfo *aCardInfo)
 /*!
     @brief  Zkontroluje jestli struktura TDataNFC je stejná v zařízení jak v NFC čipu
 
-    @param  aNFC      Pointer na NFC
+    @param  aSession  Pointer na relaci s kartou
     @param  aCardInfo Pointer na TCardInfo strukturu
     @param  anumOfNFCStruct Číslo indexu kontrolované TDataNFC Struktury
 
     @returns 0 - Pokud se Data načetla, 1 - Pokud se struktura liší, 2 - Pokud je anumOfNFCStruct mimo rozsah,3 - Nelze cist z karty
 */
 /**************************************************************************/
-uint8_t NFC_CheckStructIsSame(pn532_t *aNFC, TCardInfo *aCardInfo, uint16_t anumOfNFCStruct)
+uint8_t NFC_CheckStructIsSame(TNFCSession *aSession, TCardInfo *aCardInfo, uint16_t anumOfNFCStruct)
 {
   static const char *TAGin = "NFC_CheckStructIsSame";
   if (anumOfNFCStruct <= aCardInfo->sNumOfBlocks)
   {
     TDataNFC idataNFC1;
     NFC_READER_ALL_DEBUG(TAGin, "Porovnavam data\n");
-    if (NFC_GetStructData(aNFC, &idataNFC1, anumOfNFCStruct) == 0)
+    if (NFC_GetStructData(aSession, &idataNFC1, anumOfNFCStruct) == 0)
     {
       for (size_t i = 0; i < TDataNFC_Size; ++i)
       {
@@ -329,70 +1274,278 @@ uint8_t NFC_CheckStructIsSame(pn532_t *aNFC, TCardInfo *aCardInfo, uint16_t anum
   }
 }
 
+/**************************************************************************/
+/*!
+    @brief  Zapíše označené stránky z aCardInfo->sDataNFC, každou jednou a
+            vzestupně, v jedné relaci. Zapsané stránky se převezmou do
+            sCardImage a zruší se jim příznak v sDirtyPages.
+
+    @param  aSession    Pointer na relaci s kartou
+    @param  aCardInfo   Pointer na TCardInfo strukturu
+    @param  aPages      Bitmapa stránek k zápisu (stránka 0 = aSession->sDataPage)
+    @param  aPageStatus Pole NFC_NumOfPages výsledků po stránkách, nebo NULL
+
+    @returns Počet stránek, které se nepodařilo zapsat
+*/
+/**************************************************************************/
+static size_t NFC_WritePages(TNFCSession *aSession, TCardInfo *aCardInfo, const uint32_t *aPages, TPageStatus *aPageStatus)
+{
+  static const char *TAGin = "NFC_WritePages";
+  size_t iWritten = 0;
+  size_t iFailed = 0;
+  int64_t iStart = esp_timer_get_time();
+  if (ISCLASSIC(aSession))
+  {
+    iFailed = NFC_ClassicWritePages(aSession, aCardInfo, aPages, aPageStatus, &iWritten);
+  }
+  for (size_t iPage = 0; !ISCLASSIC(aSession) && iPage < NFC_NumOfPages(aCardInfo); ++iPage)
+  {
+    if (!(aPages[DIRTYWORD(iPage)] & DIRTYBIT(iPage)))
+    {
+      if (aPageStatus)
+        aPageStatus[iPage] = NFC_PAGE_SKIPPED;
+      continue;
+    }
+    uint8_t *iData = (uint8_t *)aCardInfo->sDataNFC + iPage * PAGESIZE;
+    pn532_write_status_t iStatus = NFC_SessionWritePage(aSession, aSession->sDataPage + iPage, iData);
+    if (iStatus == PN532_WRITE_ACK)
+    {
+      memcpy(aCardInfo->sCardImage + iPage * PAGESIZE, iData, PAGESIZE);
+      aCardInfo->sDirtyPages[DIRTYWORD(iPage)] &= ~DIRTYBIT(iPage);
+      ++iWritten;
+      if (aPageStatus)
+        aPageStatus[iPage] = NFC_PAGE_WRITTEN;
+      NFC_READER_ALL_DEBUG(TAGin, "Zapsano na %d stranu\n", aSession->sDataPage + iPage);
+    }
+    else
+    {
+      ++iFailed;
+      if (aPageStatus)
+        aPageStatus[iPage] = (iStatus == PN532_WRITE_NAK) ? NFC_PAGE_NAK : NFC_PAGE_TIMEOUT;
+    }
+  }
+  if (TRAILERPAGES && iWritten)
+  {
+    // CRC a MAC odpovidaji tomu, co na karte opravdu je, zapisuji se ve stejne davce
+    size_t iPages = NFC_NumOfPages(aCardInfo);
+    uint8_t iTrailer[(1 + MACPAGES) * PAGESIZE];
+    bool iOk = true;
+    if (IMAGECRC)
+    {
+      uint32_t iCrc = NFC_Crc32(0, aCardInfo->sCardImage, iPages * PAGESIZE);
+      iTrailer[0] = iCrc & 0xFF;
+      iTrailer[1] = (iCrc >> 8) & 0xFF;
+      iTrailer[2] = (iCrc >> 16) & 0xFF;
+      iTrailer[3] = iCrc >> 24;
+    }
+    if (IMAGEMAC && !NFC_MacCompute(aSession->sUid, aSession->sUidLength, aCardInfo->sCardImage, iPages * PAGESIZE, iTrailer + IMAGECRC * PAGESIZE))
+    {
+      iOk = false;
+    }
+    if (ISCLASSIC(aSession))
+    {
+      // bloky s CRC/MAC se skladaji z obsahu karty, ktery s nimi sdili blok
+      memcpy(aCardInfo->sCardImage + iPages * PAGESIZE, iTrailer, TRAILERPAGES * PAGESIZE);
+      for (size_t iByte = (iPages * PAGESIZE / CLASSICBLOCK) * CLASSICBLOCK; iOk && iByte < (iPages + TRAILERPAGES) * PAGESIZE; iByte += CLASSICBLOCK)
+      {
+        int16_t iBlock = NFC_ClassicBlock(aSession, iByte / CLASSICBLOCK);
+        iOk = iBlock >= 0 && NFC_ClassicWriteBlock(aSession, iBlock, aCardInfo->sCardImage + iByte) == PN532_WRITE_ACK;
+      }
+    }
+    for (size_t iPage = iPages; iOk && !ISCLASSIC(aSession) && iPage < iPages + TRAILERPAGES; ++iPage)
+    {
+      if (NFC_SessionWritePage(aSession, aSession->sDataPage + iPage, iTrailer + (iPage - iPages) * PAGESIZE) != PN532_WRITE_ACK)
+      {
+        iOk = false;
+      }
+    }
+    aCardInfo->sCrcValid = iOk;
+    aCardInfo->sMacValid = iOk;
+    if (!iOk)
+    {
+      ++iFailed;
+    }
+  }
+  NFC_READER_DEBUG(TAGin, "Zapsano %zu z %zu stranek za %lld us.\n", iWritten, iWritten + iFailed, esp_timer_get_time() - iStart);
+  return iFailed;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Zapíše na NFC Čip struktury vybrané bitmapou
+
+    Určí množinu stránek, do kterých vybrané struktury zasahují, a zapíše
+    každou z nich jen jednou, i když ji sdílí sousední struktury.
+
+    @param  aSession    Pointer na relaci s kartou
+    @param  aCardInfo   Pointer na TCardInfo strukturu
+    @param  aStructs    Bitmapa indexů struktur TDataNFC (bit i = struktura i)
+    @param  aPageStatus Pole NFC_NumOfPages výsledků po stránkách, nebo NULL
+
+    @returns 0 - Vše zapsáno, 1 - Index mimo rozsah karty, 2 - Nepodporovaný typ karty, 3 - Některé stránky se nepodařilo zapsat
+*/
+/**************************************************************************/
+uint8_t NFC_WriteStructsMask(TNFCSession *aSession, TCardInfo *aCardInfo, const uint32_t *aStructs, TPageStatus *aPageStatus)
+{
+  static const char *TAGin = "NFC_WriteStructsMask";
+  uint32_t iPages[DIRTYWORD(MAXPAGES)] = {0};
+  if (NFC_NumOfPages(aCardInfo) > MAXPAGES)
+  {
+    return 1;
+  }
+  if (!ISTYPE2(aSession) && (!ISCLASSIC(aSession) || TEARPROOF))
+  {
+    NFC_READER_DEBUG(TAGin, "Zapis umi jen Mifare Ultralight / NTAG a Mifare Classic (bez odolneho zapisu).\n");
+    return 2;
+  }
+  for (size_t i = 0; i < aCardInfo->sNumOfBlocks; ++i)
+  {
+    if (!(aStructs[DIRTYWORD(i)] & DIRTYBIT(i)))
+    {
+      continue;
+    }
+    size_t iFirstPage = (i * TDataNFC_Size) / PAGESIZE;
+    size_t iLastPage = ((i + 1) * TDataNFC_Size - 1) / PAGESIZE;
+    for (size_t iPage = iFirstPage; iPage <= iLastPage; ++iPage)
+    {
+      iPages[DIRTYWORD(iPage)] |= DIRTYBIT(iPage);
+    }
+  }
+  if (TEARPROOF)
+  {
+    // novy obraz = obsah karty + vybrane struktury, zapsany jako jedna transakce
+    size_t iLen = NFC_NumOfPages(aCardInfo) * PAGESIZE;
+    uint8_t *iImage = (uint8_t *)malloc(iLen);
+    if (iImage == NULL)
+    {
+      return 3;
+    }
+    memcpy(iImage, aCardInfo->sCardImage, iLen);
+    for (size_t i = 0; i < aCardInfo->sNumOfBlocks; ++i)
+    {
+      if (aStructs[DIRTYWORD(i)] & DIRTYBIT(i))
+      {
+        memcpy(iImage + i * TDataNFC_Size, &aCardInfo->sDataNFC[i], TDataNFC_Size);
+      }
+    }
+    uint8_t iResult = NFC_CommitImage(aSession, aCardInfo, iImage, aPageStatus);
+    free(iImage);
+    return iResult;
+  }
+  return NFC_WritePages(aSession, aCardInfo, iPages, aPageStatus) ? 3 : 0;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Zapíše na NFC Čip souvislý rozsah struktur TDataNFC
+
+    @param  aSession    Pointer na relaci s kartou
+    @param  aCardInfo   Pointer na TCardInfo strukturu
+    @param  aFirst      Index první zapisované struktury
+    @param  aCount      Počet struktur
+    @param  aPageStatus Pole NFC_NumOfPages výsledků po stránkách, nebo NULL
+
+    @returns Stejně jako NFC_WriteStructsMask
+*/
+/**************************************************************************/
+uint8_t NFC_WriteStructs(TNFCSession *aSession, TCardInfo *aCardInfo, uint16_t aFirst, uint16_t aCount, TPageStatus *aPageStatus)
+{
+  uint32_t iStructs[DIRTYWORD(MAXPAGES)] = {0};
+  if (aCount == 0 || aFirst + aCount > aCardInfo->sNumOfBlocks || aFirst + aCount > MAXPAGES)
+  {
+    return 1;
+  }
+  for (size_t i = aFirst; i < aFirst + aCount; ++i)
+  {
+    iStructs[DIRTYWORD(i)] |= DIRTYBIT(i);
+  }
+  return NFC_WriteStructsMask(aSession, aCardInfo, iStructs, aPageStatus);
+}
+
 /**************************************************************************/
 /*!
     @brief  Zapíše strukturu TDataNFC na NFC Čip
 
-    @param  aNFC      Pointer na NFC strukturu
+    @param  aSession  Pointer na relaci s kartou
     @param  aCardInfo Pointer na TCardInfo strukturu
     @param  anumOfNFCStruct Index struktury TDataNFC, která se má zapsat
 
-    @returns 0 - Pokud se podařilo zapsat, 1 - Pokud je anumOfNFCStruct mimo rozsah karty
+    @returns Stejně jako NFC_WriteStructsMask: 0 - Pokud se podařilo zapsat, 1 - Pokud je anumOfNFCStruct mimo rozsah karty,
+             2 - Nepodporovaný typ karty, 3 - Některé stránky se nepodařilo zapsat
 
 */
 /**************************************************************************/
-uint8_t NFC_WriteStruct(pn532_t *aNFC, TCardInfo *aCardInfo, uint16_t anumOfNFCStruct)
+uint8_t NFC_WriteStruct(TNFCSession *aSession, TCardInfo *aCardInfo, uint16_t anumOfNFCStruct)
 {
   static const char *TAGin = "NFC_WriteStruct";
-  if (aCardInfo->sNumOfBlocks >= anumOfNFCStruct)
-  {
-    size_t iWritingPointer = anumOfNFCStruct * TDataNFC_Size;
-    uint8_t iData[PAGESIZE];
-
-    uint8_t iuid[] = {0, 0, 0, 0, 0, 0, 0}; // Buffer to store the returned UID
-    uint8_t iuidLength;
+  NFC_READER_ALL_DEBUG(TAGin, "Zapisuji strukturu %d\n", anumOfNFCStruct);
+  return NFC_WriteStructs(aSession, aCardInfo, anumOfNFCStruct, 1, NULL);
+}
 
-    size_t iBlockWriting = iWritingPointer / PAGESIZE;
-    int iPointerToWrite = iWritingPointer % PAGESIZE;
-    size_t iPage = 0;
-    NFC_READER_ALL_DEBUG(TAGin, "Zapisuji na kartu\n");
-    NFC_READER_ALL_DEBUG(TAGin, "Zapisuji strukturu %d, iPointer: %d, datasize: %zu\n", anumOfNFCStruct, iPointerToWrite, TDataNFC_Size);
-    while (iPointerToWrite > -(int)TDataNFC_Size)
+/**************************************************************************/
+/*!
+    @brief  Spočítá stránky, které karta při zápisu potvrdila
+*/
+/**************************************************************************/
+static size_t NFC_CountWritten(const TPageStatus *aPageStatus, size_t aPages)
+{
+  size_t iWritten = 0;
+  for (size_t i = 0; i < aPages; ++i)
+  {
+    if (aPageStatus[i] == NFC_PAGE_WRITTEN)
     {
-      NFC_READER_ALL_DEBUG(TAGin, "Zapisuji do bloku: %d\n", iBlockWriting + OFFSETDATA + iPage);
-      for (size_t i = 0; i < PAGESIZE; ++i)
-      {
-        if (iPointerToWrite > 0)
-        {
-          iData[i] = *(((uint8_t *)aCardInfo->sDataNFC + anumOfNFCStruct * TDataNFC_Size) - iPointerToWrite);
-          --iPointerToWrite;
-        }
-        else
-        {
-          iData[i] = *(((uint8_t *)aCardInfo->sDataNFC + anumOfNFCStruct * TDataNFC_Size) - iPointerToWrite);
-          --iPointerToWrite;
-        }
-      }
-      uint8_t isuccess = pn532_readPassiveTargetID(aNFC, PN532_MIFARE_ISO14443A, iuid, &iuidLength, 0);
-      if (isuccess == 1)
-      {
-        if (iuidLength == 4)
-        { // TO-DO
-        }
-        else if ((iuidLength == 7))
-        {
-          isuccess = pn532_mifareultralight_WritePage(aNFC, iBlockWriting + OFFSETDATA + iPage, iData);
-          NFC_READER_ALL_DEBUG(TAGin, "Zapsano na %d stranu\n", iBlockWriting + OFFSETDATA + iPage);
-        }
-      }
-      ++iPage;
+      ++iWritten;
     }
-    return 0;
   }
-  else
+  return iWritten;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Porovná zápis prvních WRITEBENCHSTRUCTS struktur po jedné
+            (jako dřív NFC_WriteStruct ve smyčce) a jednou dávkou
+            NFC_WriteStructs. Vypíše počet zapsaných stránek a čas obou.
+            Na kartu se zapíše obsah aCardInfo->sDataNFC.
+
+    @param  aSession  Pointer na relaci s kartou
+    @param  aCardInfo Pointer na TCardInfo strukturu
+
+    @returns 0 - Oba zápisy prošly, jinak první nenulový výsledek NFC_WriteStructs
+*/
+/**************************************************************************/
+uint8_t NFC_WriteBenchmark(TNFCSession *aSession, TCardInfo *aCardInfo)
+{
+  static const char *TAGin = "NFC_WriteBenchmark";
+  size_t iPages = NFC_NumOfPages(aCardInfo);
+  size_t iSingle = 0;
+  uint8_t iResult = 0;
+  if (aCardInfo->sNumOfBlocks < WRITEBENCHSTRUCTS || iPages > MAXPAGES)
   {
     return 1;
   }
+  TPageStatus *iStatus = (TPageStatus *)malloc(iPages * sizeof(TPageStatus));
+  if (iStatus == NULL)
+  {
+    return 3;
+  }
+  int64_t iStart = esp_timer_get_time();
+  for (uint16_t i = 0; i < WRITEBENCHSTRUCTS; ++i)
+  {
+    memset(iStatus, 0, iPages * sizeof(TPageStatus)); // NFC_PAGE_SKIPPED
+    uint8_t iZapis = NFC_WriteStructs(aSession, aCardInfo, i, 1, iStatus);
+    iResult = iResult ? iResult : iZapis;
+    iSingle += NFC_CountWritten(iStatus, iPages);
+  }
+  int64_t iSingleTime = esp_timer_get_time() - iStart;
+  memset(iStatus, 0, iPages * sizeof(TPageStatus));
+  iStart = esp_timer_get_time();
+  uint8_t iZapis = NFC_WriteStructs(aSession, aCardInfo, 0, WRITEBENCHSTRUCTS, iStatus);
+  int64_t iBatchTime = esp_timer_get_time() - iStart;
+  iResult = iResult ? iResult : iZapis;
+  printf("[%s] %d struktur po %u B: po jedne %zu stranek za %lld us, NFC_WriteStructs %zu stranek za %lld us\n", TAGin, WRITEBENCHSTRUCTS,
+         (unsigned)TDataNFC_Size, iSingle, (long long)iSingleTime, NFC_CountWritten(iStatus, iPages), (long long)iBatchTime);
+  free(iStatus);
+  return iResult;
 }
 /**************************************************************************/
 /*!
@@ -413,6 +1566,12 @@ uint8_t NFC_DeAlloc(TCardInfo *aCardInfo)
   }
   free(aCardInfo->sDataNFC);
   aCardInfo->sDataNFC = NULL;
+  free(aCardInfo->sCardImage);
+  aCardInfo->sCardImage = NULL;
+  free(aCardInfo->sSpareImage);
+  aCardInfo->sSpareImage = NULL;
+  free(aCardInfo->sDirtyPages);
+  aCardInfo->sDirtyPages = NULL;
   NFC_READER_ALL_DEBUG(TAGin, "Odalokovavam TCardInfo\n");
   if (aCardInfo->sDataNFC == NULL)
   {
@@ -428,24 +1587,43 @@ uint8_t NFC_DeAlloc(TCardInfo *aCardInfo)
 /*!
     @brief  Zapíše strukturu a zkontroluje
 
-    @param  aNFC      Pointer na NFC strukturu
+    NFC_VERIFY_ACK spoléhá na potvrzení (ACK) každé stránky kartou a
+    ušetří zpětné čtení, NFC_VERIFY_READBACK navíc strukturu přečte a
+    porovná, NFC_VERIFY_NONE jen zapisuje (chybu zápisu ale vrátí).
+
+    @param  aSession  Pointer na relaci s kartou
     @param  aCardInfo Pointer na TCardInfo strukturu
     @param  anumOfNFCStruct Index struktury TDataNFC, která se má zapsat a ověřit
+    @param  aVerify   Způsob ověření zápisu
 
-    @returns    0 - Hodnoty na kartě sedí se zapsanými, 1- Data se liší, 2 - Index anumOfNFCStruct je mimo rozsah struktury, 3 - Nelze cist z karty
+    @returns    0 - Hodnoty na kartě sedí se zapsanými, 1- Data se liší / karta zápis nepotvrdila, 2 - Index anumOfNFCStruct je mimo rozsah struktury, 3 - Nelze cist z karty
 */
 /**************************************************************************/
 
-uint8_t NFC_WriteAndCheck(pn532_t *aNFC, TCardInfo *aCardInfo, uint16_t anumOfNFCStruct)
+uint8_t NFC_WriteAndCheck(TNFCSession *aSession, TCardInfo *aCardInfo, uint16_t anumOfNFCStruct, TVerifyPolicy aVerify)
 {
   static const char *TAGin = "NFC_WriteAndCheck";
-  uint8_t iZapis = NFC_WriteStruct(aNFC, aCardInfo, anumOfNFCStruct);
-  if (iZapis != 0)
+  uint8_t iZapis = NFC_WriteStructs(aSession, aCardInfo, anumOfNFCStruct, 1, NULL);
+  if (iZapis == 1)
   {
     NFC_READER_DEBUG(TAGin, "Index struktury TDataNFC je mimo rozsah.\n");
     return 2;
   }
-  switch (NFC_CheckStructIsSame(aNFC, aCardInfo, anumOfNFCStruct))
+  if (iZapis != 0)
+  {
+    NFC_READER_DEBUG(TAGin, "Karta zapis nepotvrdila.\n");
+    return 1;
+  }
+  if (aVerify == NFC_VERIFY_NONE)
+  {
+    return 0;
+  }
+  if (aVerify == NFC_VERIFY_ACK)
+  {
+    NFC_READER_DEBUG(TAGin, "Data se správně nahrála (ACK).\n");
+    return 0;
+  }
+  switch (NFC_CheckStructIsSame(aSession, aCardInfo, anumOfNFCStruct))
   {
   case 0:
     NFC_READER_DEBUG(TAGin, "Data se správně nahrála.\n");
@@ -471,49 +1649,224 @@ uint8_t NFC_WriteAndCheck(pn532_t *aNFC, TCardInfo *aCardInfo, uint16_t anumOfNF
 
 /**************************************************************************/
 /*!
-    @brief  OVěří jestli je karta přítomna na čtečce
+    @brief  Alokuje pole struktur a obrazy karty pro danou kapacitu
 
-    @param  aNFC      Pointer na NFC strukturu
+    @param  aCardInfo Pointer na TCardInfo strukturu
+    @param  aCapacity Velikost dat v bytech
+
+    @returns True - Pokud se pamět alokovala
+*/
+/**************************************************************************/
+static bool NFC_Alloc(TCardInfo *aCardInfo, size_t aCapacity)
+{
+  aCardInfo->sSize = aCapacity;
+  aCardInfo->sNumOfBlocks = aCapacity / TDataNFC_Size;
+  if (aCardInfo->sNumOfBlocks == 0)
+  {
+    return false;
+  }
+  size_t iAllocSize = NFC_ImageSize(aCardInfo);
+  aCardInfo->sDataNFC = (TDataNFC *)calloc(1, iAllocSize);
+  aCardInfo->sCardImage = (uint8_t *)calloc(1, iAllocSize);
+  aCardInfo->sSpareImage = (uint8_t *)calloc(1, iAllocSize);
+  aCardInfo->sSlot = 0;
+  aCardInfo->sSeq = 0;
+  aCardInfo->sSlotKnown = 0;
+  aCardInfo->sDirtyPages = (uint32_t *)calloc(DIRTYWORD(iAllocSize / PAGESIZE) + 1, sizeof(uint32_t));
+  return aCardInfo->sDataNFC && aCardInfo->sCardImage && aCardInfo->sSpareImage && aCardInfo->sDirtyPages;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Velikost bufferů obrazu karty: data, CRC a MAC za nimi,
+            zaokrouhleno na celá READ okna (= bloky Mifare Classic), aby
+            se četlo přímo do pole
+
+    @param  aCardInfo Pointer na TCardInfo strukturu
+*/
+/**************************************************************************/
+static size_t NFC_ImageSize(TCardInfo *aCardInfo)
+{
+  return (((NFC_NumOfPages(aCardInfo) + TRAILERPAGES) * PAGESIZE + READWINDOW - 1) / READWINDOW) * READWINDOW;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Kolik bytů struktur se vejde na kartu relace podle jejího
+            záznamu z pn532_detectTag (bez CRC/MAC, u odolného zápisu
+            jeden slot)
+
+    @param  aSession  Pointer na relaci s kartou
+
+    @returns Kapacita v bytech, 0 - Neznámá karta
+*/
+/**************************************************************************/
+static size_t NFC_TagCapacity(TNFCSession *aSession)
+{
+  size_t iPages = 0;
+  if (aSession->sTag.type == PN532_TAG_UNKNOWN)
+  {
+    return 0;
+  }
+  if (ISCLASSIC(aSession))
+  {
+    for (int16_t iBlock = CLASSICFIRSTBLOCK; iBlock >= 0 && iBlock <= aSession->sTag.userend; iBlock = NFC_ClassicNextBlock(aSession, iBlock))
+    {
+      iPages += CLASSICBLOCK / PAGESIZE;
+    }
+  }
+  else if (aSession->sTag.userend >= OFFSETDATA)
+  {
+    iPages = aSession->sTag.userend - OFFSETDATA + 1;
+  }
+  if (TEARPROOF)
+  {
+    iPages = iPages >= 2 ? iPages / 2 - 1 : 0;
+  }
+  else
+  {
+    iPages = iPages > TRAILERPAGES ? iPages - TRAILERPAGES : 0;
+  }
+  // bitmapy stranek jsou na MAXPAGES
+  return (iPages < MAXPAGES ? iPages : MAXPAGES) * PAGESIZE;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Počet stránek, které zabírají struktury TDataNFC
+
+    @param  aCardInfo Pointer na TCardInfo strukturu
+*/
+/**************************************************************************/
+static size_t NFC_NumOfPages(TCardInfo *aCardInfo)
+{
+  return (aCardInfo->sNumOfBlocks * TDataNFC_Size + PAGESIZE - 1) / PAGESIZE;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Porovná data v zařízení s posledním známým obsahem karty a
+            označí stránky, ve kterých se změnil aspoň jeden byte
+
+    @param  aCardInfo Pointer na TCardInfo strukturu
+
+    @returns Počet stránek čekajících na zápis
+*/
+/**************************************************************************/
+size_t NFC_MarkDirty(TCardInfo *aCardInfo)
+{
+  size_t iDirty = 0;
+  for (size_t iPage = 0; iPage < NFC_NumOfPages(aCardInfo); ++iPage)
+  {
+    if (memcmp((uint8_t *)aCardInfo->sDataNFC + iPage * PAGESIZE, aCardInfo->sCardImage + iPage * PAGESIZE, PAGESIZE) != 0)
+    {
+      aCardInfo->sDirtyPages[DIRTYWORD(iPage)] |= DIRTYBIT(iPage);
+    }
+    if (aCardInfo->sDirtyPages[DIRTYWORD(iPage)] & DIRTYBIT(iPage))
+    {
+      ++iDirty;
+    }
+  }
+  return iDirty;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Zapíše na kartu jen změněné stránky
+
+    Změny libovolného počtu struktur se zapíšou jedním průchodem v relaci.
+    Struktury sdílející stránku se skládají z dat v zařízení, karta se
+    před zápisem nečte. Nezapsané stránky zůstanou označené pro další volání.
+
+    @param  aSession  Pointer na relaci s kartou
     @param  aCardInfo Pointer na TCardInfo strukturu
 
+    @returns 0 - Vše zapsáno, 1 - Některé stránky se nepodařilo zapsat, 2 - Nepodporovaný typ karty
+*/
+/**************************************************************************/
+uint8_t NFC_Flush(TNFCSession *aSession, TCardInfo *aCardInfo)
+{
+  static const char *TAGin = "NFC_Flush";
+  size_t iDirty = NFC_MarkDirty(aCardInfo);
+  if (iDirty == 0)
+  {
+    NFC_READER_ALL_DEBUG(TAGin, "Neni co zapisovat.\n");
+    return 0;
+  }
+  if (!ISTYPE2(aSession) && (!ISCLASSIC(aSession) || TEARPROOF))
+  {
+    NFC_READER_DEBUG(TAGin, "Zapis umi jen Mifare Ultralight / NTAG a Mifare Classic (bez odolneho zapisu).\n");
+    return 2;
+  }
+
+  if (TEARPROOF)
+  {
+    return NFC_CommitImage(aSession, aCardInfo, (uint8_t *)aCardInfo->sDataNFC, NULL) ? 1 : 0;
+  }
+  return NFC_WritePages(aSession, aCardInfo, aCardInfo->sDirtyPages, NULL) ? 1 : 0;
+}
+
+/**************************************************************************/
+/*!
+    @brief  OVěří jestli je karta přítomna na čtečce
+
+    Aktivní relace se ověří jedním čtením, bez nového výběru karty.
+
+    @param  aSession  Pointer na relaci s kartou
+
     @returns    true - Pokud je přítomna, false - Pokud neni přitomna
 */
 /**************************************************************************/
-bool NFC_isCardReadyToRead(pn532_t *aNFC)
+bool NFC_isCardReadyToRead(TNFCSession *aSession)
 {
   static const char *TAGin = "NFC_isCardReadyToRead";
-  uint8_t iuid[] = {0, 0, 0, 0, 0, 0, 0};
-  uint8_t iuidLength;
+  uint8_t iData[4 * PAGESIZE];
   NFC_READER_ALL_DEBUG(TAGin, "Zkousím jestli je karta přítomna.\n");
-  bool iStatus = pn532_readPassiveTargetID(aNFC, PN532_MIFARE_ISO14443A, iuid, &iuidLength, TIMEOUTCHECKCARD);
-  if (iStatus)
+  NFC_SessionUse(aSession);
+  bool iStatus;
+  if (ISCLASSIC(aSession))
   {
-    NFC_READER_ALL_DEBUG(TAGin, "Neni pritomna.\n");
+    // blok uz autentizovaneho sektoru, jinak by cteni autentizaci zrusilo
+    int16_t iSector = aSession->sAuthSector;
+    iStatus = aSession->sActive && iSector >= 0 && pn532_mifareclassic_ReadDataBlock(aSession->sNFC, iSector < 32 ? iSector * 4 : 128 + (iSector - 32) * 16, iData);
   }
   else
+  {
+    iStatus = aSession->sActive && pn532_mifareultralight_ReadPage(aSession->sNFC, 0, iData);
+  }
+  if (!iStatus)
+  {
+    iStatus = NFC_SessionReactivate(aSession);
+  }
+  if (iStatus)
   {
     NFC_READER_ALL_DEBUG(TAGin, "Je pritomna.\n");
   }
+  else
+  {
+    NFC_READER_ALL_DEBUG(TAGin, "Neni pritomna.\n");
+  }
   return iStatus;
 }
 /**************************************************************************/
 /*!
     @brief  Získá UID a délku UID karty
 
-    @param  aNFC      Pointer na NFC strukturu
+    @param  aSession  Pointer na relaci s kartou, pokud neni otevřená, otevře se
     @param  aUid      Pointer na Uid pole
      @param  aUidLength      Pointer na Uid délku
 
     @returns    true - Pokud se správně načetlo, false - Pokud se špatně načetlo
 */
 /**************************************************************************/
-bool NFC_getUID(pn532_t *aNFC, uint8_t *aUid, uint8_t *aUidLength )
+bool NFC_getUID(TNFCSession *aSession, uint8_t *aUid, uint8_t *aUidLength )
 {
   static const char *TAGin = "NFC_getUID";
   NFC_READER_ALL_DEBUG(TAGin, "Ziskavam UID.\n");
-  bool iSuccess = pn532_readPassiveTargetID(aNFC, PN532_MIFARE_ISO14443A, aUid, aUidLength, 0);
-  if (!iSuccess)
+  if (!aSession->sActive && !NFC_SessionReactivate(aSession) && (aSession->sNFC == NULL || !NFC_SessionOpen(aSession, aSession->sNFC, 0)))
     return false;
+  memcpy(aUid, aSession->sUid, aSession->sUidLength);
+  *aUidLength = aSession->sUidLength;
   NFC_READER_ALL_DEBUG(TAGin, "UID se nacetlo: ");
   for (size_t i = 0; i < *aUidLength; i++)
   {
@@ -27,23 +27,74 @@ extern "C"
     size_t sSize;
     size_t sNumOfBlocks;
     TDataNFC *sDataNFC;
+    uint8_t *sCardImage;   // posledni znamy obsah karty, po strankach jako sDataNFC
+    uint32_t *sDirtyPages; // bitmapa stranek cekajicich na zapis (NFC_Flush)
+    uint8_t *sSpareImage;  // obsah neaktivniho slotu (CONFIG_NFC_TEARPROOF)
+    uint16_t sSeq;         // poradove cislo aktivniho slotu
+    uint8_t sSlot;         // aktivni slot 0 / 1
+    uint8_t sSlotKnown;    // bit s: obsah slotu s v pameti odpovida karte
+    bool sCrcValid;        // CRC nactenych dat sedi (CONFIG_NFC_IMAGE_CRC / slot)
+    bool sMacValid;        // MAC nactenych dat sedi (CONFIG_NFC_MAC)
     uint8_t sUid[7];
     uint8_t sUidLength;
 
   } TCardInfo;
 
+  // Relace s jednou vybranou kartou, Tg karty si drzi sNFC. Pri dvou
+  // kartach v poli (NFC_SessionOpenAll) ma kazda svou relaci.
+  typedef struct
+  {
+    pn532_t *sNFC;
+    uint8_t sUid[7];
+    uint8_t sUidLength;
+    bool sActive;      // karta odpovida, neni potreba ji znovu vybirat
+    uint8_t sDataPage; // prvni stranka dat (aktivniho slotu)
+    int16_t sAuthSector; // autentizovany sektor Mifare Classic, -1 - zadny
+    pn532_taginfo_t sTag; // typ a rozlozeni pameti karty (pn532_detectTag)
+    uint8_t sTargets;     // kolik karet se vybira spolu s touto (MaxTg)
+    uint32_t sSelectCount; // pn532_selectCount pri posledni praci s kartou
+  } TNFCSession;
+
+  // Vysledek zapisu jedne stranky (NFC_WriteStructs)
+  typedef enum
+  {
+    NFC_PAGE_SKIPPED = 0, // stranka nebyla ke zapisu
+    NFC_PAGE_WRITTEN,     // karta zapis potvrdila (ACK)
+    NFC_PAGE_NAK,         // karta zapis odmitla
+    NFC_PAGE_TIMEOUT      // karta neodpovedela
+  } TPageStatus;
+
+  // Overeni zapisu v NFC_WriteAndCheck
+  typedef enum
+  {
+    NFC_VERIFY_NONE = 0, // jen zapis
+    NFC_VERIFY_ACK,      // kazda stranka potvrzena ACK od karty
+    NFC_VERIFY_READBACK  // ACK a zpetne cteni struktury
+  } TVerifyPolicy;
+
   static const size_t TDataNFC_Size = sizeof(TDataNFC);
 
   bool NFC_init(pn532_t *aNFC, size_t aCapacity, TCardInfo *aCardInfo, uint8_t aClk, uint8_t aMiso, uint8_t aMosi, uint8_t aSs);
   uint8_t NFC_DeAlloc(TCardInfo *aCardInfo);
-  uint8_t NFC_GetStructData(pn532_t *aNFC, TDataNFC *aDataNFC, uint16_t anumOfNFCStruct);
-  bool NFC_LoadNFC(pn532_t *aNFC, TCardInfo *aCardInfo);
+  bool NFC_SessionOpen(TNFCSession *aSession, pn532_t *aNFC, uint16_t aTimeout);
+  uint8_t NFC_SessionOpenAll(TNFCSession *aSessions, uint8_t aMax, pn532_t *aNFC, uint16_t aTimeout);
+  bool NFC_SessionAttach(TNFCSession *aSession, pn532_t *aNFC, const pn532_target_t *aTarget, uint8_t aTargets);
+  bool NFC_SessionAutoPoll(TNFCSession *aSession, pn532_t *aNFC, uint8_t aRounds, uint8_t aPeriod, uint16_t aTimeout);
+  bool NFC_SessionReactivate(TNFCSession *aSession);
+  void NFC_SessionClose(TNFCSession *aSession);
+  uint8_t NFC_GetStructData(TNFCSession *aSession, TDataNFC *aDataNFC, uint16_t anumOfNFCStruct);
+  bool NFC_LoadNFC(TNFCSession *aSession, TCardInfo *aCardInfo);
   void NFC_PrintData(TCardInfo *aCardInfo);
-  uint8_t NFC_CheckStructIsSame(pn532_t *aNFC, TCardInfo *aCardInfo, uint16_t anumOfNFCStruct);
-  uint8_t NFC_WriteStruct(pn532_t *aNFC, TCardInfo *aCardInfo, uint16_t anumOfNFCStruct);
-  uint8_t NFC_WriteAndCheck(pn532_t *aNFC, TCardInfo *aCardInfo, uint16_t anumOfNFCStruct);
-  bool NFC_isCardReadyToRead(pn532_t *aNFC);
-  bool NFC_getUID(pn532_t *aNFC, uint8_t *aUid, uint8_t *aUidLength);
+  uint8_t NFC_CheckStructIsSame(TNFCSession *aSession, TCardInfo *aCardInfo, uint16_t anumOfNFCStruct);
+  uint8_t NFC_WriteStruct(TNFCSession *aSession, TCardInfo *aCardInfo, uint16_t anumOfNFCStruct);
+  uint8_t NFC_WriteStructs(TNFCSession *aSession, TCardInfo *aCardInfo, uint16_t aFirst, uint16_t aCount, TPageStatus *aPageStatus);
+  uint8_t NFC_WriteStructsMask(TNFCSession *aSession, TCardInfo *aCardInfo, const uint32_t *aStructs, TPageStatus *aPageStatus);
+  uint8_t NFC_WriteBenchmark(TNFCSession *aSession, TCardInfo *aCardInfo);
+  uint8_t NFC_WriteAndCheck(TNFCSession *aSession, TCardInfo *aCardInfo, uint16_t anumOfNFCStruct, TVerifyPolicy aVerify);
+  size_t NFC_MarkDirty(TCardInfo *aCardInfo);
+  uint8_t NFC_Flush(TNFCSession *aSession, TCardInfo *aCardInfo);
+  bool NFC_isCardReadyToRead(TNFCSession *aSession);
+  bool NFC_getUID(TNFCSession *aSession, uint8_t *aUid, uint8_t *aUidLength);
   bool NFC_saveUID(TCardInfo *aCardInfo, uint8_t *aUid, uint8_t aUidLength);
 
 
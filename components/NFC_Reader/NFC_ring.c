@@ -0,0 +1,119 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "NFC_ring.h"
+
+/**************************************************************************/
+/*!
+    @brief  Alokuje sloty fronty a jejich data, za běhu se už nealokuje
+
+    @param  aRing       Pointer na frontu
+    @param  aSlots      Počet slotů
+    @param  aMaxBlocks  Počet struktur TDataNFC v jednom slotu
+
+    @returns True - Pokud je dost paměti
+*/
+/**************************************************************************/
+bool NFC_RingInit(TNFCRing *aRing, size_t aSlots, size_t aMaxBlocks)
+{
+  aRing->sCount = aSlots;
+  aRing->sMaxBlocks = aMaxBlocks;
+  aRing->sConsumer = NULL;
+  atomic_init(&aRing->sHead, 0);
+  atomic_init(&aRing->sTail, 0);
+  aRing->sSlots = (TNFCRecord *)calloc(aSlots, sizeof(TNFCRecord));
+  aRing->sData = (TDataNFC *)calloc(aSlots * aMaxBlocks, sizeof(TDataNFC));
+  if (aRing->sSlots == NULL || aRing->sData == NULL)
+  {
+    free(aRing->sSlots);
+    free(aRing->sData);
+    aRing->sSlots = NULL;
+    aRing->sData = NULL;
+    aRing->sCount = 0;
+    return false;
+  }
+  for (size_t i = 0; i < aSlots; ++i)
+  {
+    aRing->sSlots[i].sData = aRing->sData + i * aMaxBlocks;
+  }
+  return true;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Producent: vrátí volný slot k vyplnění. Fronta se nemění, dokud
+            se slot neodešle NFC_RingCommit.
+
+    @param  aRing     Pointer na frontu
+
+    @returns Pointer na slot, NULL - fronta je plná
+*/
+/**************************************************************************/
+TNFCRecord *NFC_RingReserve(TNFCRing *aRing)
+{
+  size_t iHead = atomic_load_explicit(&aRing->sHead, memory_order_relaxed);
+  // acquire: konzument uz slot docetl
+  size_t iTail = atomic_load_explicit(&aRing->sTail, memory_order_acquire);
+  if (iHead - iTail >= aRing->sCount)
+  {
+    return NULL;
+  }
+  return &aRing->sSlots[iHead % aRing->sCount];
+}
+
+/**************************************************************************/
+/*!
+    @brief  Producent: předá slot z NFC_RingReserve konzumentovi a probudí ho
+
+    @param  aRing     Pointer na frontu
+*/
+/**************************************************************************/
+void NFC_RingCommit(TNFCRing *aRing)
+{
+  size_t iHead = atomic_load_explicit(&aRing->sHead, memory_order_relaxed);
+  // release: obsah slotu je zapsany driv, nez ho konzument uvidi
+  atomic_store_explicit(&aRing->sHead, iHead + 1, memory_order_release);
+  if (aRing->sConsumer != NULL)
+  {
+    xTaskNotifyGive(aRing->sConsumer);
+  }
+}
+
+/**************************************************************************/
+/*!
+    @brief  Konzument: vrátí nejstarší slot, slot zůstává ve frontě do
+            NFC_RingRelease
+
+    @param  aRing     Pointer na frontu
+
+    @returns Pointer na slot, NULL - fronta je prázdná
+*/
+/**************************************************************************/
+TNFCRecord *NFC_RingPeek(TNFCRing *aRing)
+{
+  size_t iTail = atomic_load_explicit(&aRing->sTail, memory_order_relaxed);
+  // acquire: vidi se cely obsah slotu zapsany pred NFC_RingCommit
+  size_t iHead = atomic_load_explicit(&aRing->sHead, memory_order_acquire);
+  if (iHead == iTail)
+  {
+    return NULL;
+  }
+  return &aRing->sSlots[iTail % aRing->sCount];
+}
+
+/**************************************************************************/
+/*!
+    @brief  Konzument: vrátí slot z NFC_RingPeek producentovi
+
+    @param  aRing     Pointer na frontu
+*/
+/**************************************************************************/
+void NFC_RingRelease(TNFCRing *aRing)
+{
+  size_t iTail = atomic_load_explicit(&aRing->sTail, memory_order_relaxed);
+  atomic_store_explicit(&aRing->sTail, iTail + 1, memory_order_release);
+}
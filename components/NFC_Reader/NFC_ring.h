@@ -0,0 +1,57 @@
+/* ==========================================
+    NFC_ring - Fronta jeden zapisovatel / jeden čtenář bez zámků
+    Copyright (c) 2023 Luboš Chmelař
+    [Licence]
+========================================== */
+#ifndef NFC_ring_H
+#define NFC_ring_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "NFC_reader.h"
+#include "NFC_watch.h"
+
+  // Jeden slot fronty: udalost karty a jeji obsah
+  typedef struct
+  {
+    TNFCEvent sEvent;
+    bool sLoaded;        // sData obsahuje obsah karty
+    size_t sNumOfBlocks; // platne struktury v sData
+    TDataNFC *sData;     // predalokovano v NFC_RingInit, sMaxBlocks struktur
+  } TNFCRecord;
+
+  // Sloty se alokuji jednou pri NFC_RingInit, za behu se nic nealokuje.
+  // Zapisuje jen jedna uloha (producent) a cte jen jedna (konzument).
+  typedef struct
+  {
+    TNFCRecord *sSlots;
+    TDataNFC *sData;
+    size_t sCount;          // pocet slotu
+    size_t sMaxBlocks;      // struktur TDataNFC na slot
+    atomic_size_t sHead;    // pocitadlo zapsanych slotu, meni jen producent
+    atomic_size_t sTail;    // pocitadlo prectenych slotu, meni jen konzument
+    TaskHandle_t sConsumer; // uloha buzena po NFC_RingCommit, nebo NULL
+  } TNFCRing;
+
+  bool NFC_RingInit(TNFCRing *aRing, size_t aSlots, size_t aMaxBlocks);
+  TNFCRecord *NFC_RingReserve(TNFCRing *aRing);
+  void NFC_RingCommit(TNFCRing *aRing);
+  TNFCRecord *NFC_RingPeek(TNFCRing *aRing);
+  void NFC_RingRelease(TNFCRing *aRing);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
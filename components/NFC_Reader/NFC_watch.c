@@ -0,0 +1,232 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+
+#include <esp_timer.h>
+#include "sdkconfig.h"
+
+#include "NFC_watch.h"
+
+#ifdef CONFIG_NFC_POLL_PERIOD_MS
+#define POLLPERIOD (CONFIG_NFC_POLL_PERIOD_MS / 150) // InAutoPoll pocita v 150 ms
+#else
+#define POLLPERIOD 1
+#endif
+#ifdef CONFIG_NFC_PRESENCE_MS
+#define PRESENCEPERIOD CONFIG_NFC_PRESENCE_MS
+#else
+#define PRESENCEPERIOD 250
+#endif
+#define AUTOPOLLWAIT 5000 // po teto dobe se InAutoPoll prerusi a zamek se na chvili uvolni
+#ifdef CONFIG_NFC_IDLE_POWERDOWN
+#define IDLEPOWERDOWN 1 // bez karty PN532 spi v PowerDown a budi se jen na kratke hledani
+#define IDLESLEEP CONFIG_NFC_IDLE_SLEEP_MS
+#else
+#define IDLEPOWERDOWN 0
+#define IDLESLEEP 0
+#endif
+// odhad proudu PN532 z typickych hodnot datasheetu, pro presne cislo zmerit na miste
+#define SLEEPCURRENTUA 10
+#define AWAKECURRENTUA 60000
+#define WAKEUPSOURCES (PN532_WAKEUP_RF | PN532_WAKEUP_HSU | PN532_WAKEUP_SPI | PN532_WAKEUP_I2C)
+#define WATCHSTACK 4096
+
+/**************************************************************************/
+/*!
+    @brief  Pošle do fronty událost s UID karty relace
+
+    @param  aWatch    Pointer na hlídání čtečky
+    @param  aType     Druh události
+*/
+/**************************************************************************/
+static void NFC_WatchPost(TNFCWatch *aWatch, TNFCEventType aType)
+{
+  TNFCEvent iEvent;
+  iEvent.sType = aType;
+  iEvent.sTime = esp_timer_get_time();
+  iEvent.sUidLength = aWatch->sSession->sUidLength;
+  memcpy(iEvent.sUid, aWatch->sSession->sUid, sizeof(iEvent.sUid));
+  // plna fronta: udalost se zahodi, hlidani nesmi cekat na aplikaci
+  xQueueSend(aWatch->sEvents, &iEvent, 0);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Probudí PN532, pokud ho NFC_WatchIdle nechal spát v PowerDown,
+            a přičte dobu spánku. Volá se jen pod zámkem.
+
+    @param  aWatch    Pointer na hlídání
+*/
+/**************************************************************************/
+static void NFC_WatchResume(TNFCWatch *aWatch)
+{
+  if (!aWatch->sAsleep)
+  {
+    return;
+  }
+  aWatch->sSleepUs += esp_timer_get_time() - aWatch->sSleepStart;
+  pn532_wakeup(aWatch->sSession->sNFC);
+  aWatch->sAsleep = false;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Jedno kolo klidového režimu: PN532 usne v PowerDown, po
+            IDLESLEEP ms (nebo dřív při probuzení cizím RF polem přes IRQ)
+            se probudí a jednou hledá kartu. Zámek je během spánku volný.
+
+    @param  aWatch    Pointer na hlídání
+
+    @returns True - Pokud se našla karta
+*/
+/**************************************************************************/
+static bool NFC_WatchIdle(TNFCWatch *aWatch)
+{
+  static const char *TAGin = "NFC_WatchIdle";
+  TNFCSession *iSession = aWatch->sSession;
+  pn532_t *iNFC = iSession->sNFC;
+  aWatch->sSleepStart = esp_timer_get_time();
+  aWatch->sAsleep = pn532_powerDown(iNFC, WAKEUPSOURCES, true);
+  xSemaphoreGive(aWatch->sLock);
+  bool iRf = pn532_waitWakeup(iNFC, IDLESLEEP);
+  xSemaphoreTake(aWatch->sLock, portMAX_DELAY);
+  int64_t iWake = esp_timer_get_time();
+  // mezitim ho mohl probudit drzitel zamku v NFC_WatchLock
+  NFC_WatchResume(aWatch);
+  bool iFound = NFC_SessionAutoPoll(iSession, iNFC, 1, POLLPERIOD, AUTOPOLLWAIT);
+  int64_t iDone = esp_timer_get_time();
+  aWatch->sAwakeUs += iDone - iWake;
+  if (iFound)
+  {
+    int64_t iTotal = aWatch->sSleepUs + aWatch->sAwakeUs;
+    aWatch->sWakeLatencyUs = iDone - iWake;
+    printf("[%s] Karta %lld us po probuzeni%s, nejdele %lld us od prilozeni. PN532 spal %lld %% casu, odhad %lld uA.\n", TAGin,
+           aWatch->sWakeLatencyUs, iRf ? " (RF pole)" : "", (int64_t)IDLESLEEP * 1000 + aWatch->sWakeLatencyUs,
+           iTotal ? aWatch->sSleepUs * 100 / iTotal : 0,
+           iTotal ? (aWatch->sSleepUs * SLEEPCURRENTUA + aWatch->sAwakeUs * AWAKECURRENTUA) / iTotal : 0);
+    aWatch->sSleepUs = 0;
+    aWatch->sAwakeUs = 0;
+  }
+  return iFound;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Úloha hlídání čtečky. Bez karty čeká na odpověď InAutoPoll,
+            s kartou po PRESENCEPERIOD ms ověřuje, že je karta přítomná.
+
+    @param  pvParameter Pointer na TNFCWatch
+*/
+/**************************************************************************/
+static void NFC_WatchTask(void *pvParameter)
+{
+  TNFCWatch *iWatch = (TNFCWatch *)pvParameter;
+  TNFCSession *iSession = iWatch->sSession;
+  pn532_t *iNFC = iSession->sNFC;
+  bool iPresent = false;
+  while (1)
+  {
+    xSemaphoreTake(iWatch->sLock, portMAX_DELAY);
+    if (!iPresent)
+    {
+      iPresent = IDLEPOWERDOWN ? NFC_WatchIdle(iWatch) : NFC_SessionAutoPoll(iSession, iNFC, PN532_AUTOPOLL_ENDLESS, POLLPERIOD, AUTOPOLLWAIT);
+      xSemaphoreGive(iWatch->sLock);
+      if (iPresent)
+      {
+        NFC_WatchPost(iWatch, NFC_EVENT_ARRIVED);
+      }
+      else
+      {
+        // ostatni ulohy dostanou prilezitost ke ctecce
+        vTaskDelay(1);
+      }
+      continue;
+    }
+    iPresent = NFC_isCardReadyToRead(iSession);
+    if (!iPresent)
+    {
+      NFC_WatchPost(iWatch, NFC_EVENT_REMOVED);
+      NFC_SessionClose(iSession);
+    }
+    xSemaphoreGive(iWatch->sLock);
+    if (iPresent)
+    {
+      vTaskDelay(pdMS_TO_TICKS(PRESENCEPERIOD));
+    }
+  }
+}
+
+/**************************************************************************/
+/*!
+    @brief  Spustí hlídání čtečky. Přiložení a odebrání karty chodí jako
+            TNFCEvent do fronty aWatch->sEvents.
+
+    @param  aWatch      Pointer na hlídání
+    @param  aSession    Relace, kterou hlídání otevírá a zavírá
+    @param  aNFC        Pointer na NFC strukturu (po NFC_init)
+    @param  aQueueLen   Délka fronty událostí
+    @param  aPriority   Priorita úlohy hlídání
+    @param  aCore       Jádro pro úlohu hlídání, tskNO_AFFINITY - libovolné
+
+    @returns True - Pokud hlídání běží
+*/
+/**************************************************************************/
+bool NFC_WatchStart(TNFCWatch *aWatch, TNFCSession *aSession, pn532_t *aNFC, size_t aQueueLen, UBaseType_t aPriority, BaseType_t aCore)
+{
+  memset(aSession, 0, sizeof(*aSession));
+  aSession->sNFC = aNFC;
+  aWatch->sSession = aSession;
+  aWatch->sAsleep = false;
+  aWatch->sSleepStart = 0;
+  aWatch->sSleepUs = 0;
+  aWatch->sAwakeUs = 0;
+  aWatch->sWakeLatencyUs = 0;
+  aWatch->sEvents = xQueueCreate(aQueueLen, sizeof(TNFCEvent));
+  aWatch->sLock = xSemaphoreCreateMutex();
+  if (aWatch->sEvents == NULL || aWatch->sLock == NULL)
+  {
+    return false;
+  }
+  return xTaskCreatePinnedToCore(&NFC_WatchTask, "nfc_watch", WATCHSTACK, aWatch, aPriority, &aWatch->sTask, aCore) == pdPASS;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Zamkne čtečku pro práci s kartou mimo úlohu hlídání. Spí-li
+            PN532 v klidovém režimu, probudí ho, takže volající může hned
+            posílat příkazy.
+
+    @param  aWatch    Pointer na hlídání
+    @param  aWait     Doba čekání na zámek v tickách
+
+    @returns True - Pokud se zámek získal
+*/
+/**************************************************************************/
+bool NFC_WatchLock(TNFCWatch *aWatch, TickType_t aWait)
+{
+  if (xSemaphoreTake(aWatch->sLock, aWait) != pdTRUE)
+  {
+    return false;
+  }
+  NFC_WatchResume(aWatch);
+  return true;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Odemkne čtečku zamčenou NFC_WatchLock
+
+    @param  aWatch    Pointer na hlídání
+*/
+/**************************************************************************/
+void NFC_WatchUnlock(TNFCWatch *aWatch)
+{
+  xSemaphoreGive(aWatch->sLock);
+}
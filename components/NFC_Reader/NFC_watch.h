@@ -0,0 +1,62 @@
+/* ==========================================
+    NFC_watch - Události přiložení a odebrání karty
+    Copyright (c) 2023 Luboš Chmelař
+    [Licence]
+========================================== */
+#ifndef NFC_watch_H
+#define NFC_watch_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+#include "NFC_reader.h"
+
+  // Druh udalosti ve fronte sEvents
+  typedef enum
+  {
+    NFC_EVENT_ARRIVED = 0, // karta prilozena, relace je otevrena
+    NFC_EVENT_REMOVED      // karta odebrana, relace je zavrena
+  } TNFCEventType;
+
+  typedef struct
+  {
+    TNFCEventType sType;
+    uint8_t sUid[7];
+    uint8_t sUidLength;
+    int64_t sTime; // esp_timer_get_time() v okamziku zjisteni
+  } TNFCEvent;
+
+  // Ctecka s vlastni ulohou, ktera hlida kartu; ostatni pristup k ctecce jen pod zamkem
+  typedef struct
+  {
+    TNFCSession *sSession;
+    QueueHandle_t sEvents;
+    SemaphoreHandle_t sLock;
+    TaskHandle_t sTask;
+    bool sAsleep;           // PN532 spi v PowerDown, probudi ho az dalsi drzitel zamku
+    int64_t sSleepStart;    // kdy PN532 usnul
+    int64_t sSleepUs;       // CONFIG_NFC_IDLE_POWERDOWN: cas v PowerDown od posledni karty
+    int64_t sAwakeUs;       // cas hledani karty od posledni karty
+    int64_t sWakeLatencyUs; // od probuzeni po nalezeni posledni karty
+  } TNFCWatch;
+
+  bool NFC_WatchStart(TNFCWatch *aWatch, TNFCSession *aSession, pn532_t *aNFC, size_t aQueueLen, UBaseType_t aPriority, BaseType_t aCore);
+  bool NFC_WatchLock(TNFCWatch *aWatch, TickType_t aWait);
+  void NFC_WatchUnlock(TNFCWatch *aWatch);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
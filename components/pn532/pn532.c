@@ -12,6 +12,9 @@
 #include <esp_log_internal.h>
 
 #include "driver/gpio.h"
+#include "driver/spi_master.h"
+#include "esp_heap_caps.h"
+#include "esp_rom_sys.h"
 #include "pn532.h"
 
 //#define PN532_DEBUG_EN
@@ -29,7 +32,8 @@
 #define MIFARE_DEBUG(fmt, ...)
 #endif
 
-#define PN532_PACKBUFFSIZ 64
+// Largest single SPI transfer: direction byte + frame header/trailer + packet
+#define PN532_SPI_DMABUFFSIZ (PN532_PACKBUFFSIZ + 16)
 
 #ifndef _BV
 #define _BV(bit) (1 << (bit))
@@ -37,17 +41,58 @@
 
 #define PN532_DELAY(ms) vTaskDelay(ms / portTICK_PERIOD_MS)
 
-static uint8_t pn532ack[] = {0x00, 0x00, 0xFF, 0x00, 0xFF, 0x00};
-static uint8_t pn532response_firmwarevers[] = {0x00, 0xFF, 0x06, 0xFA, 0xD5, 0x03};
-static uint8_t pn532_packetbuffer[PN532_PACKBUFFSIZ];
+// Time the PN532 needs between SS going low and the first SCK edge. Busy
+// waited, a vTaskDelay here would cost a whole tick (10 ms at 100 Hz).
+#define PN532_SS_SETUP_US 100
 
-static void pn532_readdata(pn532_t *obj, uint8_t *buff, uint8_t n);
+// CONFIG_PN532_SPI_LEGACY_TIMING puts back the tick sleeps of the original
+// SPI code, at every SS select and before every byte read, only so that
+// NFC_BENCHMARK can compare NFC_LoadNFC with and without them
+#ifdef CONFIG_PN532_SPI_LEGACY_TIMING
+#define PN532_LEGACY_TIMING 1
+#else
+#define PN532_LEGACY_TIMING 0
+#endif
+
+// SS low time that brings the PN532 back from PowerDown. Only the cold boot
+// in pn532_begin needs the long pulse of pn532_spi_wakeup.
+#define PN532_SPI_RESUME_US 2000
+
+// Result of pn532_readframe()
+typedef enum
+{
+    PN532_FRAME_INVALID = 0, // bad preamble, LCS/DCS mismatch or too long
+    PN532_FRAME_DATA,        // normal information frame (PN532 to host)
+    PN532_FRAME_ACK,
+    PN532_FRAME_NACK,
+    PN532_FRAME_ERROR,       // syntax error frame (TFI 0x7F)
+} pn532_frame_t;
+
+// Bytes in front of the frame data: PREAMBLE STARTCODE1 STARTCODE2 LEN LCS
+#define PN532_FRAME_HEADER 5
+
+static pn532_frame_t pn532_readframe(pn532_t *obj, uint8_t *buff, uint8_t maxlen);
 static void pn532_writecommand(pn532_t *obj, uint8_t *cmd, uint8_t cmdlen);
 static bool pn532_readack(pn532_t *obj);
 static bool pn532_isready(pn532_t *obj);
 static bool pn532_waitready(pn532_t *obj, uint16_t timeout);
+static bool pn532_writeack(pn532_t *obj);
+static uint8_t pn532_parsetarget(const uint8_t *target, uint8_t len, pn532_target_t *out);
+static void pn532_storetargets(pn532_t *obj, pn532_target_t *list, uint8_t count);
+static void pn532_activatetarget(pn532_t *obj, uint8_t index);
+static bool pn532_reselect(pn532_t *obj);
 static void pn532_spi_write(pn532_t *obj, uint8_t c);
 static uint8_t pn532_spi_read(pn532_t *obj);
+static bool pn532_spi_transfer(pn532_t *obj, const uint8_t *tx, size_t txlen, uint8_t *rx, size_t len);
+static void pn532_select(pn532_t *obj);
+static void pn532_deselect(pn532_t *obj);
+static bool pn532_spi_writeframe(pn532_t *obj, const uint8_t *frame, uint8_t len);
+static uint8_t pn532_spi_readframe(pn532_t *obj, uint8_t *buff, uint8_t maxlen);
+static bool pn532_spi_isready(pn532_t *obj);
+static void pn532_spi_wakeup(pn532_t *obj);
+static void pn532_spi_resume(pn532_t *obj);
+static bool pn532_waitirq(pn532_t *obj, uint16_t timeout);
+static bool pn532_waitirqslot(pn532_t *obj, volatile TaskHandle_t *slot, uint16_t timeout);
 
 //static const char *TAG = "library";
 
@@ -57,6 +102,9 @@ void pn532_spi_init(pn532_t *obj, uint8_t clk, uint8_t miso, uint8_t mosi, uint8
     obj->_miso = miso;
     obj->_mosi = mosi;
     obj->_ss = ss;
+    obj->_transport = &pn532_transport_spi;
+    obj->_spi = NULL;
+    obj->_irq = -1;
 
     esp_rom_gpio_pad_select_gpio(obj->_clk);
     esp_rom_gpio_pad_select_gpio(obj->_miso);
@@ -70,6 +118,153 @@ void pn532_spi_init(pn532_t *obj, uint8_t clk, uint8_t miso, uint8_t mosi, uint8
     gpio_set_direction(obj->_miso, GPIO_MODE_INPUT);
 }
 
+/**************************************************************************/
+/*!
+    @brief  Sets up the PN532 on a hardware SPI peripheral (spi_master
+            driver, mode 0, LSB first). Every frame is then clocked out or
+            in as a single DMA transaction instead of bit by bit.
+
+            SS stays a plain GPIO driven by this library so the PN532
+            wake-up timing is the same as with the soft SPI backend. Several
+            PN532s may share one host, the bus is only initialised once.
+
+    @param  host      SPI peripheral to use (SPI2_HOST or SPI3_HOST)
+    @param  clk       SCK GPIO
+    @param  miso      MISO GPIO
+    @param  mosi      MOSI GPIO
+    @param  ss        SS GPIO
+    @param  clock_hz  SCK frequency, the PN532 allows up to 5 MHz
+
+    @returns true if the bus and the device were set up
+*/
+/**************************************************************************/
+bool pn532_spi_init_hw(pn532_t *obj, spi_host_device_t host, uint8_t clk, uint8_t miso, uint8_t mosi, uint8_t ss, int clock_hz)
+{
+    obj->_clk = clk;
+    obj->_miso = miso;
+    obj->_mosi = mosi;
+    obj->_ss = ss;
+    obj->_transport = &pn532_transport_spi;
+    obj->_spi = NULL;
+    obj->_irq = -1;
+
+    esp_rom_gpio_pad_select_gpio(obj->_ss);
+    gpio_set_direction(obj->_ss, GPIO_MODE_OUTPUT);
+    gpio_set_level(obj->_ss, 1);
+
+    spi_bus_config_t buscfg = {
+        .mosi_io_num = mosi,
+        .miso_io_num = miso,
+        .sclk_io_num = clk,
+        .quadwp_io_num = -1,
+        .quadhd_io_num = -1,
+        .max_transfer_sz = PN532_SPI_DMABUFFSIZ,
+    };
+    esp_err_t err = spi_bus_initialize(host, &buscfg, SPI_DMA_CH_AUTO);
+    if (err != ESP_OK && err != ESP_ERR_INVALID_STATE) // INVALID_STATE: bus already up
+    {
+        PN532_DEBUG("SPI bus init failed: %d\n", err);
+        return false;
+    }
+
+    spi_device_interface_config_t devcfg = {
+        .mode = 0,
+        .clock_speed_hz = clock_hz,
+        .spics_io_num = -1,
+        .flags = SPI_DEVICE_BIT_LSBFIRST,
+        .queue_size = 1,
+    };
+    if (spi_bus_add_device(host, &devcfg, &obj->_spi) != ESP_OK)
+    {
+        PN532_DEBUG("SPI device add failed\n");
+        obj->_spi = NULL;
+        return false;
+    }
+
+    obj->_spi_tx = heap_caps_malloc(PN532_SPI_DMABUFFSIZ, MALLOC_CAP_DMA);
+    obj->_spi_rx = heap_caps_malloc(PN532_SPI_DMABUFFSIZ, MALLOC_CAP_DMA);
+    if (obj->_spi_tx == NULL || obj->_spi_rx == NULL)
+    {
+        PN532_DEBUG("No DMA memory for SPI buffers\n");
+        heap_caps_free(obj->_spi_tx);
+        heap_caps_free(obj->_spi_rx);
+        obj->_spi_tx = NULL;
+        obj->_spi_rx = NULL;
+        spi_bus_remove_device(obj->_spi);
+        obj->_spi = NULL;
+        return false;
+    }
+
+    return true;
+}
+
+/**************************************************************************/
+/*!
+    @brief  IRQ falling edge: wakes the task blocked in pn532_waitready and
+            the one blocked in pn532_waitWakeup
+*/
+/**************************************************************************/
+static void IRAM_ATTR pn532_irq_isr(void *arg)
+{
+    pn532_t *obj = (pn532_t *)arg;
+    BaseType_t woken = pdFALSE;
+    TaskHandle_t task = obj->_irqtask;
+    TaskHandle_t waketask = obj->_waketask;
+
+    if (task != NULL)
+    {
+        vTaskNotifyGiveFromISR(task, &woken);
+    }
+    if (waketask != NULL && waketask != task)
+    {
+        vTaskNotifyGiveFromISR(waketask, &woken);
+    }
+    portYIELD_FROM_ISR(woken);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Uses the PN532 IRQ line for readiness instead of polling the
+            status byte. Call after pn532_spi_init / pn532_spi_init_hw.
+
+            While waiting, the calling task blocks on its task notification
+            (index 0), so that task should not use plain notifications for
+            anything else during a PN532 command. pn532_waitWakeup has a
+            slot of its own, so one task may sleep in it while another one
+            runs commands.
+
+    @param  irq       GPIO connected to the PN532 P70_IRQ pin
+
+    @returns true if the interrupt was installed
+*/
+/**************************************************************************/
+bool pn532_irq_init(pn532_t *obj, uint8_t irq)
+{
+    obj->_irq = -1;
+    obj->_irqtask = NULL;
+    obj->_waketask = NULL;
+
+    esp_rom_gpio_pad_select_gpio(irq);
+    gpio_set_direction(irq, GPIO_MODE_INPUT);
+    gpio_set_pull_mode(irq, GPIO_PULLUP_ONLY); // fails harmlessly on input-only pins
+    gpio_set_intr_type(irq, GPIO_INTR_NEGEDGE);
+
+    esp_err_t err = gpio_install_isr_service(0);
+    if (err != ESP_OK && err != ESP_ERR_INVALID_STATE) // INVALID_STATE: already installed
+    {
+        PN532_DEBUG("GPIO ISR service install failed: %d\n", err);
+        return false;
+    }
+    if (gpio_isr_handler_add(irq, pn532_irq_isr, obj) != ESP_OK)
+    {
+        PN532_DEBUG("IRQ handler add failed\n");
+        return false;
+    }
+
+    obj->_irq = irq;
+    return true;
+}
+
 /**************************************************************************/
 /*!
     @brief  Setups the HW
@@ -77,16 +272,20 @@ void pn532_spi_init(pn532_t *obj, uint8_t clk, uint8_t miso, uint8_t mosi, uint8
 /**************************************************************************/
 void pn532_begin(pn532_t *obj)
 {
-    gpio_set_level(obj->_ss, 0);
-
-    PN532_DELAY(1000);
+    obj->_transport->wakeup(obj);
+    obj->_inListedTag = 1;
+    obj->_targetCount = 0;
+    obj->_target = 0;
+    obj->_selectCount = 0;
 
     // not exactly sure why but we have to send a dummy command to get synced up
-    pn532_packetbuffer[0] = PN532_COMMAND_GETFIRMWAREVERSION;
-    pn532_sendCommandCheckAck(obj, pn532_packetbuffer, 1, 1000);
-
-    // ignore response!
-    gpio_set_level(obj->_ss, 1);
+    obj->_packetbuffer[0] = PN532_COMMAND_GETFIRMWAREVERSION;
+    if (pn532_sendCommandCheckAck(obj, obj->_packetbuffer, 1, 1000))
+    {
+        // ignore response! It is read all the same, on HSU it would stay
+        // in the UART buffer and pass for the ACK of the next command
+        pn532_readframe(obj, obj->_packetbuffer, sizeof(obj->_packetbuffer));
+    }
 }
 
 /**************************************************************************/
@@ -101,31 +300,33 @@ uint32_t pn532_getFirmwareVersion(pn532_t *obj)
     
     uint32_t response;
 
-    pn532_packetbuffer[0] = PN532_COMMAND_GETFIRMWAREVERSION;
+    obj->_packetbuffer[0] = PN532_COMMAND_GETFIRMWAREVERSION;
 
-    if (!pn532_sendCommandCheckAck(obj, pn532_packetbuffer, 1, 1000))
+    if (!pn532_sendCommandCheckAck(obj, obj->_packetbuffer, 1, 1000))
     {
         return 0;
     }
     // read data packet
-    pn532_readdata(obj, pn532_packetbuffer, 12);
+    if (pn532_readframe(obj, obj->_packetbuffer, sizeof(obj->_packetbuffer)) != PN532_FRAME_DATA)
+    {
+        return 0;
+    }
 
-    
     // check some basic stuff
-    if (0 != strncmp((char *)pn532_packetbuffer, (char *)pn532response_firmwarevers, 6))
+    if (obj->_packetbuffer[3] != 6 || obj->_packetbuffer[6] != PN532_COMMAND_GETFIRMWAREVERSION + 1)
     {
         PN532_DEBUG("Firmware doesn't match!\n");
         return 0;
     }
 
-    int offset = 6;
-    response = pn532_packetbuffer[offset++];
+    int offset = 7;
+    response = obj->_packetbuffer[offset++];
     response <<= 8;
-    response |= pn532_packetbuffer[offset++];
+    response |= obj->_packetbuffer[offset++];
     response <<= 8;
-    response |= pn532_packetbuffer[offset++];
+    response |= obj->_packetbuffer[offset++];
     response <<= 8;
-    response |= pn532_packetbuffer[offset++];
+    response |= obj->_packetbuffer[offset++];
 
     return response;
 }
@@ -199,28 +400,29 @@ bool pn532_writeGPIO(pn532_t *obj, uint8_t pinstate)
     pinstate |= (1 << PN532_GPIO_P32) | (1 << PN532_GPIO_P34);
 
     // Fill command buffer
-    pn532_packetbuffer[0] = PN532_COMMAND_WRITEGPIO;
-    pn532_packetbuffer[1] = PN532_GPIO_VALIDATIONBIT | pinstate; // P3 Pins
-    pn532_packetbuffer[2] = 0x00;                                // P7 GPIO Pins (not used ... taken by SPI)
+    obj->_packetbuffer[0] = PN532_COMMAND_WRITEGPIO;
+    obj->_packetbuffer[1] = PN532_GPIO_VALIDATIONBIT | pinstate; // P3 Pins
+    obj->_packetbuffer[2] = 0x00;                                // P7 GPIO Pins (not used ... taken by SPI)
 
-    PN532_DEBUG("Writing P3 GPIO: %02x\n", pn532_packetbuffer[1]);
+    PN532_DEBUG("Writing P3 GPIO: %02x\n", obj->_packetbuffer[1]);
 
     // Send the WRITEGPIO command (0x0E)
-    if (!pn532_sendCommandCheckAck(obj, pn532_packetbuffer, 3, 1000))
+    if (!pn532_sendCommandCheckAck(obj, obj->_packetbuffer, 3, 1000))
         return 0x0;
 
-    // Read response packet (00 FF PLEN PLENCHECKSUM D5 CMD+1(0x0F) DATACHECKSUM 00)
-    pn532_readdata(obj, pn532_packetbuffer, 8);
+    // Read response packet (00 00 FF PLEN PLENCHECKSUM D5 CMD+1(0x0F) DATACHECKSUM 00)
+    if (pn532_readframe(obj, obj->_packetbuffer, sizeof(obj->_packetbuffer)) != PN532_FRAME_DATA)
+        return 0x0;
 
     PN532_DEBUG("Received:");
     for (int i = 0; i < 8; i++)
     {
-        PN532_DEBUG(" %02x", pn532_packetbuffer[i]);
+        PN532_DEBUG(" %02x", obj->_packetbuffer[i]);
     }
     PN532_DEBUG("\n");
 
-    int offset = 5;
-    return (pn532_packetbuffer[offset] == 0x0F);
+    int offset = 6;
+    return (obj->_packetbuffer[offset] == 0x0F);
 }
 
 /**************************************************************************/
@@ -239,39 +441,40 @@ bool pn532_writeGPIO(pn532_t *obj, uint8_t pinstate)
 /**************************************************************************/
 uint8_t pn532_readGPIO(pn532_t *obj)
 {
-    pn532_packetbuffer[0] = PN532_COMMAND_READGPIO;
+    obj->_packetbuffer[0] = PN532_COMMAND_READGPIO;
 
     // Send the READGPIO command (0x0C)
-    if (!pn532_sendCommandCheckAck(obj, pn532_packetbuffer, 1, 1000))
+    if (!pn532_sendCommandCheckAck(obj, obj->_packetbuffer, 1, 1000))
         return 0x0;
 
-    // Read response packet (00 FF PLEN PLENCHECKSUM D5 CMD+1(0x0D) P3 P7 IO1 DATACHECKSUM 00)
-    pn532_readdata(obj, pn532_packetbuffer, 11);
+    // Read response packet (00 00 FF PLEN PLENCHECKSUM D5 CMD+1(0x0D) P3 P7 IO1 DATACHECKSUM 00)
+    if (pn532_readframe(obj, obj->_packetbuffer, sizeof(obj->_packetbuffer)) != PN532_FRAME_DATA)
+        return 0x0;
 
     /* READGPIO response should be in the following format:
 
     uint8_t            Description
     -------------   ------------------------------------------
-    b0..5           Frame header and preamble (with I2C there is an extra 0x00)
-    b6              P3 GPIO Pins
-    b7              P7 GPIO Pins (not used ... taken by SPI)
-    b8              Interface Mode Pins (not used ... bus select pins)
-    b9..10          checksum */
+    b0..6           Frame header, preamble and response code
+    b7              P3 GPIO Pins
+    b8              P7 GPIO Pins (not used ... taken by SPI)
+    b9              Interface Mode Pins (not used ... bus select pins)
+    b10..11         checksum and postamble */
 
-    int p3offset = 6;
+    int p3offset = 7;
 
     PN532_DEBUG("Received:");
-    for (int i = 0; i < 11; i++)
+    for (int i = 0; i < 12; i++)
     {
-        PN532_DEBUG(" %02x", pn532_packetbuffer[i]);
+        PN532_DEBUG(" %02x", obj->_packetbuffer[i]);
     }
     PN532_DEBUG("\n");
 
-    PN532_DEBUG("P3 GPIO: %02x\n", pn532_packetbuffer[p3offset]);
-    PN532_DEBUG("P7 GPIO: %02x\n", pn532_packetbuffer[p3offset + 1]);
-    PN532_DEBUG("IO GPIO: %02x\n", pn532_packetbuffer[p3offset + 2]);
+    PN532_DEBUG("P3 GPIO: %02x\n", obj->_packetbuffer[p3offset]);
+    PN532_DEBUG("P7 GPIO: %02x\n", obj->_packetbuffer[p3offset + 1]);
+    PN532_DEBUG("IO GPIO: %02x\n", obj->_packetbuffer[p3offset + 2]);
     // Note: You can use the IO GPIO value to detect the serial bus being used
-    switch (pn532_packetbuffer[p3offset + 2])
+    switch (obj->_packetbuffer[p3offset + 2])
     {
     case 0x00: // Using UART
         PN532_DEBUG("Using UART (IO = 0x00)\n");
@@ -284,7 +487,7 @@ uint8_t pn532_readGPIO(pn532_t *obj)
         break;
     }
 
-    return pn532_packetbuffer[p3offset];
+    return obj->_packetbuffer[p3offset];
 }
 
 /**************************************************************************/
@@ -294,19 +497,20 @@ uint8_t pn532_readGPIO(pn532_t *obj)
 /**************************************************************************/
 bool pn532_SAMConfig(pn532_t *obj)
 {
-    pn532_packetbuffer[0] = PN532_COMMAND_SAMCONFIGURATION;
-    pn532_packetbuffer[1] = 0x01; // normal mode;
-    pn532_packetbuffer[2] = 0x14; // timeout 50ms * 20 = 1 second
-    pn532_packetbuffer[3] = 0x01; // use IRQ pin!
+    obj->_packetbuffer[0] = PN532_COMMAND_SAMCONFIGURATION;
+    obj->_packetbuffer[1] = 0x01; // normal mode;
+    obj->_packetbuffer[2] = 0x14; // timeout 50ms * 20 = 1 second
+    obj->_packetbuffer[3] = 0x01; // use IRQ pin!
 
-    if (!pn532_sendCommandCheckAck(obj, pn532_packetbuffer, 4, 1000))
+    if (!pn532_sendCommandCheckAck(obj, obj->_packetbuffer, 4, 1000))
         return false;
 
     // read data packet
-    pn532_readdata(obj, pn532_packetbuffer, 8);
+    if (pn532_readframe(obj, obj->_packetbuffer, sizeof(obj->_packetbuffer)) != PN532_FRAME_DATA)
+        return false;
 
-    int offset = 5;
-    return (pn532_packetbuffer[offset] == 0x15);
+    int offset = 6;
+    return (obj->_packetbuffer[offset] == 0x15);
 }
 
 /**************************************************************************/
@@ -321,18 +525,156 @@ bool pn532_SAMConfig(pn532_t *obj)
 /**************************************************************************/
 bool pn532_setPassiveActivationRetries(pn532_t *obj, uint8_t maxRetries)
 {
-    pn532_packetbuffer[0] = PN532_COMMAND_RFCONFIGURATION;
-    pn532_packetbuffer[1] = 5;    // Config item 5 (MaxRetries)
-    pn532_packetbuffer[2] = 0xFF; // MxRtyATR (default = 0xFF)
-    pn532_packetbuffer[3] = 0x01; // MxRtyPSL (default = 0x01)
-    pn532_packetbuffer[4] = maxRetries;
+    obj->_packetbuffer[0] = PN532_COMMAND_RFCONFIGURATION;
+    obj->_packetbuffer[1] = 5;    // Config item 5 (MaxRetries)
+    obj->_packetbuffer[2] = 0xFF; // MxRtyATR (default = 0xFF)
+    obj->_packetbuffer[3] = 0x01; // MxRtyPSL (default = 0x01)
+    obj->_packetbuffer[4] = maxRetries;
 
     PN532_DEBUG("Setting MxRtyPassiveActivation to %d\n", maxRetries);
 
-    if (!pn532_sendCommandCheckAck(obj, pn532_packetbuffer, 5, 1000))
+    if (!pn532_sendCommandCheckAck(obj, obj->_packetbuffer, 5, 1000))
         return 0x0; // no ACK
 
-    return 1;
+    // consume the response so it is not left pending on the bus
+    if (pn532_readframe(obj, obj->_packetbuffer, sizeof(obj->_packetbuffer)) != PN532_FRAME_DATA)
+        return 0x0;
+
+    return (obj->_packetbuffer[6] == PN532_COMMAND_RFCONFIGURATION + 1);
+}
+
+/**************************************************************************/
+/*!
+    Switches the RF field on or off (RFConfiguration item 1). The next
+    InListPassiveTarget / InAutoPoll switches it on again by itself.
+
+    @param  on        true to switch the field on
+
+    @returns 1 if everything executed properly, 0 for an error
+*/
+/**************************************************************************/
+bool pn532_setRFField(pn532_t *obj, bool on)
+{
+    obj->_packetbuffer[0] = PN532_COMMAND_RFCONFIGURATION;
+    obj->_packetbuffer[1] = 1;                // Config item 1 (RF field)
+    obj->_packetbuffer[2] = on ? 0x01 : 0x00; // AutoRFCA off, RF on / off
+
+    if (!pn532_sendCommandCheckAck(obj, obj->_packetbuffer, 3, 1000))
+        return 0x0;
+
+    if (pn532_readframe(obj, obj->_packetbuffer, sizeof(obj->_packetbuffer)) != PN532_FRAME_DATA)
+        return 0x0;
+
+    return (obj->_packetbuffer[6] == PN532_COMMAND_RFCONFIGURATION + 1);
+}
+
+/**************************************************************************/
+/*!
+    Changes the PN532 HSU baud rate. The PN532 answers at the old rate and
+    switches only after the host has ACKed the answer, so the caller must
+    change its own UART rate right after this returns.
+
+    @param  br    PN532_HSU_BR_xxx code
+
+    @returns 1 if the PN532 accepted the new rate, 0 for an error
+*/
+/**************************************************************************/
+bool pn532_setSerialBaudRate(pn532_t *obj, uint8_t br)
+{
+    obj->_packetbuffer[0] = PN532_COMMAND_SETSERIALBAUDRATE;
+    obj->_packetbuffer[1] = br;
+
+    if (!pn532_sendCommandCheckAck(obj, obj->_packetbuffer, 2, 1000))
+        return false;
+
+    if (pn532_readframe(obj, obj->_packetbuffer, sizeof(obj->_packetbuffer)) != PN532_FRAME_DATA)
+        return false;
+
+    if (obj->_packetbuffer[6] != PN532_COMMAND_SETSERIALBAUDRATE + 1)
+        return false;
+
+    return pn532_writeack(obj);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Sends an ACK frame to the PN532. After a response it confirms
+            the response, during a command it aborts the command.
+*/
+/**************************************************************************/
+static bool pn532_writeack(pn532_t *obj)
+{
+    static const uint8_t ack[] = {PN532_PREAMBLE, PN532_STARTCODE1, PN532_STARTCODE2, 0x00, 0xFF, PN532_POSTAMBLE};
+
+    return obj->_transport->write(obj, ack, sizeof(ack));
+}
+
+/**************************************************************************/
+/*!
+    Puts the PN532 into PowerDown. It keeps its configuration (SAMConfig,
+    RF settings) and answers again after pn532_wakeup, no pn532_begin is
+    needed.
+
+    @param  wakeupEnable  PN532_WAKEUP_xxx sources allowed to wake it; the
+                          host interface in use must be one of them
+    @param  generateIrq   Pull IRQ low when a wake-up source fires
+
+    @returns 1 if the PN532 went to sleep, 0 for an error
+*/
+/**************************************************************************/
+bool pn532_powerDown(pn532_t *obj, uint8_t wakeupEnable, bool generateIrq)
+{
+    obj->_packetbuffer[0] = PN532_COMMAND_POWERDOWN;
+    obj->_packetbuffer[1] = wakeupEnable;
+    obj->_packetbuffer[2] = generateIrq ? 0x01 : 0x00;
+
+    if (!pn532_sendCommandCheckAck(obj, obj->_packetbuffer, 3, 1000))
+        return false;
+
+    if (pn532_readframe(obj, obj->_packetbuffer, sizeof(obj->_packetbuffer)) != PN532_FRAME_DATA)
+        return false;
+
+    // D5 17 status, the PN532 sleeps about 1 ms after this answer
+    return obj->_packetbuffer[6] == PN532_COMMAND_POWERDOWN + 1 && (obj->_packetbuffer[7] & 0x3F) == 0x00;
+}
+
+/**************************************************************************/
+/*!
+    Sleeps until a PowerDown wake-up source pulls IRQ low. Without the IRQ
+    line the task just sleeps for the whole timeout. Does not touch the
+    slot of pn532_waitready, another task may run commands meanwhile (their
+    answers pull IRQ low too and end the sleep early).
+
+    @param  timeout   Time to sleep in ms
+
+    @returns 1 if the PN532 signalled a wake-up, 0 after the timeout
+*/
+/**************************************************************************/
+bool pn532_waitWakeup(pn532_t *obj, uint16_t timeout)
+{
+    if (obj->_irq >= 0)
+    {
+        return pn532_waitirqslot(obj, &obj->_waketask, timeout);
+    }
+    PN532_DELAY(timeout);
+    return false;
+}
+
+/**************************************************************************/
+/*!
+    Wakes the PN532 from PowerDown through the host interface (no resync,
+    the next command can follow right away). Uses the short resume of the
+    transport when it has one, the cold boot wake-up otherwise.
+*/
+/**************************************************************************/
+void pn532_wakeup(pn532_t *obj)
+{
+    if (obj->_transport->resume)
+    {
+        obj->_transport->resume(obj);
+        return;
+    }
+    obj->_transport->wakeup(obj);
 }
 
 /***** ISO14443A Commands ******/
@@ -352,19 +694,101 @@ bool pn532_setPassiveActivationRetries(pn532_t *obj, uint8_t maxRetries)
 /**************************************************************************/
 bool pn532_readPassiveTargetID(pn532_t *obj, uint8_t cardbaudrate, uint8_t *uid, uint8_t *uidLength, uint16_t timeout)
 {
-    pn532_packetbuffer[0] = PN532_COMMAND_INLISTPASSIVETARGET;
-    pn532_packetbuffer[1] = 1; // max 1 cards at once (we can set this to 2 later)
-    pn532_packetbuffer[2] = cardbaudrate;
+    if (pn532_listPassiveTargets(obj, cardbaudrate, 1, NULL, timeout) == 0)
+        return 0;
+
+    *uidLength = obj->_uidLen;
+    memcpy(uid, obj->_uid, obj->_uidLen);
+    return 1;
+}
+
+/**************************************************************************/
+/*!
+    Lists up to PN532_MAXTARGETS ISO14443A targets in the field at once
+    (InListPassiveTarget with MaxTg 2), e.g. two stacked cards. The first
+    target becomes the active one, pn532_selectTarget switches to the
+    other; the PN532 deselects and selects the cards itself on the next
+    exchange.
+
+    @param  cardBaudRate  Baud rate of the card
+    @param  maxTg         Number of targets to look for, 1..PN532_MAXTARGETS
+    @param  targets       Pointer to the array that receives the targets
+                          (maxTg entries), or NULL
+    @param  timeout       Time to wait in ms, 0 waits forever
+
+    @returns Number of targets found, 0 for none or an error
+*/
+/**************************************************************************/
+uint8_t pn532_listPassiveTargets(pn532_t *obj, uint8_t cardbaudrate, uint8_t maxTg, pn532_target_t *targets, uint16_t timeout)
+{
+    if (!pn532_startListPassiveTargets(obj, cardbaudrate, maxTg, timeout))
+        return 0;
+    return pn532_finishListPassiveTargets(obj, targets, timeout);
+}
+
+/**************************************************************************/
+/*!
+    First half of pn532_listPassiveTargets: sends InListPassiveTarget and
+    returns once the PN532 has ACKed it. The PN532 then looks for cards
+    on its own, meanwhile the bus is free for other modules.
+
+    @param  cardBaudRate  Baud rate of the card
+    @param  maxTg         Number of targets to look for, 1..PN532_MAXTARGETS
+    @param  timeout       Time to wait for the ACK in ms
+
+    @returns 1 if the command was ACKed
+*/
+/**************************************************************************/
+bool pn532_startListPassiveTargets(pn532_t *obj, uint8_t cardbaudrate, uint8_t maxTg, uint16_t timeout)
+{
+    if (maxTg == 0 || maxTg > PN532_MAXTARGETS)
+        maxTg = PN532_MAXTARGETS;
+
+    obj->_packetbuffer[0] = PN532_COMMAND_INLISTPASSIVETARGET;
+    obj->_packetbuffer[1] = maxTg;
+    obj->_packetbuffer[2] = cardbaudrate;
+
+    pn532_writecommand(obj, obj->_packetbuffer, 3);
+    if (!pn532_waitready(obj, timeout))
+        return 0;
+    if (!pn532_readack(obj))
+    {
+        PN532_DEBUG("No ACK frame received!\n");
+        return 0;
+    }
+    return 1;
+}
+
+/**************************************************************************/
+/*!
+    Second half of pn532_listPassiveTargets: waits for the answer and
+    stores the targets. On timeout the search is aborted with an ACK
+    frame, so the PN532 accepts the next command.
+
+    @param  targets       Pointer to the array that receives the targets,
+                          or NULL
+    @param  timeout       Time to wait in ms, 0 waits forever
+
+    @returns Number of targets found, 0 for none or an error
+*/
+/**************************************************************************/
+uint8_t pn532_finishListPassiveTargets(pn532_t *obj, pn532_target_t *targets, uint16_t timeout)
+{
+    pn532_target_t list[PN532_MAXTARGETS];
 
-    if (!pn532_sendCommandCheckAck(obj, pn532_packetbuffer, 3, timeout))
+    if (!pn532_waitready(obj, timeout))
     {
         PN532_DEBUG("No card(s) read\n");
-        return 0x0; // no cards read
+        pn532_writeack(obj);
+        return 0; // no cards read
     }
 
     // read data packet
-    pn532_readdata(obj, pn532_packetbuffer, 20);
+    if (pn532_readframe(obj, obj->_packetbuffer, sizeof(obj->_packetbuffer)) != PN532_FRAME_DATA)
+        return 0;
     // check some basic stuff
+    if (obj->_packetbuffer[6] != PN532_RESPONSE_INLISTPASSIVETARGET)
+        return 0;
 
     /* ISO14443A card response should be in the following format:
 
@@ -372,91 +796,271 @@ bool pn532_readPassiveTargetID(pn532_t *obj, uint8_t cardbaudrate, uint8_t *uid,
     -------------   ------------------------------------------
     b0..6           Frame header and preamble
     b7              Tags Found
-    b8              Tag Number (only one used in this example)
+    b8              Tag Number
     b9..10          SENS_RES
     b11             SEL_RES
     b12             NFCID Length
-    b13..NFCIDLen   NFCID                                      */
+    b13..NFCIDLen   NFCID
+    (ATS)           ATS length and ATS, ISO14443-4 targets only
+    ...             second target, same layout                 */
 
-    PN532_DEBUG("Found %d tags\n", pn532_packetbuffer[7]);
-    if (pn532_packetbuffer[7] != 1)
+    uint8_t count = obj->_packetbuffer[7];
+    PN532_DEBUG("Found %d tags\n", count);
+    if (count == 0 || count > PN532_MAXTARGETS)
         return 0;
 
-    uint16_t sens_res = pn532_packetbuffer[9];
-    sens_res <<= 8;
-    sens_res |= pn532_packetbuffer[10];
-    PN532_DEBUG("ATQA: %02x\n", sens_res);
-    PN532_DEBUG("SAK: %02x\n", pn532_packetbuffer[11]);
-
-    /* Card appears to be Mifare Classic */
-    *uidLength = pn532_packetbuffer[12];
-
-    for (uint8_t i = 0; i < pn532_packetbuffer[12]; i++)
+    // LEN counts TFI, response code and the tag count in front of the targets
+    const uint8_t *target = obj->_packetbuffer + 8;
+    uint8_t left = obj->_packetbuffer[3] - 3;
+    for (uint8_t i = 0; i < count; i++)
     {
-        uid[i] = pn532_packetbuffer[13 + i];
+        uint8_t used = pn532_parsetarget(target, left, &list[i]);
+        if (used == 0)
+            return 0;
+        target += used;
+        left -= used;
     }
 
-    PN532_DEBUG("UID:");
-    for (int i = 0; i < pn532_packetbuffer[12]; i++)
+    pn532_storetargets(obj, list, count);
+    if (targets != NULL)
+        memcpy(targets, obj->_targets, count * sizeof(pn532_target_t));
+    return count;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Makes the listed target with this UID the active one, the
+            following commands go to its Tg. MIFARE Classic
+            authentication does not survive a switch.
+
+    @param  uid         UID of the target
+    @param  uidLength   UID length
+
+    @returns 1 if the target is listed, 0 otherwise
+*/
+/**************************************************************************/
+bool pn532_selectTarget(pn532_t *obj, const uint8_t *uid, uint8_t uidLength)
+{
+    for (uint8_t i = 0; i < obj->_targetCount; i++)
     {
-        PN532_DEBUG(" %02x", uid[i]);
+        if (obj->_targets[i].uidLen != uidLength || memcmp(obj->_targets[i].uid, uid, uidLength) != 0)
+            continue;
+        if (i != obj->_target)
+        {
+            // keep what pn532_detectTag found for the target we leave
+            obj->_targets[obj->_target].pages = obj->_tagPages;
+            obj->_targets[obj->_target].userend = obj->_tagUserEnd;
+            pn532_activatetarget(obj, i);
+            obj->_selectCount++;
+        }
+        return 1;
     }
-    PN532_DEBUG("\n");
+    return 0;
+}
 
-    return 1;
+/**************************************************************************/
+/*!
+    @brief  Counts target changes: each InListPassiveTarget, InAutoPoll
+            and switch by pn532_selectTarget. Callers that track the
+            state of a tag (Classic authentication) compare it with their
+            own copy.
+*/
+/**************************************************************************/
+uint32_t pn532_selectCount(pn532_t *obj)
+{
+    return obj->_selectCount;
 }
 
 /**************************************************************************/
 /*!
-    @brief  Exchanges an APDU with the currently inlisted peer
+    @brief  Reads one target record of InListPassiveTarget or InAutoPoll
 
-    @param  send            Pointer to data to send
-    @param  sendLength      Length of the data to send
-    @param  response        Pointer to response data
-    @param  responseLength  Pointer to the response data length
+    @param  target      Target data: Tg, SENS_RES (2), SEL_RES,
+                        NFCID length, NFCID [, ATS length, ATS]
+    @param  len         Bytes left in the frame
+    @param  out         Pointer to the target to fill
+
+    @returns Bytes used by the record, 0 if it is malformed or its UID
+             too long
 */
 /**************************************************************************/
-bool pn532_inDataExchange(pn532_t *obj, uint8_t *send, uint8_t sendLength, uint8_t *response, uint8_t *responseLength)
+static uint8_t pn532_parsetarget(const uint8_t *target, uint8_t len, pn532_target_t *out)
 {
-    if (sendLength > PN532_PACKBUFFSIZ - 2)
-    {
-        PN532_DEBUG("APDU length too long for packet buffer\n");
-        return false;
-    }
-    uint8_t i;
+    if (len < 5 || target[4] > sizeof(out->uid) || len < 5 + target[4])
+        return 0;
 
-    pn532_packetbuffer[0] = 0x40; // PN532_COMMAND_INDATAEXCHANGE;
-    pn532_packetbuffer[1] = obj->_inListedTag;
-    for (i = 0; i < sendLength; ++i)
+    memset(out, 0, sizeof(*out));
+    out->tg = target[0];
+    out->atqa = ((uint16_t)target[1] << 8) | target[2];
+    out->sak = target[3];
+    out->uidLen = target[4];
+    memcpy(out->uid, target + 5, out->uidLen);
+    PN532_DEBUG("Tg %d, ATQA: %04x, SAK: %02x\n", out->tg, out->atqa, out->sak);
+
+    uint8_t used = 5 + out->uidLen;
+    // ISO14443-4 targets add their ATS, its length byte counts itself
+    if ((out->sak & 0x20) && used < len)
     {
-        pn532_packetbuffer[i + 2] = send[i];
+        if (target[used] == 0 || target[used] > len - used)
+            return 0;
+        used += target[used];
     }
+    return used;
+}
 
-    if (!pn532_sendCommandCheckAck(obj, pn532_packetbuffer, sendLength + 2, 1000))
+/**************************************************************************/
+/*!
+    @brief  Replaces the listed targets and activates the first one for
+            the following InDataExchange / InRelease
+*/
+/**************************************************************************/
+static void pn532_storetargets(pn532_t *obj, pn532_target_t *list, uint8_t count)
+{
+    if (obj->_targetCount != 0)
     {
-        PN532_DEBUG("Could not send APDU\n");
-        return false;
+        obj->_targets[obj->_target].pages = obj->_tagPages;
+        obj->_targets[obj->_target].userend = obj->_tagUserEnd;
     }
 
-    if (!pn532_waitready(obj, 1000))
+    // the layout found by pn532_detectTag stays valid while the same tag is reselected
+    for (uint8_t i = 0; i < count; i++)
     {
-        PN532_DEBUG("Response never received for APDU...\n");
+        for (uint8_t j = 0; j < obj->_targetCount; j++)
+        {
+            if (obj->_targets[j].uidLen == list[i].uidLen && memcmp(obj->_targets[j].uid, list[i].uid, list[i].uidLen) == 0)
+            {
+                list[i].pages = obj->_targets[j].pages;
+                list[i].userend = obj->_targets[j].userend;
+            }
+        }
+    }
+
+    memcpy(obj->_targets, list, count * sizeof(pn532_target_t));
+    obj->_targetCount = count;
+    obj->_selectCount++;
+    pn532_activatetarget(obj, 0);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Copies a listed target into the active target fields
+*/
+/**************************************************************************/
+static void pn532_activatetarget(pn532_t *obj, uint8_t index)
+{
+    const pn532_target_t *target = &obj->_targets[index];
+
+    obj->_target = index;
+    obj->_inListedTag = target->tg;
+    obj->_atqa = target->atqa;
+    obj->_sak = target->sak;
+    memcpy(obj->_uid, target->uid, target->uidLen);
+    obj->_uidLen = target->uidLen;
+    obj->_tagPages = target->pages;
+    obj->_tagUserEnd = target->userend;
+
+    PN532_DEBUG("UID:");
+    for (int i = 0; i < obj->_uidLen; i++)
+    {
+        PN532_DEBUG(" %02x", obj->_uid[i]);
+    }
+    PN532_DEBUG("\n");
+}
+
+/**************************************************************************/
+/*!
+    Lets the PN532 poll for an ISO14443A target on its own (InAutoPoll).
+    The host only waits for the answer, with the IRQ line or HSU it
+    sleeps without any bus traffic until a target shows up.
+
+    @param  pollNr      Number of polling rounds, 0xFF polls endlessly
+    @param  period      Time between rounds in units of 150 ms (1..15)
+    @param  uid         Pointer to the array that receives the UID
+    @param  uidLength   Pointer to the variable that receives the UID length
+    @param  timeout     Time to wait in ms, 0 waits forever. On timeout the
+                        polling is aborted with an ACK frame.
+
+    @returns 1 if a target was found and selected, 0 otherwise
+*/
+/**************************************************************************/
+bool pn532_inAutoPoll(pn532_t *obj, uint8_t pollNr, uint8_t period, uint8_t *uid, uint8_t *uidLength, uint16_t timeout)
+{
+    obj->_packetbuffer[0] = PN532_COMMAND_INAUTOPOLL;
+    obj->_packetbuffer[1] = pollNr;
+    obj->_packetbuffer[2] = period;
+    obj->_packetbuffer[3] = PN532_AUTOPOLL_GENERIC106A;
+
+    if (!pn532_sendCommandCheckAck(obj, obj->_packetbuffer, 4, timeout))
+    {
+        // nothing came in time, stop the polling so the next command is accepted
+        pn532_writeack(obj);
+        return 0;
+    }
+
+    if (pn532_readframe(obj, obj->_packetbuffer, sizeof(obj->_packetbuffer)) != PN532_FRAME_DATA)
+        return 0;
+
+    /* D5 61 NbTg Type1 Len1 TargetData1 ...
+       TargetData of a 106 kbps type A target: Tg, SENS_RES, SEL_RES,
+       NFCID length, NFCID (as in InListPassiveTarget) */
+    if (obj->_packetbuffer[6] != PN532_COMMAND_INAUTOPOLL + 1 || obj->_packetbuffer[7] == 0)
+        return 0;
+
+    PN532_DEBUG("Autopoll found type %02x\n", obj->_packetbuffer[8]);
+    pn532_target_t target;
+    if (pn532_parsetarget(obj->_packetbuffer + 10, obj->_packetbuffer[9], &target) == 0)
+        return 0;
+
+    pn532_storetargets(obj, &target, 1);
+    *uidLength = obj->_uidLen;
+    memcpy(uid, obj->_uid, obj->_uidLen);
+    return 1;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Exchanges an APDU with the currently inlisted peer
+
+    @param  send            Pointer to data to send
+    @param  sendLength      Length of the data to send
+    @param  response        Pointer to response data
+    @param  responseLength  Pointer to the response data length
+*/
+/**************************************************************************/
+bool pn532_inDataExchange(pn532_t *obj, uint8_t *send, uint8_t sendLength, uint8_t *response, uint8_t *responseLength)
+{
+    if (sendLength > PN532_PACKBUFFSIZ - 2)
+    {
+        PN532_DEBUG("APDU length too long for packet buffer\n");
         return false;
     }
+    uint8_t i;
 
-    pn532_readdata(obj, pn532_packetbuffer, sizeof(pn532_packetbuffer));
+    obj->_packetbuffer[0] = 0x40; // PN532_COMMAND_INDATAEXCHANGE;
+    obj->_packetbuffer[1] = obj->_inListedTag;
+    for (i = 0; i < sendLength; ++i)
+    {
+        obj->_packetbuffer[i + 2] = send[i];
+    }
 
-    if (pn532_packetbuffer[0] == 0 && pn532_packetbuffer[1] == 0 && pn532_packetbuffer[2] == 0xff)
+    if (!pn532_sendCommandCheckAck(obj, obj->_packetbuffer, sendLength + 2, 1000))
     {
-        uint8_t length = pn532_packetbuffer[3];
-        if (pn532_packetbuffer[4] != (uint8_t)(~length + 1))
-        {
-            PN532_DEBUG("Length check invalid %02x%02x\n", length, (~length) + 1);
-            return false;
-        }
-        if (pn532_packetbuffer[5] == PN532_PN532TOHOST && pn532_packetbuffer[6] == PN532_RESPONSE_INDATAEXCHANGE)
+        PN532_DEBUG("Could not send APDU\n");
+        return false;
+    }
+
+    if (!pn532_waitready(obj, 1000))
+    {
+        PN532_DEBUG("Response never received for APDU...\n");
+        return false;
+    }
+
+    if (pn532_readframe(obj, obj->_packetbuffer, sizeof(obj->_packetbuffer)) == PN532_FRAME_DATA)
+    {
+        uint8_t length = obj->_packetbuffer[3];
+        if (obj->_packetbuffer[6] == PN532_RESPONSE_INDATAEXCHANGE)
         {
-            if ((pn532_packetbuffer[7] & 0x3f) != 0)
+            if (length < 3 || (obj->_packetbuffer[7] & 0x3f) != 0)
             {
                 PN532_DEBUG("Status code indicates an error\n");
                 return false;
@@ -471,7 +1075,7 @@ bool pn532_inDataExchange(pn532_t *obj, uint8_t *send, uint8_t sendLength, uint8
 
             for (i = 0; i < length; ++i)
             {
-                response[i] = pn532_packetbuffer[8 + i];
+                response[i] = obj->_packetbuffer[8 + i];
             }
             *responseLength = length;
 
@@ -479,17 +1083,63 @@ bool pn532_inDataExchange(pn532_t *obj, uint8_t *send, uint8_t sendLength, uint8
         }
         else
         {
-            PN532_DEBUG("Don't know how to handle this command: %02x\n", pn532_packetbuffer[6]);
+            PN532_DEBUG("Don't know how to handle this command: %02x\n", obj->_packetbuffer[6]);
             return false;
         }
     }
     else
     {
-        PN532_DEBUG("Preamble missing\n");
+        PN532_DEBUG("Invalid response frame\n");
         return false;
     }
 }
 
+/**************************************************************************/
+/*!
+    @brief  Sends InRelease or InDeselect for the inlisted target and
+            checks the status byte of the answer
+*/
+/**************************************************************************/
+static bool pn532_inEndTarget(pn532_t *obj, uint8_t command)
+{
+    obj->_packetbuffer[0] = command;
+    obj->_packetbuffer[1] = obj->_inListedTag;
+
+    if (!pn532_sendCommandCheckAck(obj, obj->_packetbuffer, 2, 1000))
+        return false;
+
+    if (pn532_readframe(obj, obj->_packetbuffer, sizeof(obj->_packetbuffer)) != PN532_FRAME_DATA)
+        return false;
+
+    return obj->_packetbuffer[6] == command + 1 && (obj->_packetbuffer[7] & 0x3F) == 0x00;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Releases the inlisted target (InRelease), the PN532 forgets it
+            and the tag has to be activated again
+
+    @returns 1 if everything executed properly, 0 for an error
+*/
+/**************************************************************************/
+bool pn532_inRelease(pn532_t *obj)
+{
+    return pn532_inEndTarget(obj, PN532_COMMAND_INRELEASE);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Deselects the inlisted target (InDeselect), the PN532 keeps
+            it and reselects it on the next exchange
+
+    @returns 1 if everything executed properly, 0 for an error
+*/
+/**************************************************************************/
+bool pn532_inDeselect(pn532_t *obj)
+{
+    return pn532_inEndTarget(obj, PN532_COMMAND_INDESELECT);
+}
+
 /**************************************************************************/
 /*!
     @brief  'InLists' a passive target. PN532 acting as reader/initiator,
@@ -498,13 +1148,13 @@ bool pn532_inDataExchange(pn532_t *obj, uint8_t *send, uint8_t sendLength, uint8
 /**************************************************************************/
 bool pn532_inListPassiveTarget(pn532_t *obj)
 {
-    pn532_packetbuffer[0] = PN532_COMMAND_INLISTPASSIVETARGET;
-    pn532_packetbuffer[1] = 1;
-    pn532_packetbuffer[2] = 0;
+    obj->_packetbuffer[0] = PN532_COMMAND_INLISTPASSIVETARGET;
+    obj->_packetbuffer[1] = 1;
+    obj->_packetbuffer[2] = 0;
 
     PN532_DEBUG("About to inList passive target\n");
 
-    if (!pn532_sendCommandCheckAck(obj, pn532_packetbuffer, 3, 1000))
+    if (!pn532_sendCommandCheckAck(obj, obj->_packetbuffer, 3, 1000))
     {
         PN532_DEBUG("Could not send inlist message\n");
         return false;
@@ -515,26 +1165,18 @@ bool pn532_inListPassiveTarget(pn532_t *obj)
         return false;
     }
 
-    pn532_readdata(obj, pn532_packetbuffer, sizeof(pn532_packetbuffer));
-
-    if (pn532_packetbuffer[0] == 0 && pn532_packetbuffer[1] == 0 && pn532_packetbuffer[2] == 0xff)
+    if (pn532_readframe(obj, obj->_packetbuffer, sizeof(obj->_packetbuffer)) == PN532_FRAME_DATA)
     {
-        uint8_t length = pn532_packetbuffer[3];
-        if (pn532_packetbuffer[4] != (uint8_t)(~length + 1))
-        {
-            PN532_DEBUG("Length check invalid %02x%02x\n", length, (~length) + 1);
-            return false;
-        }
-        if (pn532_packetbuffer[5] == PN532_PN532TOHOST && pn532_packetbuffer[6] == PN532_RESPONSE_INLISTPASSIVETARGET)
+        if (obj->_packetbuffer[6] == PN532_RESPONSE_INLISTPASSIVETARGET)
         {
-            if (pn532_packetbuffer[7] != 1)
+            if (obj->_packetbuffer[7] != 1)
             {
                 PN532_DEBUG("Unhandled number of targets inlisted\n");
-                PN532_DEBUG("Number of tags inlisted: %d\n", pn532_packetbuffer[7]);
+                PN532_DEBUG("Number of tags inlisted: %d\n", obj->_packetbuffer[7]);
                 return false;
             }
 
-            obj->_inListedTag = pn532_packetbuffer[8];
+            obj->_inListedTag = obj->_packetbuffer[8];
             PN532_DEBUG("Tag number: %d\n", obj->_inListedTag);
 
             return true;
@@ -547,11 +1189,9 @@ bool pn532_inListPassiveTarget(pn532_t *obj)
     }
     else
     {
-        PN532_DEBUG("Preamble missing\n");
+        PN532_DEBUG("Invalid response frame\n");
         return false;
     }
-
-    return true;
 }
 
 /***** Mifare Classic Functions ******/
@@ -627,31 +1267,32 @@ uint8_t pn532_mifareclassic_AuthenticateBlock(pn532_t *obj, uint8_t *uid, uint8_
     MIFARE_DEBUG("\n");
 
     // Prepare the authentication command //
-    pn532_packetbuffer[0] = PN532_COMMAND_INDATAEXCHANGE; /* Data Exchange Header */
-    pn532_packetbuffer[1] = 1;                            /* Max card numbers */
-    pn532_packetbuffer[2] = (keyNumber) ? MIFARE_CMD_AUTH_B : MIFARE_CMD_AUTH_A;
-    pn532_packetbuffer[3] = blockNumber; /* Block Number (1K = 0..63, 4K = 0..255 */
-    memcpy(pn532_packetbuffer + 4, obj->_key, 6);
+    obj->_packetbuffer[0] = PN532_COMMAND_INDATAEXCHANGE; /* Data Exchange Header */
+    obj->_packetbuffer[1] = obj->_inListedTag; /* Card number */
+    obj->_packetbuffer[2] = (keyNumber) ? MIFARE_CMD_AUTH_B : MIFARE_CMD_AUTH_A;
+    obj->_packetbuffer[3] = blockNumber; /* Block Number (1K = 0..63, 4K = 0..255 */
+    memcpy(obj->_packetbuffer + 4, obj->_key, 6);
     for (i = 0; i < obj->_uidLen; i++)
     {
-        pn532_packetbuffer[10 + i] = obj->_uid[i]; /* 4 uint8_t card ID */
+        obj->_packetbuffer[10 + i] = obj->_uid[i]; /* 4 uint8_t card ID */
     }
 
-    if (!pn532_sendCommandCheckAck(obj, pn532_packetbuffer, 10 + obj->_uidLen, 1000))
+    if (!pn532_sendCommandCheckAck(obj, obj->_packetbuffer, 10 + obj->_uidLen, 1000))
         return 0;
 
     // Read the response packet
-    pn532_readdata(obj, pn532_packetbuffer, 12);
+    if (pn532_readframe(obj, obj->_packetbuffer, sizeof(obj->_packetbuffer)) != PN532_FRAME_DATA)
+        return 0;
 
     // check if the response is valid and we are authenticated???
     // for an auth success it should be bytes 5-7: 0xD5 0x41 0x00
     // Mifare auth error is technically uint8_t 7: 0x14 but anything other and 0x00 is not good
-    if (pn532_packetbuffer[7] != 0x00)
+    if (obj->_packetbuffer[7] != 0x00)
     {
         MIFARE_DEBUG("Authentification failed\n");
         for (int i = 0; i < 12; i++)
     {
-        MIFARE_DEBUG(" %02x", pn532_packetbuffer[i]);
+        MIFARE_DEBUG(" %02x", obj->_packetbuffer[i]);
     }
     MIFARE_DEBUG("\n");
         return 0;
@@ -678,28 +1319,29 @@ uint8_t pn532_mifareclassic_ReadDataBlock(pn532_t *obj, uint8_t blockNumber, uin
     MIFARE_DEBUG("Trying to read 16 bytes from block %d\n", blockNumber);
     
     /* Prepare the command */
-    pn532_packetbuffer[0] = PN532_COMMAND_INDATAEXCHANGE;
-    pn532_packetbuffer[1] = 1;               /* Card number */
-    pn532_packetbuffer[2] = MIFARE_CMD_READ; /* Mifare Read command = 0x30 */
-    pn532_packetbuffer[3] = blockNumber;     /* Block Number (0..63 for 1K, 0..255 for 4K) */
+    obj->_packetbuffer[0] = PN532_COMMAND_INDATAEXCHANGE;
+    obj->_packetbuffer[1] = obj->_inListedTag; /* Card number */
+    obj->_packetbuffer[2] = MIFARE_CMD_READ; /* Mifare Read command = 0x30 */
+    obj->_packetbuffer[3] = blockNumber;     /* Block Number (0..63 for 1K, 0..255 for 4K) */
 
     /* Send the command */
-    if (!pn532_sendCommandCheckAck(obj, pn532_packetbuffer, 4, 1000))
+    if (!pn532_sendCommandCheckAck(obj, obj->_packetbuffer, 4, 1000))
     {
         MIFARE_DEBUG("Failed to receive ACK for read command\n");
         return 0;
     }
 
     /* Read the response packet */
-    pn532_readdata(obj, pn532_packetbuffer, 26);
+    if (pn532_readframe(obj, obj->_packetbuffer, sizeof(obj->_packetbuffer)) != PN532_FRAME_DATA)
+        return 0;
 
     /* If uint8_t 8 isn't 0x00 we probably have an error */
-    if (pn532_packetbuffer[7] != 0x00)
+    if (obj->_packetbuffer[7] != 0x00 || obj->_packetbuffer[3] < 3 + 16)
     {
         MIFARE_DEBUG("Unexpected response:");
         for (int i = 0; i < 26; i++)
         {
-            MIFARE_DEBUG(" %02x", pn532_packetbuffer[i]);
+            MIFARE_DEBUG(" %02x", obj->_packetbuffer[i]);
         }
         MIFARE_DEBUG("\n");
         return 0;
@@ -707,7 +1349,7 @@ uint8_t pn532_mifareclassic_ReadDataBlock(pn532_t *obj, uint8_t blockNumber, uin
 
     /* Copy the 16 data bytes to the output buffer        */
     /* Block content starts at uint8_t 9 of a valid response */
-    memcpy(data, pn532_packetbuffer + 8, 16);
+    memcpy(data, obj->_packetbuffer + 8, 16);
 
 /* Display data for debug if requested */
     MIFARE_DEBUG("Block %d\n", blockNumber);
@@ -729,32 +1371,67 @@ uint8_t pn532_mifareclassic_ReadDataBlock(pn532_t *obj, uint8_t blockNumber, uin
                           1KB cards, and 0..255 for 4KB cards).
     @param  data          The uint8_t array that contains the data to write.
 
-    @returns 1 if everything executed properly, 0 for an error
+    @returns 1 if the tag acknowledged the write, 0 for an error
 */
 /**************************************************************************/
 uint8_t pn532_mifareclassic_WriteDataBlock(pn532_t *obj, uint8_t blockNumber, uint8_t *data)
+{
+    return pn532_mifareclassic_WriteDataBlockStatus(obj, blockNumber, data) == PN532_WRITE_ACK;
+}
+
+/**************************************************************************/
+/*!
+    Writes a 16-uint8_t data block and reports how the tag answered. The
+    sector must be authenticated.
+
+    @param  blockNumber   The block number to write.  (0..63 for 1KB
+                          cards, and 0..255 for 4KB cards).
+    @param  data          The uint8_t array that contains the data to write.
+
+    @returns PN532_WRITE_ACK if the tag acknowledged the write,
+             PN532_WRITE_NAK if it refused it (not authenticated, access
+             bits), PN532_WRITE_TIMEOUT if the PN532 or the tag did not
+             answer
+*/
+/**************************************************************************/
+pn532_write_status_t pn532_mifareclassic_WriteDataBlockStatus(pn532_t *obj, uint8_t blockNumber, uint8_t *data)
 {
     MIFARE_DEBUG("Trying to write 16 bytes to block %d\n", blockNumber);
 
     /* Prepare the first command */
-    pn532_packetbuffer[0] = PN532_COMMAND_INDATAEXCHANGE;
-    pn532_packetbuffer[1] = 1;                /* Card number */
-    pn532_packetbuffer[2] = MIFARE_CMD_WRITE; /* Mifare Write command = 0xA0 */
-    pn532_packetbuffer[3] = blockNumber;      /* Block Number (0..63 for 1K, 0..255 for 4K) */
-    memcpy(pn532_packetbuffer + 4, data, 16); /* Data Payload */
+    obj->_packetbuffer[0] = PN532_COMMAND_INDATAEXCHANGE;
+    obj->_packetbuffer[1] = obj->_inListedTag; /* Card number */
+    obj->_packetbuffer[2] = MIFARE_CMD_WRITE; /* Mifare Write command = 0xA0 */
+    obj->_packetbuffer[3] = blockNumber;      /* Block Number (0..63 for 1K, 0..255 for 4K) */
+    memcpy(obj->_packetbuffer + 4, data, 16); /* Data Payload */
 
     /* Send the command */
-    if (!pn532_sendCommandCheckAck(obj, pn532_packetbuffer, 20, 1000))
+    if (!pn532_sendCommandCheckAck(obj, obj->_packetbuffer, 20, 1000))
     {
         MIFARE_DEBUG("Failed to receive ACK for write command\n");
-        return 0;
+        return PN532_WRITE_TIMEOUT;
     }
-    PN532_DELAY(10);
 
-    /* Read the response packet */
-    pn532_readdata(obj, pn532_packetbuffer, 26);
+    /* Read the response packet: D5 41 status */
+    if (pn532_readframe(obj, obj->_packetbuffer, sizeof(obj->_packetbuffer)) != PN532_FRAME_DATA)
+        return PN532_WRITE_TIMEOUT;
 
-    return 1;
+    if (obj->_packetbuffer[6] != PN532_COMMAND_INDATAEXCHANGE + 1 || obj->_packetbuffer[3] < 3)
+        return PN532_WRITE_ERROR;
+
+    uint8_t status = obj->_packetbuffer[7] & 0x3F;
+    if (status == 0x01)
+    {
+        MIFARE_DEBUG("Tag did not answer the write\n");
+        return PN532_WRITE_TIMEOUT;
+    }
+    if (status != 0x00)
+    {
+        MIFARE_DEBUG("Write refused, status %02x\n", status);
+        return PN532_WRITE_NAK;
+    }
+
+    return PN532_WRITE_ACK;
 }
 
 /**************************************************************************/
@@ -882,12 +1559,13 @@ uint8_t pn532_mifareclassic_WriteNDEFURI(pn532_t *obj, uint8_t sectorNumber, uin
 
     @param  page        The page number (0..63 in most cases)
     @param  buffer      Pointer to the uint8_t array that will hold the
-                        retrieved data (if any)
+                        retrieved data (if any), 16 bytes: the requested
+                        page and the three following it
 */
 /**************************************************************************/
 uint8_t pn532_mifareultralight_ReadPage(pn532_t *obj, uint8_t page, uint8_t *buffer)
 {
-    if (page >= 64)
+    if (page >= (obj->_tagPages ? obj->_tagPages : 64))
     {
         MIFARE_DEBUG("Page value out of range\n");
         return 0;
@@ -896,43 +1574,44 @@ uint8_t pn532_mifareultralight_ReadPage(pn532_t *obj, uint8_t page, uint8_t *buf
     MIFARE_DEBUG("Reading page %d\n", page);
 
     /* Prepare the command */
-    pn532_packetbuffer[0] = PN532_COMMAND_INDATAEXCHANGE;
-    pn532_packetbuffer[1] = 1;               /* Card number */
-    pn532_packetbuffer[2] = MIFARE_CMD_READ; /* Mifare Read command = 0x30 */
-    pn532_packetbuffer[3] = page;            /* Page Number (0..63 in most cases) */
+    obj->_packetbuffer[0] = PN532_COMMAND_INDATAEXCHANGE;
+    obj->_packetbuffer[1] = obj->_inListedTag; /* Card number */
+    obj->_packetbuffer[2] = MIFARE_CMD_READ; /* Mifare Read command = 0x30 */
+    obj->_packetbuffer[3] = page;            /* Page Number (0..63 in most cases) */
 
     /* Send the command */
-    if (!pn532_sendCommandCheckAck(obj, pn532_packetbuffer, 4, 1000))
+    if (!pn532_sendCommandCheckAck(obj, obj->_packetbuffer, 4, 1000))
     {
         MIFARE_DEBUG("Failed to receive ACK for write command\n");
         return 0;
     }
 
     /* Read the response packet */
-    pn532_readdata(obj, pn532_packetbuffer, 26);
+    if (pn532_readframe(obj, obj->_packetbuffer, sizeof(obj->_packetbuffer)) != PN532_FRAME_DATA)
+        return 0;
     MIFARE_DEBUG("Received:");
     for (int i = 0; i < 26; i++)
     {
-        MIFARE_DEBUG(" %02x", pn532_packetbuffer[i]);
+        MIFARE_DEBUG(" %02x", obj->_packetbuffer[i]);
     }
     MIFARE_DEBUG("\n");
 
     /* If uint8_t 8 isn't 0x00 we probably have an error */
-    if (pn532_packetbuffer[6] == 0x00)
+    if (obj->_packetbuffer[7] == 0x00 && obj->_packetbuffer[3] >= 3 + 16)
     {
-        /* Copy the 4 data bytes to the output buffer         */
+        /* Copy the data bytes to the output buffer           */
         /* Block content starts at uint8_t 9 of a valid response */
         /* Note that the command actually reads 16 uint8_t or 4  */
-        /* pages at a time ... we simply discard the last 12  */
-        /* bytes                                              */
-        memcpy(buffer, pn532_packetbuffer + 7, 16);
+        /* pages at a time ... all 16 are handed back, so the */
+        /* buffer must hold 16 bytes                          */
+        memcpy(buffer, obj->_packetbuffer + 8, 16);
     }
     else
     {
         MIFARE_DEBUG("Unexpected response reading block:");
         for (int i = 0; i < 26; i++)
         {
-            MIFARE_DEBUG(" %02x", pn532_packetbuffer[i]);
+            MIFARE_DEBUG(" %02x", obj->_packetbuffer[i]);
         }
         MIFARE_DEBUG("\n");
         return 0;
@@ -965,36 +1644,78 @@ uint8_t pn532_mifareultralight_ReadPage(pn532_t *obj, uint8_t page, uint8_t *buf
 uint8_t pn532_mifareultralight_WritePage(pn532_t *obj, uint8_t page, uint8_t *data)
 {
 
-    if (page >= 64)
+    if (page >= (obj->_tagPages ? obj->_tagPages : 64))
     {
         MIFARE_DEBUG("Page value out of range\n");
         // Return Failed Signal
         return 0;
     }
 
+    return pn532_mifareultralight_WritePageStatus(obj, page, data) == PN532_WRITE_ACK;
+}
+
+/**************************************************************************/
+/*!
+    Writes a 4-uint8_t page (Ultralight / NTAG2xx WRITE, 0xA2) and reports
+    how the tag answered. The InDataExchange status byte and the tag's
+    4-bit ACK/NAK are checked, there is no fixed delay: the answer is read
+    as soon as the PN532 signals it is ready. No page range check is done
+    here, the tag NAKs pages it does not have.
+
+    @param  page          The page number to write
+    @param  data          The uint8_t array that contains the data to write.
+                          Should be exactly 4 bytes long.
+
+    @returns PN532_WRITE_ACK if the tag confirmed the write,
+             PN532_WRITE_NAK if it refused it,
+             PN532_WRITE_TIMEOUT if the PN532 or the tag did not answer,
+             PN532_WRITE_ERROR for an unexpected answer
+*/
+/**************************************************************************/
+pn532_write_status_t pn532_mifareultralight_WritePageStatus(pn532_t *obj, uint8_t page, uint8_t *data)
+{
     MIFARE_DEBUG("Trying to write 4 uint8_t page %d\n", page);
 
     /* Prepare the first command */
-    pn532_packetbuffer[0] = PN532_COMMAND_INDATAEXCHANGE;
-    pn532_packetbuffer[1] = 1;                           /* Card number */
-    pn532_packetbuffer[2] = MIFARE_ULTRALIGHT_CMD_WRITE; /* Mifare Ultralight Write command = 0xA2 */
-    pn532_packetbuffer[3] = page;                        /* Page Number (0..63 for most cases) */
-    memcpy(pn532_packetbuffer + 4, data, 4);             /* Data Payload */
+    obj->_packetbuffer[0] = PN532_COMMAND_INDATAEXCHANGE;
+    obj->_packetbuffer[1] = obj->_inListedTag; /* Card number */
+    obj->_packetbuffer[2] = MIFARE_ULTRALIGHT_CMD_WRITE; /* Mifare Ultralight Write command = 0xA2 */
+    obj->_packetbuffer[3] = page;                        /* Page Number (0..63 for most cases) */
+    memcpy(obj->_packetbuffer + 4, data, 4);             /* Data Payload */
 
     /* Send the command */
-    if (!pn532_sendCommandCheckAck(obj, pn532_packetbuffer, 8, 1000))
+    if (!pn532_sendCommandCheckAck(obj, obj->_packetbuffer, 8, 1000))
     {
         MIFARE_DEBUG("Failed to receive ACK for write command\n");
-        // Return Failed Signal
-        return 0;
+        return PN532_WRITE_TIMEOUT;
     }
-    PN532_DELAY(10);
 
-    /* Read the response packet */
-    pn532_readdata(obj, pn532_packetbuffer, 26);
+    /* Read the response packet: D5 41 status [tag answer] */
+    if (pn532_readframe(obj, obj->_packetbuffer, sizeof(obj->_packetbuffer)) != PN532_FRAME_DATA)
+        return PN532_WRITE_TIMEOUT;
 
-    // Return OK Signal
-    return 1;
+    if (obj->_packetbuffer[6] != PN532_COMMAND_INDATAEXCHANGE + 1 || obj->_packetbuffer[3] < 3)
+        return PN532_WRITE_ERROR;
+
+    uint8_t status = obj->_packetbuffer[7] & 0x3F;
+    if (status == 0x01)
+    {
+        MIFARE_DEBUG("Tag did not answer the write\n");
+        return PN532_WRITE_TIMEOUT;
+    }
+    if (status != 0x00)
+    {
+        MIFARE_DEBUG("Write refused, status %02x\n", status);
+        return PN532_WRITE_NAK;
+    }
+    /* Some firmware hands the 4-bit answer through, ACK is 0xA */
+    if (obj->_packetbuffer[3] > 3 && (obj->_packetbuffer[8] & 0x0F) != 0x0A)
+    {
+        MIFARE_DEBUG("Tag NAK %x\n", obj->_packetbuffer[8] & 0x0F);
+        return PN532_WRITE_NAK;
+    }
+
+    return PN532_WRITE_ACK;
 }
 
 /***** NTAG2xx Functions ******/
@@ -1017,7 +1738,7 @@ uint8_t pn532_ntag2xx_ReadPage(pn532_t *obj, uint8_t page, uint8_t *buffer)
     // NTAG 215       135     4             129
     // NTAG 216       231     4             225
 
-    if (page >= 231)
+    if (page >= (obj->_tagPages ? obj->_tagPages : 231))
     {
         MIFARE_DEBUG("Page value out of range\n");
         return 0;
@@ -1026,43 +1747,44 @@ uint8_t pn532_ntag2xx_ReadPage(pn532_t *obj, uint8_t page, uint8_t *buffer)
     MIFARE_DEBUG("Reading page %d\n", page);
 
     /* Prepare the command */
-    pn532_packetbuffer[0] = PN532_COMMAND_INDATAEXCHANGE;
-    pn532_packetbuffer[1] = 1;               /* Card number */
-    pn532_packetbuffer[2] = MIFARE_CMD_READ; /* Mifare Read command = 0x30 */
-    pn532_packetbuffer[3] = page;            /* Page Number (0..63 in most cases) */
+    obj->_packetbuffer[0] = PN532_COMMAND_INDATAEXCHANGE;
+    obj->_packetbuffer[1] = obj->_inListedTag; /* Card number */
+    obj->_packetbuffer[2] = MIFARE_CMD_READ; /* Mifare Read command = 0x30 */
+    obj->_packetbuffer[3] = page;            /* Page Number (0..63 in most cases) */
 
     /* Send the command */
-    if (!pn532_sendCommandCheckAck(obj, pn532_packetbuffer, 4, 1000))
+    if (!pn532_sendCommandCheckAck(obj, obj->_packetbuffer, 4, 1000))
     {
         MIFARE_DEBUG("Failed to receive ACK for write command\n");
         return 0;
     }
 
     /* Read the response packet */
-    pn532_readdata(obj, pn532_packetbuffer, 26);
+    if (pn532_readframe(obj, obj->_packetbuffer, sizeof(obj->_packetbuffer)) != PN532_FRAME_DATA)
+        return 0;
     MIFARE_DEBUG("Received:");
     for (int i = 0; i < 26; i++)
     {
-        MIFARE_DEBUG(" %02x", pn532_packetbuffer[i]);
+        MIFARE_DEBUG(" %02x", obj->_packetbuffer[i]);
     }
     MIFARE_DEBUG("\n");
 
     /* If uint8_t 8 isn't 0x00 we probably have an error */
-    if (pn532_packetbuffer[7] == 0x00)
+    if (obj->_packetbuffer[7] == 0x00 && obj->_packetbuffer[3] >= 3 + 4)
     {
         /* Copy the 4 data bytes to the output buffer         */
         /* Block content starts at uint8_t 9 of a valid response */
         /* Note that the command actually reads 16 uint8_t or 4  */
         /* pages at a time ... we simply discard the last 12  */
         /* bytes                                              */
-        memcpy(buffer, pn532_packetbuffer + 8, 4);
+        memcpy(buffer, obj->_packetbuffer + 8, 4);
     }
     else
     {
         MIFARE_DEBUG("Unexpected response reading block:");
         for (int i = 0; i < 26; i++)
         {
-            MIFARE_DEBUG(" %02x", pn532_packetbuffer[i]);
+            MIFARE_DEBUG(" %02x", obj->_packetbuffer[i]);
         }
         MIFARE_DEBUG("\n");
         return 0;
@@ -1082,93 +1804,292 @@ uint8_t pn532_ntag2xx_ReadPage(pn532_t *obj, uint8_t page, uint8_t *buffer)
 
 /**************************************************************************/
 /*!
-    Tries to write an entire 4-uint8_t page at the specified block
-    address.
+    Sends GET_VERSION (0x60) raw through InCommunicateThru.
 
-    @param  page          The page number to write.  (0..63 for most cases)
-    @param  data          The uint8_t array that contains the data to write.
-                          Should be exactly 4 bytes long.
+    @param  version   Pointer to 8 bytes for the answer (vendor, type,
+                      subtype, major, minor, storage size, protocol)
 
-    @returns 1 if everything executed properly, 0 for an error
+    @returns true if the tag answered. Tags without GET_VERSION answer
+             with a NAK and go back to IDLE, they have to be selected
+             again before the next command.
 */
 /**************************************************************************/
-uint8_t pn532_ntag2xx_WritePage(pn532_t *obj, uint8_t page, uint8_t *data)
+bool pn532_ntag2xx_GetVersion(pn532_t *obj, uint8_t *version)
 {
-    // TAG Type       PAGES   USER START    USER STOP
-    // --------       -----   ----------    ---------
-    // NTAG 203       42      4             39
-    // NTAG 213       45      4             39
-    // NTAG 215       135     4             129
-    // NTAG 216       231     4             225
+    obj->_packetbuffer[0] = PN532_COMMAND_INCOMMUNICATETHRU;
+    obj->_packetbuffer[1] = NTAG_CMD_GET_VERSION;
 
-    if ((page < 4) || (page > 225))
+    if (!pn532_sendCommandCheckAck(obj, obj->_packetbuffer, 2, 1000))
     {
-        MIFARE_DEBUG("Page value out of range\n");
-        // Return Failed Signal
-        return 0;
+        MIFARE_DEBUG("Failed to receive ACK for get version command\n");
+        return false;
     }
 
-    MIFARE_DEBUG("Trying to write 4 uint8_t page %d\n", page);
+    /* Read the response packet: D5 43 status version[8] */
+    if (pn532_readframe(obj, obj->_packetbuffer, sizeof(obj->_packetbuffer)) != PN532_FRAME_DATA)
+        return false;
 
-    /* Prepare the first command */
-    pn532_packetbuffer[0] = PN532_COMMAND_INDATAEXCHANGE;
-    pn532_packetbuffer[1] = 1;                           /* Card number */
-    pn532_packetbuffer[2] = MIFARE_ULTRALIGHT_CMD_WRITE; /* Mifare Ultralight Write command = 0xA2 */
-    pn532_packetbuffer[3] = page;                        /* Page Number (0..63 for most cases) */
-    memcpy(pn532_packetbuffer + 4, data, 4);             /* Data Payload */
+    if (obj->_packetbuffer[6] != PN532_COMMAND_INCOMMUNICATETHRU + 1 || (obj->_packetbuffer[7] & 0x3F) != 0x00 || obj->_packetbuffer[3] < 3 + 8)
+    {
+        MIFARE_DEBUG("No answer to get version, status %02x\n", obj->_packetbuffer[7]);
+        return false;
+    }
 
-    /* Send the command */
-    if (!pn532_sendCommandCheckAck(obj, pn532_packetbuffer, 8, 1000))
+    memcpy(version, obj->_packetbuffer + 8, 8);
+    return true;
+}
+
+/**************************************************************************/
+/*!
+    Works out the type and memory layout of the active tag selected by
+    pn532_readPassiveTargetID / pn532_listPassiveTargets. MIFARE
+    Classic is told apart by SAK, Type 2 tags by GET_VERSION and, for
+    tags without it, by the size in the capability container (page 3).
+    The page limits of the Ultralight / NTAG read and write functions
+    follow the result.
+
+    A tag that refuses GET_VERSION is selected again, so the tag is
+    selected on return whenever this returns true.
+
+    @param  info      Pointer to the capability record to fill
+
+    @returns true if the tag was recognised
+*/
+/**************************************************************************/
+bool pn532_detectTag(pn532_t *obj, pn532_taginfo_t *info)
+{
+    uint8_t version[8];
+
+    memset(info, 0, sizeof(*info));
+    info->atqa = obj->_atqa;
+    info->sak = obj->_sak;
+
+    if (obj->_sak & 0x08)
     {
-        MIFARE_DEBUG("Failed to receive ACK for write command\n");
+        // MIFARE Classic: SAK 0x09 Mini, 0x08 1K, 0x18 4K
+        info->type = (obj->_sak == 0x09) ? PN532_TAG_CLASSIC_MINI : (obj->_sak & 0x10) ? PN532_TAG_CLASSIC_4K : PN532_TAG_CLASSIC_1K;
+        info->pages = (info->type == PN532_TAG_CLASSIC_MINI) ? 20 : (info->type == PN532_TAG_CLASSIC_4K) ? 256 : 64;
+        info->userstart = 1;
+        info->userend = info->pages - 1;
+        return true;
+    }
+    if (obj->_sak != 0x00)
+    {
+        MIFARE_DEBUG("Unknown tag, SAK %02x\n", obj->_sak);
+        return false;
+    }
 
-        // Return Failed Signal
-        return 0;
+    if (pn532_ntag2xx_GetVersion(obj, version))
+    {
+        // NTAG21x (type 0x04) and Ultralight EV1 (type 0x03)
+        info->userstart = 4;
+        info->fastread = true;
+        info->counter = true;
+        switch (version[6])
+        {
+        case 0x0B: // MF0UL11
+            info->pages = 20;
+            info->userend = 15;
+            break;
+        case 0x0E: // MF0UL21
+            info->pages = 41;
+            info->userend = 35;
+            break;
+        case 0x0F: // NTAG213
+            info->pages = 45;
+            info->userend = 39;
+            break;
+        case 0x11: // NTAG215
+            info->pages = 135;
+            info->userend = 129;
+            break;
+        case 0x13: // NTAG216
+            info->pages = 231;
+            info->userend = 225;
+            break;
+        default:
+            MIFARE_DEBUG("Unknown storage size %02x\n", version[6]);
+            return false;
+        }
+        info->type = (version[2] == 0x04) ? PN532_TAG_NTAG21X : PN532_TAG_ULTRALIGHT_EV1;
     }
-    PN532_DELAY(10);
+    else
+    {
+        // the NAK put the tag in IDLE, select it again
+        if (!pn532_reselect(obj))
+            return false;
 
-    /* Read the response packet */
-    pn532_readdata(obj, pn532_packetbuffer, 26);
+        uint8_t cc[16];
+        if (!pn532_mifareultralight_ReadPage(obj, 0, cc))
+            return false;
 
-    // Return OK Signal
-    return 1;
+        // CC byte 2 = data area size / 8: 0x06 Ultralight, 0x12 Ultralight C / NTAG203
+        info->type = PN532_TAG_ULTRALIGHT;
+        info->userstart = 4;
+        info->userend = (cc[14] > 0x06) ? 4 + cc[14] * 2 - 1 : 15;
+        // lock pages after the data: 2 on NTAG203, Ultralight C has more but they are not needed here
+        info->pages = (cc[14] > 0x06) ? info->userend + 3 : 16;
+    }
+    obj->_tagPages = info->pages;
+    obj->_tagUserEnd = info->userend;
+    obj->_targets[obj->_target].pages = info->pages;
+    obj->_targets[obj->_target].userend = info->userend;
+
+    MIFARE_DEBUG("Tag type %d, pages %d, user pages %d..%d\n", info->type, info->pages, info->userstart, info->userend);
+    return true;
 }
 
 /**************************************************************************/
 /*!
-    Writes an NDEF URI Record starting at the specified page (4..nn)
-
-    Note that this function assumes that the NTAG2xx card is
-    already formatted to work as an "NFC Forum Tag".
+    @brief  Lists the targets again after the active one dropped to IDLE
+            and activates the same tag; the other listed tag stays
+            available for pn532_selectTarget
+*/
+/**************************************************************************/
+static bool pn532_reselect(pn532_t *obj)
+{
+    uint8_t uid[7];
+    uint8_t uidLen = obj->_uidLen;
 
-    @param  uriIdentifier The uri identifier code (0 = none, 0x01 =
-                          "http://www.\n", etc.)
-    @param  url           The uri text to write (null-terminated string).
-    @param  dataLen       The size of the data area for overflow checks.
+    memcpy(uid, obj->_uid, uidLen);
+    if (pn532_listPassiveTargets(obj, PN532_MIFARE_ISO14443A, obj->_targetCount, NULL, 200) == 0)
+        return false;
+    return pn532_selectTarget(obj, uid, uidLen);
+}
 
-    @returns 1 if everything executed properly, 0 for an error
+/**************************************************************************/
+/*!
+    Reads a range of pages from an NTAG21x / Ultralight EV1 tag with
+    FAST_READ (0x3A), sent raw through InCommunicateThru. Each exchange
+    returns up to PN532_FASTREAD_MAXPAGES pages, longer ranges are split
+    into as few exchanges as that allows.
+
+    @param  startpage The first page to read
+    @param  endpage   The last page to read (inclusive)
+    @param  buffer    Pointer to the byte array that will hold the
+                      retrieved data, 4 * (endpage - startpage + 1) bytes
+
+    @returns 1 if everything executed properly, 0 for an error (tags
+             without FAST_READ answer with a NAK)
 */
 /**************************************************************************/
-uint8_t pn532_ntag2xx_WriteNDEFURI(pn532_t *obj, uint8_t uriIdentifier, char *url, uint8_t dataLen)
+uint8_t pn532_ntag2xx_FastRead(pn532_t *obj, uint8_t startpage, uint8_t endpage, uint8_t *buffer)
 {
-    uint8_t pageBuffer[4] = {0, 0, 0, 0};
+    if (endpage < startpage)
+    {
+        MIFARE_DEBUG("Page range is empty\n");
+        return 0;
+    }
 
-    // Remove NDEF record overhead from the URI data (pageHeader below)
-    uint8_t wrapperSize = 12;
+    for (uint16_t page = startpage; page <= endpage;)
+    {
+        uint16_t last = page + PN532_FASTREAD_MAXPAGES - 1;
+        if (last > endpage)
+        {
+            last = endpage;
+        }
+        uint16_t len = (last - page + 1) * 4;
 
-    // Figure out how long the string is
-    uint8_t len = strlen(url);
+        MIFARE_DEBUG("Fast reading pages %d..%d\n", page, last);
 
-    // Make sure the URI payload will fit in dataLen (include 0xFE trailer)
-    if ((len < 1) || (len + 1 > (dataLen - wrapperSize)))
-        return 0;
+        /* Prepare the command */
+        obj->_packetbuffer[0] = PN532_COMMAND_INCOMMUNICATETHRU;
+        obj->_packetbuffer[1] = NTAG_CMD_FAST_READ; /* FAST_READ = 0x3A */
+        obj->_packetbuffer[2] = page;
+        obj->_packetbuffer[3] = last;
 
-    // Setup the record header
-    // See NFCForum-TS-Type-2-Tag_1.1.pdf for details
-    uint8_t pageHeader[12] =
+        /* Send the command */
+        if (!pn532_sendCommandCheckAck(obj, obj->_packetbuffer, 4, 1000))
         {
-            /* NDEF Lock Control TLV (must be first and always present) */
-            0x01, /* Tag Field (0x01 = Lock Control TLV) */
+            MIFARE_DEBUG("Failed to receive ACK for fast read command\n");
+            return 0;
+        }
+
+        /* Read the response packet: D5 43 status data... */
+        if (pn532_readframe(obj, obj->_packetbuffer, sizeof(obj->_packetbuffer)) != PN532_FRAME_DATA)
+            return 0;
+
+        if (obj->_packetbuffer[6] != PN532_COMMAND_INCOMMUNICATETHRU + 1 || (obj->_packetbuffer[7] & 0x3F) != 0x00 || obj->_packetbuffer[3] < 3 + len)
+        {
+            MIFARE_DEBUG("Unexpected response to fast read, status %02x, len %d\n", obj->_packetbuffer[7], obj->_packetbuffer[3]);
+            return 0;
+        }
+
+        memcpy(buffer, obj->_packetbuffer + 8, len);
+        buffer += len;
+        page = last + 1;
+    }
+
+    // Return OK signal
+    return 1;
+}
+
+/**************************************************************************/
+/*!
+    Tries to write an entire 4-uint8_t page at the specified block
+    address.
+
+    @param  page          The page number to write.  (0..63 for most cases)
+    @param  data          The uint8_t array that contains the data to write.
+                          Should be exactly 4 bytes long.
+
+    @returns 1 if everything executed properly, 0 for an error
+*/
+/**************************************************************************/
+uint8_t pn532_ntag2xx_WritePage(pn532_t *obj, uint8_t page, uint8_t *data)
+{
+    // TAG Type       PAGES   USER START    USER STOP
+    // --------       -----   ----------    ---------
+    // NTAG 203       42      4             39
+    // NTAG 213       45      4             39
+    // NTAG 215       135     4             129
+    // NTAG 216       231     4             225
+
+    if ((page < 4) || (page > (obj->_tagUserEnd ? obj->_tagUserEnd : 225)))
+    {
+        MIFARE_DEBUG("Page value out of range\n");
+        // Return Failed Signal
+        return 0;
+    }
+
+    return pn532_mifareultralight_WritePageStatus(obj, page, data) == PN532_WRITE_ACK;
+}
+
+/**************************************************************************/
+/*!
+    Writes an NDEF URI Record starting at the specified page (4..nn)
+
+    Note that this function assumes that the NTAG2xx card is
+    already formatted to work as an "NFC Forum Tag".
+
+    @param  uriIdentifier The uri identifier code (0 = none, 0x01 =
+                          "http://www.\n", etc.)
+    @param  url           The uri text to write (null-terminated string).
+    @param  dataLen       The size of the data area for overflow checks.
+
+    @returns 1 if everything executed properly, 0 for an error
+*/
+/**************************************************************************/
+uint8_t pn532_ntag2xx_WriteNDEFURI(pn532_t *obj, uint8_t uriIdentifier, char *url, uint8_t dataLen)
+{
+    uint8_t pageBuffer[4] = {0, 0, 0, 0};
+
+    // Remove NDEF record overhead from the URI data (pageHeader below)
+    uint8_t wrapperSize = 12;
+
+    // Figure out how long the string is
+    uint8_t len = strlen(url);
+
+    // Make sure the URI payload will fit in dataLen (include 0xFE trailer)
+    if ((len < 1) || (len + 1 > (dataLen - wrapperSize)))
+        return 0;
+
+    // Setup the record header
+    // See NFCForum-TS-Type-2-Tag_1.1.pdf for details
+    uint8_t pageHeader[12] =
+        {
+            /* NDEF Lock Control TLV (must be first and always present) */
+            0x01, /* Tag Field (0x01 = Lock Control TLV) */
             0x03, /* Payload Length (always 3) */
             0xA0, /* The position inside the tag of the lock bytes (upper 4 = page address, lower 4 = uint8_t offset) */
             0x10, /* Size in bits of the lock area */
@@ -1238,7 +2159,7 @@ uint8_t pn532_ntag2xx_WriteNDEFURI(pn532_t *obj, uint8_t uriIdentifier, char *ur
     return 1;
 }
 
-/************** high level communication functions (handles both I2C and SPI) */
+/************** high level communication functions (any transport) */
 
 /**************************************************************************/
 /*!
@@ -1247,11 +2168,9 @@ uint8_t pn532_ntag2xx_WriteNDEFURI(pn532_t *obj, uint8_t uriIdentifier, char *ur
 /**************************************************************************/
 bool pn532_readack(pn532_t *obj)
 {
-    uint8_t ackbuff[6];
+    uint8_t ackbuff[PN532_FRAME_HEADER + 2];
 
-    pn532_readdata(obj, ackbuff, 6);
-
-    return (0 == strncmp((char *)ackbuff, (char *)pn532ack, 6));
+    return (pn532_readframe(obj, ackbuff, sizeof(ackbuff)) == PN532_FRAME_ACK);
 }
 
 /**************************************************************************/
@@ -1261,16 +2180,7 @@ bool pn532_readack(pn532_t *obj)
 /**************************************************************************/
 bool pn532_isready(pn532_t *obj)
 {
-    gpio_set_level(obj->_ss, 0);
-    PN532_DELAY(10);
-    pn532_spi_write(obj, PN532_SPI_STATREAD);
-    // read uint8_t
-    uint8_t x = pn532_spi_read(obj);
-
-    gpio_set_level(obj->_ss, 1);
-
-    // Check if status is ready.
-    return x == PN532_SPI_READY;
+    return obj->_transport->isready(obj);
 }
 
 /**************************************************************************/
@@ -1282,6 +2192,15 @@ bool pn532_isready(pn532_t *obj)
 /**************************************************************************/
 bool pn532_waitready(pn532_t *obj, uint16_t timeout)
 {
+    if (obj->_transport->waitready)
+    {
+        return obj->_transport->waitready(obj, timeout);
+    }
+    if (obj->_irq >= 0)
+    {
+        return pn532_waitirq(obj, timeout);
+    }
+
     uint16_t timer = 0;
     while (!pn532_isready(obj))
     {
@@ -1301,31 +2220,171 @@ bool pn532_waitready(pn532_t *obj, uint16_t timeout)
 
 /**************************************************************************/
 /*!
-    @brief  Reads n bytes of data from the PN532 via SPI or I2C.
+    @brief  Blocks until the PN532 pulls IRQ low (response ready), without
+            any bus traffic while waiting.
 
-    @param  buff      Pointer to the buffer where data will be written
-    @param  n         Number of bytes to be read
+    @param  timeout   Timeout in ms before giving up, 0 waits forever
 */
 /**************************************************************************/
-void pn532_readdata(pn532_t *obj, uint8_t *buff, uint8_t n)
+bool pn532_waitirq(pn532_t *obj, uint16_t timeout)
 {
-    gpio_set_level(obj->_ss, 0);
-    PN532_DELAY(10);
-    pn532_spi_write(obj, PN532_SPI_DATAREAD);
+    return pn532_waitirqslot(obj, &obj->_irqtask, timeout);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Blocks until IRQ is low, notified through the given slot of the
+            ISR
+
+    @param  slot      Task handle the ISR notifies (_irqtask or _waketask)
+    @param  timeout   Timeout in ms before giving up, 0 waits forever
+*/
+/**************************************************************************/
+bool pn532_waitirqslot(pn532_t *obj, volatile TaskHandle_t *slot, uint16_t timeout)
+{
+    TickType_t start = xTaskGetTickCount();
+    TickType_t ticks = pdMS_TO_TICKS(timeout) + 1;
+    bool ready = true;
+
+    // Arm first, then look at the level, so an edge in between is not lost
+    ulTaskNotifyTake(pdTRUE, 0);
+    *slot = xTaskGetCurrentTaskHandle();
 
-    PN532_DEBUG("Reading:");
-    for (uint8_t i = 0; i < n; i++)
+    while (gpio_get_level(obj->_irq) != 0)
     {
-        PN532_DELAY(10);
-        buff[i] = pn532_spi_read(obj);
+        TickType_t wait = portMAX_DELAY;
+        if (timeout != 0)
+        {
+            TickType_t elapsed = xTaskGetTickCount() - start;
+            if (elapsed >= ticks)
+            {
+                PN532_DEBUG("TIMEOUT!\n");
+                ready = false;
+                break;
+            }
+            wait = ticks - elapsed;
+        }
+        ulTaskNotifyTake(pdTRUE, wait);
+    }
+
+    *slot = NULL;
+    return ready;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Reads one frame from the PN532. The transport clocks exactly as
+            many bytes as the frame holds: the header (preamble, start
+            code, LEN and LCS) first, then LEN + 2 bytes (data, DCS and
+            postamble).
+
+            The frame is stored normalised as 00 00 FF LEN LCS TFI ..., so
+            the response code is always at buff[6] and the first data byte
+            at buff[7], even if the chip dropped the preamble byte.
+
+    @param  buff      Buffer for the frame
+    @param  maxlen    Size of buff
+
+    @returns The frame type, PN532_FRAME_DATA only after LCS and DCS
+             validated
+*/
+/**************************************************************************/
+pn532_frame_t pn532_readframe(pn532_t *obj, uint8_t *buff, uint8_t maxlen)
+{
+    // one byte headroom to put back a dropped preamble
+    uint8_t n = obj->_transport->read(obj, buff, maxlen - 1);
+
+    if (n < PN532_FRAME_PEEK)
+    {
+        PN532_DEBUG("Frame %d: short read\n", PN532_FRAME_INVALID);
+        return PN532_FRAME_INVALID;
+    }
+    if (buff[0] == 0x00 && buff[1] == 0xFF)
+    {
+        memmove(buff + 1, buff, n++);
+        buff[0] = PN532_PREAMBLE;
+    }
+
+    pn532_frame_t type = PN532_FRAME_INVALID;
+    uint8_t len = buff[3];
+    uint8_t lcs = buff[4];
+
+    if (buff[0] != 0x00 || buff[1] != 0x00 || buff[2] != 0xFF)
+    {
+        PN532_DEBUG("Preamble missing\n");
+    }
+    else if (len == 0x00 && lcs == 0xFF)
+    {
+        type = PN532_FRAME_ACK;
+    }
+    else if (len == 0xFF && lcs == 0x00)
+    {
+        type = PN532_FRAME_NACK;
+    }
+    else if ((uint8_t)(len + lcs) != 0x00)
+    {
+        PN532_DEBUG("Length check invalid %02x%02x\n", len, lcs);
+    }
+    else if (n < PN532_FRAME_HEADER + len + 1)
+    {
+        PN532_DEBUG("Frame truncated: %d of %d\n", n, PN532_FRAME_HEADER + len + 2);
     }
+    else
+    {
+        // TFI + data + DCS sums to zero
+        uint8_t dcs = 0;
+        for (uint8_t i = 0; i <= len; i++)
+        {
+            dcs += buff[PN532_FRAME_HEADER + i];
+        }
+
+        if (dcs != 0x00)
+        {
+            PN532_DEBUG("Data checksum invalid\n");
+        }
+        else if (len == 1 && buff[PN532_FRAME_HEADER] == 0x7F)
+        {
+            type = PN532_FRAME_ERROR;
+        }
+        else if (buff[PN532_FRAME_HEADER] == PN532_PN532TOHOST)
+        {
+            type = PN532_FRAME_DATA;
+        }
+    }
+
+    PN532_DEBUG("Frame %d:", type);
     for (int i = 0; i < n; i++)
     {
         PN532_DEBUG(" %02x", buff[i]);
     }
     PN532_DEBUG("\n");
 
-    gpio_set_level(obj->_ss, 1);
+    return type;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Tells a transport how many bytes of a frame are still to be
+            read once the first PN532_FRAME_PEEK bytes are in.
+
+    @param  hdr       The first PN532_FRAME_PEEK bytes of the frame
+
+    @returns Bytes left to read, 0 for ACK/NACK or a corrupt header
+*/
+/**************************************************************************/
+uint8_t pn532_frame_remaining(const uint8_t *hdr)
+{
+    // start code 00 FF, with or without the leading preamble byte
+    uint8_t k = (hdr[0] == 0x00 && hdr[1] == 0xFF) ? 0 : 1;
+    uint8_t len = hdr[k + 2];
+    uint8_t lcs = hdr[k + 3];
+    uint8_t have = PN532_FRAME_PEEK - (k + 4); // bytes after LCS already read
+
+    if ((uint8_t)(len + lcs) != 0x00 || len + 2 < have)
+    {
+        return 0; // ACK, NACK or garbage: nothing more to clock
+    }
+    return len + 2 - have;
 }
 
 /**************************************************************************/
@@ -1340,7 +2399,7 @@ void pn532_readdata(pn532_t *obj, uint8_t *buff, uint8_t n)
 /**************************************************************************/
 uint8_t pn532_AsTarget(pn532_t *obj)
 {
-    pn532_packetbuffer[0] = 0x8C;
+    obj->_packetbuffer[0] = 0x8C;
     uint8_t target[] = {
         0x8C,             // INIT AS TARGET
         0x00,             // MODE -> BITFIELD
@@ -1358,10 +2417,11 @@ uint8_t pn532_AsTarget(pn532_t *obj)
         return false;
 
     // read data packet
-    pn532_readdata(obj, pn532_packetbuffer, 8);
+    if (pn532_readframe(obj, obj->_packetbuffer, sizeof(obj->_packetbuffer)) != PN532_FRAME_DATA)
+        return false;
 
-    int offset = 5;
-    return (pn532_packetbuffer[offset] == 0x15);
+    int offset = 6;
+    return (obj->_packetbuffer[offset] == PN532_COMMAND_TGINITASTARGET + 1);
 }
 /**************************************************************************/
 /*!
@@ -1374,16 +2434,17 @@ uint8_t pn532_AsTarget(pn532_t *obj)
 uint8_t pn532_getDataTarget(pn532_t *obj, uint8_t *cmd, uint8_t *cmdlen)
 {
     uint8_t length;
-    pn532_packetbuffer[0] = 0x86;
-    if (!pn532_sendCommandCheckAck(obj, pn532_packetbuffer, 1, 1000))
+    obj->_packetbuffer[0] = 0x86;
+    if (!pn532_sendCommandCheckAck(obj, obj->_packetbuffer, 1, 1000))
     {
         PN532_DEBUG("Error en ack\n");
         return false;
     }
 
     // read data packet
-    pn532_readdata(obj, pn532_packetbuffer, 64);
-    length = pn532_packetbuffer[3] - 3;
+    if (pn532_readframe(obj, obj->_packetbuffer, sizeof(obj->_packetbuffer)) != PN532_FRAME_DATA || obj->_packetbuffer[3] < 3)
+        return false;
+    length = obj->_packetbuffer[3] - 3;
 
     //if (length > *responseLength) {// Bug, should avoid it in the reading target data
     //  length = *responseLength; // silent truncation...
@@ -1391,7 +2452,7 @@ uint8_t pn532_getDataTarget(pn532_t *obj, uint8_t *cmd, uint8_t *cmdlen)
 
     for (int i = 0; i < length; ++i)
     {
-        cmd[i] = pn532_packetbuffer[8 + i];
+        cmd[i] = obj->_packetbuffer[8 + i];
     }
     *cmdlen = length;
     return true;
@@ -1414,17 +2475,18 @@ uint8_t pn532_setDataTarget(pn532_t *obj, uint8_t *cmd, uint8_t cmdlen)
         return false;
 
     // read data packet
-    pn532_readdata(obj, pn532_packetbuffer, 8);
-    length = pn532_packetbuffer[3] - 3;
+    if (pn532_readframe(obj, obj->_packetbuffer, sizeof(obj->_packetbuffer)) != PN532_FRAME_DATA || obj->_packetbuffer[3] < 3)
+        return false;
+    length = obj->_packetbuffer[3] - 3;
     for (int i = 0; i < length; ++i)
     {
-        cmd[i] = pn532_packetbuffer[8 + i];
+        cmd[i] = obj->_packetbuffer[8 + i];
     }
     //cmdl = 0
     cmdlen = length;
 
-    int offset = 5;
-    return (pn532_packetbuffer[offset] == 0x15);
+    int offset = 6;
+    return (obj->_packetbuffer[offset] == PN532_COMMAND_TGSETDATA + 1);
 }
 
 /**************************************************************************/
@@ -1437,43 +2499,255 @@ uint8_t pn532_setDataTarget(pn532_t *obj, uint8_t *cmd, uint8_t cmdlen)
 */
 /**************************************************************************/
 void pn532_writecommand(pn532_t *obj, uint8_t *cmd, uint8_t cmdlen)
+{
+    uint8_t frame[PN532_FRAMESIZ];
+    uint8_t len = pn532_buildframe(cmd, cmdlen, frame);
+
+    if (len == 0)
+    {
+        PN532_DEBUG("Command too long for frame buffer\n");
+        return;
+    }
+
+    obj->_transport->write(obj, frame, len);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Builds a complete command frame (preamble, len, checksums,
+            postamble) without sending it
+
+    @param  cmd       Pointer to the command buffer
+    @param  cmdlen    Command length in bytes
+    @param  frame     Output, PN532_FRAMESIZ bytes
+
+    @returns Frame length, 0 if the command does not fit
+*/
+/**************************************************************************/
+uint8_t pn532_buildframe(const uint8_t *cmd, uint8_t cmdlen, uint8_t *frame)
 {
     uint8_t checksum;
+    uint8_t len = 0;
+
+    if (cmdlen > PN532_PACKBUFFSIZ - 8)
+    {
+        return 0;
+    }
 
     cmdlen++;
 
     PN532_DEBUG("Sending:");
 
-    gpio_set_level(obj->_ss, 0);
-    PN532_DELAY(10); // or whatever the PN532_DELAY is for waking up the board
-    pn532_spi_write(obj, PN532_SPI_DATAWRITE);
-
+    // Build the whole frame first so it can go out in one bus transfer
     checksum = PN532_PREAMBLE + PN532_PREAMBLE + PN532_STARTCODE2;
-    pn532_spi_write(obj, PN532_PREAMBLE);
-    pn532_spi_write(obj, PN532_PREAMBLE);
-    pn532_spi_write(obj, PN532_STARTCODE2);
+    frame[len++] = PN532_PREAMBLE;
+    frame[len++] = PN532_PREAMBLE;
+    frame[len++] = PN532_STARTCODE2;
 
-    pn532_spi_write(obj, cmdlen);
-    pn532_spi_write(obj, ~cmdlen + 1);
+    frame[len++] = cmdlen;
+    frame[len++] = ~cmdlen + 1;
 
-    pn532_spi_write(obj, PN532_HOSTTOPN532);
+    frame[len++] = PN532_HOSTTOPN532;
     checksum += PN532_HOSTTOPN532;
 
     PN532_DEBUG(" %02x %02x %02x %02x %02x %02x", (uint8_t)PN532_PREAMBLE, (uint8_t)PN532_PREAMBLE, (uint8_t)PN532_STARTCODE2, (uint8_t)cmdlen, (uint8_t)(~cmdlen + 1), (uint8_t)PN532_HOSTTOPN532);
 
     for (uint8_t i = 0; i < cmdlen - 1; i++)
     {
-        pn532_spi_write(obj, cmd[i]);
+        frame[len++] = cmd[i];
         checksum += cmd[i];
         PN532_DEBUG(" %02x", cmd[i]);
     }
 
-    pn532_spi_write(obj, ~checksum);
-    pn532_spi_write(obj, PN532_POSTAMBLE);
-    gpio_set_level(obj->_ss, 1);
+    frame[len++] = ~checksum;
+    frame[len++] = PN532_POSTAMBLE;
 
     PN532_DEBUG(" %02x %02x\n", (uint8_t)~checksum, (uint8_t)PN532_POSTAMBLE);
+
+    return len;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Sends a frame from pn532_buildframe and waits for the ACK. The
+            PN532 then works on the command (RF exchange) until
+            pn532_readresponse finds it ready.
+
+    @param  frame     Complete frame
+    @param  len       Frame length
+    @param  timeout   Time to wait for the ACK in ms
+
+    @returns true if the command was ACKed
+*/
+/**************************************************************************/
+bool pn532_sendframe(pn532_t *obj, const uint8_t *frame, uint8_t len, uint16_t timeout)
+{
+    if (!obj->_transport->write(obj, frame, len))
+        return false;
+
+    if (!pn532_waitready(obj, timeout))
+        return false;
+
+    if (!pn532_readack(obj))
+    {
+        PN532_DEBUG("No ACK frame received!\n");
+        return false;
+    }
+    return true;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Waits for the answer to a command sent by pn532_sendframe
+
+    @param  response  Output: response code (command + 1) and its data,
+                      NULL to only check for an answer
+    @param  maxlen    Size of response
+    @param  timeout   Time to wait for the answer in ms, 0 waits forever
+
+    @returns Number of bytes in response, 0 for a timeout or bad frame
+*/
+/**************************************************************************/
+uint8_t pn532_readresponse(pn532_t *obj, uint8_t *response, uint8_t maxlen, uint16_t timeout)
+{
+    if (!pn532_waitready(obj, timeout))
+        return 0;
+
+    if (pn532_readframe(obj, obj->_packetbuffer, sizeof(obj->_packetbuffer)) != PN532_FRAME_DATA)
+        return 0;
+
+    // LEN counts TFI + response code + data
+    uint8_t len = obj->_packetbuffer[3] - 1;
+    if (len == 0)
+        return 0;
+    if (response == NULL)
+        return len;
+    if (len > maxlen)
+        return 0;
+
+    memcpy(response, obj->_packetbuffer + 6, len);
+    return len;
+}
+/**************************************************************************/
+/*!
+    @brief  Aborts the command the PN532 is working on (ACK frame), e.g.
+            after pn532_readresponse gave up, so the next command is taken
+
+    @returns true if the ACK went out
+*/
+/**************************************************************************/
+bool pn532_abort(pn532_t *obj)
+{
+    return pn532_writeack(obj);
+}
+/************** SPI transport (soft or hardware) */
+
+const pn532_transport_t pn532_transport_spi = {
+    .write = pn532_spi_writeframe,
+    .read = pn532_spi_readframe,
+    .isready = pn532_spi_isready,
+    .wakeup = pn532_spi_wakeup,
+    .resume = pn532_spi_resume,
+};
+
+/**************************************************************************/
+/*!
+    @brief  Sends a complete frame behind the SPI data write byte
+*/
+/**************************************************************************/
+bool pn532_spi_writeframe(pn532_t *obj, const uint8_t *frame, uint8_t len)
+{
+    uint8_t buff[PN532_PACKBUFFSIZ + 9];
+
+    if (len + 1 > sizeof(buff))
+    {
+        return false;
+    }
+    buff[0] = PN532_SPI_DATAWRITE;
+    memcpy(buff + 1, frame, len);
+
+    pn532_select(obj);
+    bool ok = pn532_spi_transfer(obj, buff, len + 1, NULL, 0);
+    pn532_deselect(obj);
+
+    return ok;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Reads one frame: the header, then only the bytes it announces,
+            all within one SS low window
+*/
+/**************************************************************************/
+uint8_t pn532_spi_readframe(pn532_t *obj, uint8_t *buff, uint8_t maxlen)
+{
+    uint8_t cmd = PN532_SPI_DATAREAD;
+    uint8_t n = PN532_FRAME_PEEK;
+
+    pn532_select(obj);
+    pn532_spi_transfer(obj, &cmd, 1, buff, PN532_FRAME_PEEK);
+
+    uint8_t more = pn532_frame_remaining(buff);
+    if (more > maxlen - n)
+    {
+        more = maxlen - n;
+    }
+    if (more)
+    {
+        // burst: the rest of the response is clocked back-to-back
+        pn532_spi_transfer(obj, NULL, 0, buff + n, more);
+        n += more;
+    }
+    pn532_deselect(obj);
+
+    return n;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Return true if the PN532 is ready with a response.
+*/
+/**************************************************************************/
+bool pn532_spi_isready(pn532_t *obj)
+{
+    uint8_t cmd = PN532_SPI_STATREAD;
+    uint8_t x;
+
+    pn532_select(obj);
+    pn532_spi_transfer(obj, &cmd, 1, &x, 1);
+
+    pn532_deselect(obj);
+
+    // Check if status is ready.
+    return x == PN532_SPI_READY;
 }
+
+/**************************************************************************/
+/*!
+    @brief  Wakes the PN532 up with a long SS low pulse (cold boot)
+*/
+/**************************************************************************/
+void pn532_spi_wakeup(pn532_t *obj)
+{
+    gpio_set_level(obj->_ss, 0);
+
+    PN532_DELAY(1000);
+
+    gpio_set_level(obj->_ss, 1);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Wakes the PN532 from PowerDown with a short SS low pulse
+*/
+/**************************************************************************/
+void pn532_spi_resume(pn532_t *obj)
+{
+    pn532_select(obj);
+    esp_rom_delay_us(PN532_SPI_RESUME_US);
+    pn532_deselect(obj);
+}
+
 /************** low level SPI */
 
 /**************************************************************************/
@@ -1530,5 +2804,118 @@ uint8_t pn532_spi_read(pn532_t *obj)
     return x;
 }
 
+/**************************************************************************/
+/*!
+    @brief  Pulls SS low and busy waits the PN532 SPI setup time.
 
+            On hardware SPI the bus is held for the whole SS low window,
+            so another PN532 sharing the host cannot clock while this
+            module is selected.
+*/
+/**************************************************************************/
+void pn532_select(pn532_t *obj)
+{
+    if (obj->_spi)
+    {
+        spi_device_acquire_bus(obj->_spi, portMAX_DELAY);
+    }
+    gpio_set_level(obj->_ss, 0);
+    if (PN532_LEGACY_TIMING)
+    {
+        PN532_DELAY(10);
+        return;
+    }
+    esp_rom_delay_us(PN532_SS_SETUP_US);
+}
 
+/**************************************************************************/
+/*!
+    @brief  Releases SS (and the shared bus) after a transfer
+*/
+/**************************************************************************/
+void pn532_deselect(pn532_t *obj)
+{
+    gpio_set_level(obj->_ss, 1);
+    if (obj->_spi)
+    {
+        spi_device_release_bus(obj->_spi);
+    }
+}
+
+/**************************************************************************/
+/*!
+    @brief  Clocks txlen bytes out and then len bytes in while SS is held
+            low by the caller. On hardware SPI this is a single full duplex
+            DMA transaction, with soft SPI it falls back to the bit-banged
+            byte wrappers.
+
+    @param  tx      Bytes to send (direction byte and frame)
+    @param  txlen   Number of bytes to send
+    @param  rx      Buffer for the bytes clocked in after tx, may be NULL
+    @param  len     Number of bytes to receive
+
+    @returns true if the transfer completed
+*/
+/**************************************************************************/
+bool pn532_spi_transfer(pn532_t *obj, const uint8_t *tx, size_t txlen, uint8_t *rx, size_t len)
+{
+    if (PN532_LEGACY_TIMING && len > 1)
+    {
+        // byte by byte with a tick sleep each, as the original pn532_readdata
+        if (txlen && !pn532_spi_transfer(obj, tx, txlen, NULL, 0))
+        {
+            return false;
+        }
+        for (size_t i = 0; i < len; i++)
+        {
+            PN532_DELAY(10);
+            if (!pn532_spi_transfer(obj, NULL, 0, rx + i, 1))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    if (obj->_spi == NULL)
+    {
+        for (size_t i = 0; i < txlen; i++)
+        {
+            pn532_spi_write(obj, tx[i]);
+        }
+        for (size_t i = 0; i < len; i++)
+        {
+            rx[i] = pn532_spi_read(obj);
+        }
+        return true;
+    }
+
+    if (txlen + len > PN532_SPI_DMABUFFSIZ)
+    {
+        PN532_DEBUG("SPI transfer too long\n");
+        return false;
+    }
+
+    if (txlen)
+    {
+        memcpy(obj->_spi_tx, tx, txlen);
+    }
+    memset(obj->_spi_tx + txlen, 0, len);
+
+    spi_transaction_t t = {
+        .length = (txlen + len) * 8,
+        .tx_buffer = obj->_spi_tx,
+        .rx_buffer = len ? obj->_spi_rx : NULL,
+    };
+    // polling avoids the ISR/context switch round trip for these short frames
+    if (spi_device_polling_transmit(obj->_spi, &t) != ESP_OK)
+    {
+        return false;
+    }
+
+    if (len)
+    {
+        memcpy(rx, obj->_spi_rx + txlen, len);
+    }
+    return true;
+}
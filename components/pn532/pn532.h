@@ -1,6 +1,11 @@
 #ifndef __PN532_H__
 #define __PN532_H__
 
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "driver/spi_master.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -65,6 +70,19 @@ extern "C" {
 
 #define PN532_MIFARE_ISO14443A              (0x00)
 
+// PowerDown wake-up sources
+#define PN532_WAKEUP_INT0                   (0x01)
+#define PN532_WAKEUP_INT1                   (0x02)
+#define PN532_WAKEUP_RF                     (0x08) // external RF field (phone, other reader)
+#define PN532_WAKEUP_HSU                    (0x10)
+#define PN532_WAKEUP_SPI                    (0x20)
+#define PN532_WAKEUP_GPIO                   (0x40)
+#define PN532_WAKEUP_I2C                    (0x80)
+
+// InAutoPoll target types
+#define PN532_AUTOPOLL_GENERIC106A          (0x00)
+#define PN532_AUTOPOLL_ENDLESS              (0xFF)
+
 // Mifare Commands
 #define MIFARE_CMD_AUTH_A                   (0x60)
 #define MIFARE_CMD_AUTH_B                   (0x61)
@@ -75,6 +93,8 @@ extern "C" {
 #define MIFARE_CMD_INCREMENT                (0xC1)
 #define MIFARE_CMD_STORE                    (0xC2)
 #define MIFARE_ULTRALIGHT_CMD_WRITE         (0xA2)
+#define NTAG_CMD_FAST_READ                  (0x3A)
+#define NTAG_CMD_GET_VERSION                (0x60)
 
 // Prefixes for NDEF Records (to identify record type)
 #define NDEF_URIPREFIX_NONE                 (0x00)
@@ -122,21 +142,166 @@ extern "C" {
 #define PN532_GPIO_P34                      (4)
 #define PN532_GPIO_P35                      (5)
 
+#define PN532_PACKBUFFSIZ                   (255) // frame lengths are uint8_t
+
+// FAST_READ pages per exchange: 7 framing + 3 header bytes + 4 * pages must fit one frame
+#define PN532_FASTREAD_MAXPAGES             (60)
+#define PN532_FRAMESIZ                      (PN532_PACKBUFFSIZ + 8) // longest command frame
+
+
+#define PN532_HSU_BAUDRATE                  (115200)
+#define PN532_HSU_READTIMEOUT               (100)
+
+// SETSERIALBAUDRATE BR codes
+#define PN532_HSU_BR_9600                   (0x00)
+#define PN532_HSU_BR_19200                  (0x01)
+#define PN532_HSU_BR_38400                  (0x02)
+#define PN532_HSU_BR_57600                  (0x03)
+#define PN532_HSU_BR_115200                 (0x04)
+#define PN532_HSU_BR_230400                 (0x05)
+#define PN532_HSU_BR_460800                 (0x06)
+#define PN532_HSU_BR_921600                 (0x07)
+#define PN532_HSU_BR_1288000                (0x08)
+
+// Bytes a transport reads before it knows the frame length
+#define PN532_FRAME_PEEK                    (6)
+
+typedef struct pn532 pn532_t;
+
+// How a tag answered a page write
+typedef enum
+{
+    PN532_WRITE_ACK = 0,
+    PN532_WRITE_NAK,     // tag refused the write (locked / missing page)
+    PN532_WRITE_TIMEOUT, // no answer from the PN532 or the tag
+    PN532_WRITE_ERROR    // unexpected answer
+} pn532_write_status_t;
+
+// Tag family, from SAK and GET_VERSION / capability container
+typedef enum
+{
+    PN532_TAG_UNKNOWN = 0,
+    PN532_TAG_ULTRALIGHT,     // Ultralight / Ultralight C / NTAG203 (no GET_VERSION)
+    PN532_TAG_ULTRALIGHT_EV1,
+    PN532_TAG_NTAG21X,
+    PN532_TAG_CLASSIC_MINI,
+    PN532_TAG_CLASSIC_1K,
+    PN532_TAG_CLASSIC_4K
+} pn532_tagtype_t;
+
+// What the inlisted tag can do (pn532_detectTag)
+typedef struct
+{
+    pn532_tagtype_t type;
+    uint16_t atqa;      // SENS_RES
+    uint8_t sak;        // SEL_RES
+    uint16_t pages;     // pages (Type 2) or blocks (Classic) in total
+    uint16_t userstart; // first user page / block
+    uint16_t userend;   // last user page / block, inclusive
+    bool fastread;      // FAST_READ (0x3A)
+    bool counter;       // READ_CNT / NFC counter
+} pn532_taginfo_t;
+
+// Target listed by InListPassiveTarget / InAutoPoll
+#define PN532_MAXTARGETS                    (2)
+
+typedef struct
+{
+    uint8_t tg;        // Tg number for InDataExchange
+    uint16_t atqa;     // SENS_RES
+    uint8_t sak;       // SEL_RES
+    uint8_t uid[7];
+    uint8_t uidLen;
+    uint16_t pages;    // from pn532_detectTag, 0 until then
+    uint16_t userend;
+} pn532_target_t;
+
+/*
+    Bus backend. The command layer builds complete frames (preamble to
+    postamble) and hands them to write(); read() returns one raw response
+    frame as sent by the chip. Transports use pn532_frame_remaining() to
+    clock no more bytes than the frame holds.
+*/
+typedef struct
+{
+    bool (*write)(pn532_t *obj, const uint8_t *frame, uint8_t len);
+    uint8_t (*read)(pn532_t *obj, uint8_t *buff, uint8_t maxlen); // returns bytes read
+    bool (*isready)(pn532_t *obj);
+    void (*wakeup)(pn532_t *obj);
+    bool (*waitready)(pn532_t *obj, uint16_t timeout); // optional, NULL polls isready()
+    void (*resume)(pn532_t *obj);                      // optional, NULL uses wakeup()
+} pn532_transport_t;
+
+extern const pn532_transport_t pn532_transport_spi;      // soft or hardware SPI (see _spi)
+extern const pn532_transport_t pn532_transport_i2c;
+extern const pn532_transport_t pn532_transport_hsu;
+extern const pn532_transport_t pn532_transport_loopback;
+
+/*
+    In-memory PN532 stand-in for the loopback transport. peer() gets the
+    command (starting with the command code) and writes the response data
+    (starting with the response code) to resp, returning its length, or 0
+    for no response.
+*/
+typedef uint8_t (*pn532_loopback_peer_t)(void *ctx, const uint8_t *cmd, uint8_t cmdlen, uint8_t *resp);
+
+typedef struct
+{
+    pn532_loopback_peer_t peer;
+    void *ctx;
+    bool ackpending;
+    uint32_t aborts;       // ACK frames from the host (command aborted)
+    uint8_t rxlen;
+    uint8_t rx[PN532_PACKBUFFSIZ + 8];
+} pn532_loopback_t;
+
+struct pn532
+{
+    const pn532_transport_t *_transport;
 
-typedef struct {
     uint8_t _clk;
     uint8_t _miso;
     uint8_t _mosi;
     uint8_t _ss;
 
+    spi_device_handle_t _spi; // hardware SPI device, NULL when bit-banging
+    uint8_t *_spi_tx;         // DMA capable transmit buffer (hardware SPI only)
+    uint8_t *_spi_rx;         // DMA capable receive buffer (hardware SPI only)
+
+    int _port;                // I2C / UART port number
+    QueueHandle_t _uartqueue; // UART driver event queue (HSU only)
+    uint32_t _baud;           // current HSU baud rate
+    pn532_loopback_t *_loopback;
+
+    int8_t _irq;                     // IRQ GPIO, -1 when not wired (status polling)
+    volatile TaskHandle_t _irqtask;  // task waiting for the IRQ falling edge
+    volatile TaskHandle_t _waketask; // task in pn532_waitWakeup (PowerDown)
+
     uint8_t _uid[7];       // ISO14443A uid
     uint8_t _uidLen;       // uid len
+    uint16_t _atqa;        // SENS_RES of the inlisted tag
+    uint8_t _sak;          // SEL_RES of the inlisted tag
+    uint16_t _tagPages;    // pages of the inlisted tag, 0 until pn532_detectTag
+    uint16_t _tagUserEnd;  // last user page of the inlisted tag
     uint8_t _key[6];       // Mifare Classic key
     uint8_t _inListedTag;  // Tg number of inlisted tag.
 
-} pn532_t;
+    pn532_target_t _targets[PN532_MAXTARGETS]; // targets of the last InListPassiveTarget / InAutoPoll
+    uint8_t _targetCount;
+    uint8_t _target;       // index of the active target, its copy is in the fields above
+    uint32_t _selectCount; // bumped whenever the active target changes
+
+    uint8_t _packetbuffer[PN532_PACKBUFFSIZ]; // command / response frames of this module
+
+};
 
 void pn532_spi_init(pn532_t *obj, uint8_t clk, uint8_t miso, uint8_t mosi, uint8_t ss);
+bool pn532_spi_init_hw(pn532_t *obj, spi_host_device_t host, uint8_t clk, uint8_t miso, uint8_t mosi, uint8_t ss, int clock_hz);
+bool pn532_i2c_init(pn532_t *obj, int port, uint8_t sda, uint8_t scl);
+bool pn532_hsu_init(pn532_t *obj, int port, uint8_t tx, uint8_t rx);
+bool pn532_hsu_setbaudrate(pn532_t *obj, uint32_t baud);
+void pn532_loopback_init(pn532_t *obj, pn532_loopback_t *bus, pn532_loopback_peer_t peer, void *ctx);
+bool pn532_irq_init(pn532_t *obj, uint8_t irq);
 void pn532_begin(pn532_t *obj);
 uint32_t pn532_getFirmwareVersion(pn532_t *obj);
 bool pn532_sendCommandCheckAck(pn532_t *obj, uint8_t *cmd, uint8_t cmdlen, uint16_t timeout);
@@ -144,25 +309,99 @@ bool pn532_writeGPIO(pn532_t *obj, uint8_t pinstate);
 uint8_t pn532_readGPIO(pn532_t *obj);
 bool pn532_SAMConfig(pn532_t *obj);
 bool pn532_setPassiveActivationRetries(pn532_t *obj, uint8_t maxRetries);
+bool pn532_setRFField(pn532_t *obj, bool on);
+bool pn532_setSerialBaudRate(pn532_t *obj, uint8_t br);
+bool pn532_powerDown(pn532_t *obj, uint8_t wakeupEnable, bool generateIrq);
+bool pn532_waitWakeup(pn532_t *obj, uint16_t timeout);
+void pn532_wakeup(pn532_t *obj);
 bool pn532_readPassiveTargetID(pn532_t *obj, uint8_t cardbaudrate, uint8_t *uid, uint8_t *uidLength, uint16_t timeout);
+uint8_t pn532_listPassiveTargets(pn532_t *obj, uint8_t cardbaudrate, uint8_t maxTg, pn532_target_t *targets, uint16_t timeout);
+bool pn532_startListPassiveTargets(pn532_t *obj, uint8_t cardbaudrate, uint8_t maxTg, uint16_t timeout);
+uint8_t pn532_finishListPassiveTargets(pn532_t *obj, pn532_target_t *targets, uint16_t timeout);
+bool pn532_selectTarget(pn532_t *obj, const uint8_t *uid, uint8_t uidLength);
+uint32_t pn532_selectCount(pn532_t *obj);
 bool pn532_inDataExchange(pn532_t *obj, uint8_t *send, uint8_t sendLength, uint8_t *response, uint8_t *responseLength);
 bool pn532_inListPassiveTarget(pn532_t *obj);
+bool pn532_inAutoPoll(pn532_t *obj, uint8_t pollNr, uint8_t period, uint8_t *uid, uint8_t *uidLength, uint16_t timeout);
+bool pn532_inRelease(pn532_t *obj);
+bool pn532_inDeselect(pn532_t *obj);
 bool pn532_mifareclassic_IsFirstBlock(pn532_t *obj, uint32_t uiBlock);
 bool pn532_mifareclassic_IsTrailerBlock(pn532_t *obj, uint32_t uiBlock);
 uint8_t pn532_mifareclassic_AuthenticateBlock(pn532_t *obj, uint8_t *uid, uint8_t uidLen, uint32_t blockNumber, uint8_t keyNumber, uint8_t *keyData);
 uint8_t pn532_mifareclassic_ReadDataBlock(pn532_t *obj, uint8_t blockNumber, uint8_t *data);
 uint8_t pn532_mifareclassic_WriteDataBlock(pn532_t *obj, uint8_t blockNumber, uint8_t *data);
+pn532_write_status_t pn532_mifareclassic_WriteDataBlockStatus(pn532_t *obj, uint8_t blockNumber, uint8_t *data);
 uint8_t pn532_mifareclassic_FormatNDEF(pn532_t *obj);
 uint8_t pn532_mifareclassic_WriteNDEFURI(pn532_t *obj, uint8_t sectorNumber, uint8_t uriIdentifier, const char *url);
 uint8_t pn532_mifareultralight_ReadPage(pn532_t *obj, uint8_t page, uint8_t *buffer);
 uint8_t pn532_mifareultralight_WritePage(pn532_t *obj, uint8_t page, uint8_t *data);
+pn532_write_status_t pn532_mifareultralight_WritePageStatus(pn532_t *obj, uint8_t page, uint8_t *data);
 uint8_t pn532_ntag2xx_ReadPage(pn532_t *obj, uint8_t page, uint8_t *buffer);
+bool pn532_ntag2xx_GetVersion(pn532_t *obj, uint8_t *version);
+bool pn532_detectTag(pn532_t *obj, pn532_taginfo_t *info);
+uint8_t pn532_ntag2xx_FastRead(pn532_t *obj, uint8_t startpage, uint8_t endpage, uint8_t *buffer);
 uint8_t pn532_ntag2xx_WritePage(pn532_t *obj, uint8_t page, uint8_t *data);
 uint8_t pn532_ntag2xx_WriteNDEFURI(pn532_t *obj, uint8_t uriIdentifier, char *url, uint8_t dataLen);
 uint8_t pn532_AsTarget(pn532_t *obj);
 uint8_t pn532_getDataTarget(pn532_t *obj, uint8_t *cmd, uint8_t *cmdlen);
 uint8_t pn532_setDataTarget(pn532_t *obj, uint8_t *cmd, uint8_t cmdlen);
 
+uint8_t pn532_frame_remaining(const uint8_t *hdr);
+uint8_t pn532_buildframe(const uint8_t *cmd, uint8_t cmdlen, uint8_t *frame);
+bool pn532_sendframe(pn532_t *obj, const uint8_t *frame, uint8_t len, uint16_t timeout);
+uint8_t pn532_readresponse(pn532_t *obj, uint8_t *response, uint8_t maxlen, uint16_t timeout);
+bool pn532_abort(pn532_t *obj);
+
+/*
+    Asynchronous requests (pn532_async.c). A driver task owns the bus and
+    works through a queue of requests; while the PN532 runs one RF
+    exchange, the frame of the next queued command is already built.
+    Nothing else may use the pn532_t while the driver runs, other code
+    goes through exec requests.
+*/
+#define PN532_ASYNC_MAXCMD                  (64)
+
+typedef enum
+{
+    PN532_REQ_PENDING = 0,
+    PN532_REQ_DONE,
+    PN532_REQ_FAILED
+} pn532_req_status_t;
+
+typedef struct pn532_request pn532_request_t;
+
+struct pn532_request
+{
+    // command request: cmd is sent, the answer lands in response
+    uint8_t cmd[PN532_ASYNC_MAXCMD]; // command code and parameters
+    uint8_t cmdlen;
+    uint8_t *response;               // response code and data, or NULL
+    uint8_t responsemax;
+    uint8_t responselen;             // out
+    uint16_t timeout;                // ms, for the ACK and for the answer
+
+    // exec request (exec != NULL): runs blocking driver code in the driver task
+    bool (*exec)(pn532_t *obj, void *ctx);
+
+    void (*done)(pn532_request_t *req, void *ctx); // called in the driver task, or NULL
+    void *ctx;
+    TaskHandle_t notify;                           // task to notify when done, or NULL
+    volatile pn532_req_status_t status;            // out
+};
+
+typedef struct
+{
+    pn532_t *_nfc;
+    QueueHandle_t _queue;              // pn532_request_t *
+    TaskHandle_t _task;
+    uint8_t _frames[2][PN532_FRAMESIZ]; // current and next command frame
+} pn532_async_t;
+
+bool pn532_async_start(pn532_async_t *drv, pn532_t *obj, size_t depth, UBaseType_t priority);
+bool pn532_async_submit(pn532_async_t *drv, pn532_request_t *req, TickType_t wait);
+bool pn532_async_wait(pn532_request_t *req, TickType_t wait);
+bool pn532_async_transceive(pn532_async_t *drv, pn532_request_t *req, TickType_t wait);
+
 
 
 
@@ -0,0 +1,196 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "sdkconfig.h"
+
+#include "pn532.h"
+
+//#define PN532_DEBUG_EN
+
+#ifdef PN532_DEBUG_EN
+#define PN532_DEBUG(fmt, ...) printf(fmt, ##__VA_ARGS__)
+#else
+#define PN532_DEBUG(fmt, ...)
+#endif
+
+#define PN532_ASYNC_STACK 4096
+
+static void pn532_async_task(void *arg);
+
+/**************************************************************************/
+/*!
+    @brief  Finishes a request: stores the status, calls the callback and
+            notifies the waiting task
+*/
+/**************************************************************************/
+static void pn532_async_complete(pn532_request_t *req, bool ok)
+{
+    // read before the status changes, the owner may reuse req afterwards
+    void (*done)(pn532_request_t *, void *) = req->done;
+    void *ctx = req->ctx;
+    TaskHandle_t notify = req->notify;
+
+    req->status = ok ? PN532_REQ_DONE : PN532_REQ_FAILED;
+    if (done != NULL)
+        done(req, ctx);
+    if (notify != NULL)
+        xTaskNotifyGive(notify);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Builds the frame of a command request, 0 for exec requests
+            and commands that do not fit
+*/
+/**************************************************************************/
+static uint8_t pn532_async_prepare(pn532_request_t *req, uint8_t *frame)
+{
+    if (req->exec != NULL || req->cmdlen == 0 || req->cmdlen > PN532_ASYNC_MAXCMD)
+        return 0;
+    return pn532_buildframe(req->cmd, req->cmdlen, frame);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Starts the driver task. From now on the task owns obj and its
+            bus.
+
+    @param  drv       Driver state, must stay valid while the task runs
+    @param  obj       Initialized PN532
+    @param  depth     Number of requests the queue holds
+    @param  priority  Task priority
+
+    @returns true if the queue and the task were created
+*/
+/**************************************************************************/
+bool pn532_async_start(pn532_async_t *drv, pn532_t *obj, size_t depth, UBaseType_t priority)
+{
+    drv->_nfc = obj;
+    drv->_task = NULL;
+    drv->_queue = xQueueCreate(depth, sizeof(pn532_request_t *));
+    if (drv->_queue == NULL)
+        return false;
+
+    if (xTaskCreate(pn532_async_task, "pn532_async", PN532_ASYNC_STACK, drv, priority, &drv->_task) != pdPASS)
+    {
+        vQueueDelete(drv->_queue);
+        drv->_queue = NULL;
+        return false;
+    }
+    return true;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Queues a request. The request must stay valid until its status
+            leaves PN532_REQ_PENDING.
+
+    @param  req       Command (cmd/cmdlen) or exec request
+    @param  wait      Ticks to wait for space in the queue
+
+    @returns true if queued
+*/
+/**************************************************************************/
+bool pn532_async_submit(pn532_async_t *drv, pn532_request_t *req, TickType_t wait)
+{
+    req->status = PN532_REQ_PENDING;
+    req->responselen = 0;
+    return xQueueSend(drv->_queue, &req, wait) == pdTRUE;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Waits for the notification of a request submitted with
+            notify set to the calling task
+
+    @returns true if the request finished successfully
+*/
+/**************************************************************************/
+bool pn532_async_wait(pn532_request_t *req, TickType_t wait)
+{
+    while (req->status == PN532_REQ_PENDING)
+    {
+        if (ulTaskNotifyTake(pdTRUE, wait) == 0)
+            return false;
+    }
+    return req->status == PN532_REQ_DONE;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Submits a request and blocks the calling task until it is done
+
+    @returns true if the request finished successfully
+*/
+/**************************************************************************/
+bool pn532_async_transceive(pn532_async_t *drv, pn532_request_t *req, TickType_t wait)
+{
+    req->notify = xTaskGetCurrentTaskHandle();
+    if (!pn532_async_submit(drv, req, wait))
+        return false;
+    return pn532_async_wait(req, portMAX_DELAY);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Driver task. A command is sent and ACKed; while the PN532 runs
+            the RF exchange the next queued command is taken and its frame
+            built, so it goes out right after the answer is read.
+*/
+/**************************************************************************/
+static void pn532_async_task(void *arg)
+{
+    pn532_async_t *drv = (pn532_async_t *)arg;
+    pn532_request_t *cur = NULL;
+    pn532_request_t *next = NULL;
+    uint8_t curlen = 0;
+    uint8_t nextlen = 0;
+    uint8_t slot = 0;
+
+    while (1)
+    {
+        if (cur == NULL)
+        {
+            if (xQueueReceive(drv->_queue, &cur, portMAX_DELAY) != pdTRUE)
+                continue;
+            curlen = pn532_async_prepare(cur, drv->_frames[slot]);
+        }
+
+        if (cur->exec != NULL)
+        {
+            pn532_async_complete(cur, cur->exec(drv->_nfc, cur->ctx));
+        }
+        else if (curlen == 0 || !pn532_sendframe(drv->_nfc, drv->_frames[slot], curlen, cur->timeout))
+        {
+            PN532_DEBUG("async: command %02x not sent\n", cur->cmd[0]);
+            pn532_async_complete(cur, false);
+        }
+        else
+        {
+            // RF exchange in flight, prepare the next frame meanwhile
+            if (xQueueReceive(drv->_queue, &next, 0) == pdTRUE)
+                nextlen = pn532_async_prepare(next, drv->_frames[slot ^ 1]);
+
+            uint8_t len = pn532_readresponse(drv->_nfc, cur->response, cur->responsemax, cur->timeout);
+            if (len == 0)
+            {
+                // the PN532 may still run cur, stop it before the next frame goes out
+                PN532_DEBUG("async: command %02x aborted\n", cur->cmd[0]);
+                pn532_abort(drv->_nfc);
+            }
+            uint8_t code = cur->response != NULL ? cur->response[0] : drv->_nfc->_packetbuffer[6];
+            cur->responselen = len;
+            pn532_async_complete(cur, len != 0 && code == (uint8_t)(cur->cmd[0] + 1));
+        }
+
+        cur = next;
+        curlen = nextlen;
+        next = NULL;
+        nextlen = 0;
+        slot ^= 1;
+    }
+}
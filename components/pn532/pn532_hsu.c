@@ -0,0 +1,255 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "sdkconfig.h"
+
+#include "driver/uart.h"
+#include "esp_rom_sys.h"
+#include "pn532.h"
+
+//#define PN532_DEBUG_EN
+
+#ifdef PN532_DEBUG_EN
+#define PN532_DEBUG(fmt, ...) printf(fmt, ##__VA_ARGS__)
+#else
+#define PN532_DEBUG(fmt, ...)
+#endif
+
+#define PN532_HSU_RXBUFFSIZ 512
+#define PN532_HSU_EVENTQUEUE 8
+#define PN532_HSU_RXTIMEOUT 2 // symbols of line idle that close a frame in the ISR
+
+static bool pn532_hsu_writeframe(pn532_t *obj, const uint8_t *frame, uint8_t len);
+static uint8_t pn532_hsu_readframe(pn532_t *obj, uint8_t *buff, uint8_t maxlen);
+static bool pn532_hsu_isready(pn532_t *obj);
+static void pn532_hsu_wakeup(pn532_t *obj);
+static bool pn532_hsu_waitready(pn532_t *obj, uint16_t timeout);
+
+static const struct
+{
+    uint32_t baud;
+    uint8_t br;
+} pn532_hsu_rates[] = {
+    {9600, PN532_HSU_BR_9600},
+    {19200, PN532_HSU_BR_19200},
+    {38400, PN532_HSU_BR_38400},
+    {57600, PN532_HSU_BR_57600},
+    {115200, PN532_HSU_BR_115200},
+    {230400, PN532_HSU_BR_230400},
+    {460800, PN532_HSU_BR_460800},
+    {921600, PN532_HSU_BR_921600},
+    {1288000, PN532_HSU_BR_1288000},
+};
+
+const pn532_transport_t pn532_transport_hsu = {
+    .write = pn532_hsu_writeframe,
+    .read = pn532_hsu_readframe,
+    .isready = pn532_hsu_isready,
+    .wakeup = pn532_hsu_wakeup,
+    .waitready = pn532_hsu_waitready,
+};
+
+/**************************************************************************/
+/*!
+    @brief  Sets up the PN532 on a UART (HSU) at PN532_HSU_BAUDRATE, 8N1
+
+            Received bytes are collected by the UART driver ISR; the RX
+            timeout closes a frame after a short line idle, so a waiting
+            task is woken once per frame through the event queue instead
+            of reading the line byte by byte.
+
+    @param  port      UART port (UART_NUM_1 / UART_NUM_2)
+    @param  tx        ESP32 TX GPIO (to PN532 RX)
+    @param  rx        ESP32 RX GPIO (from PN532 TX)
+
+    @returns true if the UART driver was installed
+*/
+/**************************************************************************/
+bool pn532_hsu_init(pn532_t *obj, int port, uint8_t tx, uint8_t rx)
+{
+    obj->_transport = &pn532_transport_hsu;
+    obj->_port = port;
+    obj->_spi = NULL;
+    obj->_irq = -1;
+    obj->_baud = PN532_HSU_BAUDRATE;
+
+    uart_config_t conf = {
+        .baud_rate = PN532_HSU_BAUDRATE,
+        .data_bits = UART_DATA_8_BITS,
+        .parity = UART_PARITY_DISABLE,
+        .stop_bits = UART_STOP_BITS_1,
+        .flow_ctrl = UART_HW_FLOWCTRL_DISABLE,
+        .source_clk = UART_SCLK_DEFAULT,
+    };
+    if (uart_driver_install(port, PN532_HSU_RXBUFFSIZ, 0, PN532_HSU_EVENTQUEUE, &obj->_uartqueue, 0) != ESP_OK)
+    {
+        PN532_DEBUG("UART driver install failed\n");
+        return false;
+    }
+    if (uart_param_config(port, &conf) != ESP_OK || uart_set_pin(port, tx, rx, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE) != ESP_OK)
+    {
+        PN532_DEBUG("UART config failed\n");
+        return false;
+    }
+    uart_set_rx_timeout(port, PN532_HSU_RXTIMEOUT);
+    uart_set_rx_full_threshold(port, PN532_FRAME_PEEK);
+    return true;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Negotiates a new HSU baud rate with the PN532 and moves the
+            UART over to it
+
+    @param  baud      One of the SETSERIALBAUDRATE rates, up to 1288000
+
+    @returns true if the PN532 answers at the new rate
+*/
+/**************************************************************************/
+bool pn532_hsu_setbaudrate(pn532_t *obj, uint32_t baud)
+{
+    int i;
+
+    for (i = 0; i < sizeof(pn532_hsu_rates) / sizeof(pn532_hsu_rates[0]); i++)
+    {
+        if (pn532_hsu_rates[i].baud == baud)
+            break;
+    }
+    if (i == sizeof(pn532_hsu_rates) / sizeof(pn532_hsu_rates[0]))
+    {
+        PN532_DEBUG("Unsupported HSU baud rate %lu\n", baud);
+        return false;
+    }
+
+    if (!pn532_setSerialBaudRate(obj, pn532_hsu_rates[i].br))
+    {
+        PN532_DEBUG("SETSERIALBAUDRATE refused\n");
+        return false;
+    }
+
+    // the PN532 switches once our ACK is out
+    uart_wait_tx_done(obj->_port, pdMS_TO_TICKS(PN532_HSU_READTIMEOUT));
+    esp_rom_delay_us(200);
+    if (uart_set_baudrate(obj->_port, baud) != ESP_OK)
+    {
+        return false;
+    }
+    uart_flush_input(obj->_port);
+    xQueueReset(obj->_uartqueue);
+    obj->_baud = baud;
+
+    return pn532_getFirmwareVersion(obj) != 0;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Sends a complete frame
+*/
+/**************************************************************************/
+bool pn532_hsu_writeframe(pn532_t *obj, const uint8_t *frame, uint8_t len)
+{
+    return uart_write_bytes(obj->_port, frame, len) == len;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Reads one frame from the UART buffer: the header, then exactly
+            the bytes it announces
+*/
+/**************************************************************************/
+uint8_t pn532_hsu_readframe(pn532_t *obj, uint8_t *buff, uint8_t maxlen)
+{
+    TickType_t ticks = pdMS_TO_TICKS(PN532_HSU_READTIMEOUT);
+
+    if (uart_read_bytes(obj->_port, buff, PN532_FRAME_PEEK, ticks) != PN532_FRAME_PEEK)
+    {
+        return 0;
+    }
+
+    uint8_t more = pn532_frame_remaining(buff);
+    if (more > maxlen - PN532_FRAME_PEEK)
+    {
+        more = maxlen - PN532_FRAME_PEEK;
+    }
+    if (more == 0)
+    {
+        return PN532_FRAME_PEEK;
+    }
+
+    int n = uart_read_bytes(obj->_port, buff + PN532_FRAME_PEEK, more, ticks);
+    return PN532_FRAME_PEEK + (n > 0 ? n : 0);
+}
+
+/**************************************************************************/
+/*!
+    @brief  Return true if response bytes are waiting in the UART buffer
+*/
+/**************************************************************************/
+bool pn532_hsu_isready(pn532_t *obj)
+{
+    size_t n = 0;
+
+    uart_get_buffered_data_len(obj->_port, &n);
+    return n > 0;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Sleeps on the UART event queue until a frame has arrived
+
+    @param  timeout   Timeout in ms before giving up, 0 waits forever
+*/
+/**************************************************************************/
+bool pn532_hsu_waitready(pn532_t *obj, uint16_t timeout)
+{
+    TickType_t start = xTaskGetTickCount();
+    TickType_t ticks = timeout ? pdMS_TO_TICKS(timeout) : portMAX_DELAY;
+    uart_event_t event;
+
+    while (!pn532_hsu_isready(obj))
+    {
+        TickType_t wait = portMAX_DELAY;
+        if (timeout)
+        {
+            TickType_t elapsed = xTaskGetTickCount() - start;
+            if (elapsed >= ticks)
+            {
+                PN532_DEBUG("TIMEOUT!\n");
+                return false;
+            }
+            wait = ticks - elapsed;
+        }
+        if (xQueueReceive(obj->_uartqueue, &event, wait) != pdTRUE)
+        {
+            continue;
+        }
+        if (event.type == UART_FIFO_OVF || event.type == UART_BUFFER_FULL)
+        {
+            PN532_DEBUG("UART overflow\n");
+            uart_flush_input(obj->_port);
+            xQueueReset(obj->_uartqueue);
+            return false;
+        }
+        // UART_DATA events left over from a frame already read are
+        // filtered by the buffered length check above
+    }
+    return true;
+}
+
+/**************************************************************************/
+/*!
+    @brief  HSU wake-up sequence: 0x55 0x55 and a long preamble
+*/
+/**************************************************************************/
+void pn532_hsu_wakeup(pn532_t *obj)
+{
+    static const uint8_t wakeup[] = {PN532_WAKEUP, PN532_WAKEUP, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+
+    uart_write_bytes(obj->_port, wakeup, sizeof(wakeup));
+    uart_wait_tx_done(obj->_port, pdMS_TO_TICKS(PN532_HSU_READTIMEOUT));
+    uart_flush_input(obj->_port);
+    xQueueReset(obj->_uartqueue);
+}
@@ -0,0 +1,175 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "sdkconfig.h"
+
+#include "driver/i2c.h"
+#include "esp_rom_sys.h"
+#include "pn532.h"
+
+//#define PN532_DEBUG_EN
+
+#ifdef PN532_DEBUG_EN
+#define PN532_DEBUG(fmt, ...) printf(fmt, ##__VA_ARGS__)
+#else
+#define PN532_DEBUG(fmt, ...)
+#endif
+
+#define PN532_I2C_CLOCK_HZ 400000
+#define PN532_I2C_TIMEOUT_MS 50 // per bus transaction (the PN532 stretches SCL)
+
+static bool pn532_i2c_writeframe(pn532_t *obj, const uint8_t *frame, uint8_t len);
+static uint8_t pn532_i2c_readframe(pn532_t *obj, uint8_t *buff, uint8_t maxlen);
+static bool pn532_i2c_isready(pn532_t *obj);
+static void pn532_i2c_wakeup(pn532_t *obj);
+static bool pn532_i2c_waitready(pn532_t *obj);
+
+static const uint8_t pn532_i2c_nack[] = {0x00, 0x00, 0xFF, 0xFF, 0x00, 0x00};
+
+const pn532_transport_t pn532_transport_i2c = {
+    .write = pn532_i2c_writeframe,
+    .read = pn532_i2c_readframe,
+    .isready = pn532_i2c_isready,
+    .wakeup = pn532_i2c_wakeup,
+};
+
+/**************************************************************************/
+/*!
+    @brief  Sets up the PN532 on an I2C master port at 400 kHz
+
+    @param  port      I2C port (I2C_NUM_0 / I2C_NUM_1)
+    @param  sda       SDA GPIO
+    @param  scl       SCL GPIO
+
+    @returns true if the I2C driver was installed
+*/
+/**************************************************************************/
+bool pn532_i2c_init(pn532_t *obj, int port, uint8_t sda, uint8_t scl)
+{
+    obj->_transport = &pn532_transport_i2c;
+    obj->_port = port;
+    obj->_spi = NULL;
+    obj->_irq = -1;
+
+    i2c_config_t conf = {
+        .mode = I2C_MODE_MASTER,
+        .sda_io_num = sda,
+        .scl_io_num = scl,
+        .sda_pullup_en = GPIO_PULLUP_ENABLE,
+        .scl_pullup_en = GPIO_PULLUP_ENABLE,
+        .master.clk_speed = PN532_I2C_CLOCK_HZ,
+    };
+    if (i2c_param_config(port, &conf) != ESP_OK)
+    {
+        PN532_DEBUG("I2C config failed\n");
+        return false;
+    }
+    if (i2c_driver_install(port, I2C_MODE_MASTER, 0, 0, 0) != ESP_OK)
+    {
+        PN532_DEBUG("I2C driver install failed\n");
+        return false;
+    }
+    return true;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Sends a complete frame in one I2C write
+*/
+/**************************************************************************/
+bool pn532_i2c_writeframe(pn532_t *obj, const uint8_t *frame, uint8_t len)
+{
+    return i2c_master_write_to_device(obj->_port, PN532_I2C_ADDRESS, frame, len, pdMS_TO_TICKS(PN532_I2C_TIMEOUT_MS)) == ESP_OK;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Reads one frame. Every I2C read restarts at the status byte
+            and the frame start, so after peeking at the header the PN532
+            is asked (NACK) to send the frame again and it is read whole,
+            exactly as long as LEN says.
+*/
+/**************************************************************************/
+uint8_t pn532_i2c_readframe(pn532_t *obj, uint8_t *buff, uint8_t maxlen)
+{
+    uint8_t rx[1 + PN532_PACKBUFFSIZ];
+    TickType_t ticks = pdMS_TO_TICKS(PN532_I2C_TIMEOUT_MS);
+
+    // status byte + frame header
+    if (i2c_master_read_from_device(obj->_port, PN532_I2C_ADDRESS, rx, 1 + PN532_FRAME_PEEK, ticks) != ESP_OK || rx[0] != PN532_I2C_READY)
+    {
+        return 0;
+    }
+
+    uint8_t more = pn532_frame_remaining(rx + 1);
+    if (more > maxlen - PN532_FRAME_PEEK)
+    {
+        more = maxlen - PN532_FRAME_PEEK;
+    }
+
+    if (more)
+    {
+        if (!pn532_i2c_writeframe(obj, pn532_i2c_nack, sizeof(pn532_i2c_nack)) || !pn532_i2c_waitready(obj))
+        {
+            PN532_DEBUG("I2C frame resend failed\n");
+            return 0;
+        }
+        if (i2c_master_read_from_device(obj->_port, PN532_I2C_ADDRESS, rx, 1 + PN532_FRAME_PEEK + more, ticks) != ESP_OK || rx[0] != PN532_I2C_READY)
+        {
+            return 0;
+        }
+    }
+
+    memcpy(buff, rx + 1, PN532_FRAME_PEEK + more);
+    return PN532_FRAME_PEEK + more;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Return true if the PN532 is ready with a response.
+*/
+/**************************************************************************/
+bool pn532_i2c_isready(pn532_t *obj)
+{
+    uint8_t status = PN532_I2C_BUSY;
+
+    if (i2c_master_read_from_device(obj->_port, PN532_I2C_ADDRESS, &status, 1, pdMS_TO_TICKS(PN532_I2C_TIMEOUT_MS)) != ESP_OK)
+    {
+        return false;
+    }
+    return status == PN532_I2C_READY;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Short status poll used while the PN532 resends a frame
+*/
+/**************************************************************************/
+bool pn532_i2c_waitready(pn532_t *obj)
+{
+    for (int i = 0; i < PN532_I2C_READYTIMEOUT * 4; i++)
+    {
+        if (pn532_i2c_isready(obj))
+        {
+            return true;
+        }
+        esp_rom_delay_us(250);
+    }
+    return false;
+}
+
+/**************************************************************************/
+/*!
+    @brief  The PN532 wakes on its own address, give it time to start
+*/
+/**************************************************************************/
+void pn532_i2c_wakeup(pn532_t *obj)
+{
+    uint8_t status;
+
+    i2c_master_read_from_device(obj->_port, PN532_I2C_ADDRESS, &status, 1, pdMS_TO_TICKS(PN532_I2C_TIMEOUT_MS));
+    vTaskDelay(pdMS_TO_TICKS(20));
+}
@@ -0,0 +1,145 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "sdkconfig.h"
+
+#include "pn532.h"
+
+static bool pn532_loopback_writeframe(pn532_t *obj, const uint8_t *frame, uint8_t len);
+static uint8_t pn532_loopback_readframe(pn532_t *obj, uint8_t *buff, uint8_t maxlen);
+static bool pn532_loopback_isready(pn532_t *obj);
+static void pn532_loopback_wakeup(pn532_t *obj);
+
+static const uint8_t pn532_loopback_ack[] = {0x00, 0x00, 0xFF, 0x00, 0xFF, 0x00};
+
+const pn532_transport_t pn532_transport_loopback = {
+    .write = pn532_loopback_writeframe,
+    .read = pn532_loopback_readframe,
+    .isready = pn532_loopback_isready,
+    .wakeup = pn532_loopback_wakeup,
+};
+
+/**************************************************************************/
+/*!
+    @brief  Connects the PN532 object to an in-memory stand-in instead of a
+            bus. Every command frame is ACKed and handed to peer(), whose
+            answer is returned as a normal response frame. Lets the command
+            layer run (and be timed) without hardware.
+
+    @param  bus       State of the stand-in, owned by the caller
+    @param  peer      Command handler playing the PN532
+    @param  ctx       Passed to peer
+*/
+/**************************************************************************/
+void pn532_loopback_init(pn532_t *obj, pn532_loopback_t *bus, pn532_loopback_peer_t peer, void *ctx)
+{
+    memset(bus, 0, sizeof(*bus));
+    bus->peer = peer;
+    bus->ctx = ctx;
+
+    obj->_transport = &pn532_transport_loopback;
+    obj->_loopback = bus;
+    obj->_spi = NULL;
+    obj->_irq = -1;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Takes a host frame, queues the ACK and the peer's response. An
+            ACK frame from the host drops what is queued.
+*/
+/**************************************************************************/
+bool pn532_loopback_writeframe(pn532_t *obj, const uint8_t *frame, uint8_t len)
+{
+    pn532_loopback_t *bus = obj->_loopback;
+    uint8_t resp[PN532_PACKBUFFSIZ];
+
+    if (len == sizeof(pn532_loopback_ack) && memcmp(frame, pn532_loopback_ack, len) == 0)
+    {
+        // ACK from the host aborts the command in progress
+        bus->ackpending = false;
+        bus->rxlen = 0;
+        bus->aborts++;
+        return true;
+    }
+    if (len < 8 || frame[2] != PN532_STARTCODE2 || frame[5] != PN532_HOSTTOPN532 || frame[3] + 7 != len)
+    {
+        return false;
+    }
+
+    uint8_t rlen = bus->peer(bus->ctx, frame + 6, frame[3] - 1, resp);
+    if (rlen + 8 > PN532_PACKBUFFSIZ) // frame length must fit rxlen
+    {
+        rlen = 0;
+    }
+
+    bus->ackpending = true;
+    bus->rxlen = 0;
+    if (rlen)
+    {
+        uint8_t checksum = PN532_PN532TOHOST;
+        uint8_t *p = bus->rx;
+
+        *p++ = PN532_PREAMBLE;
+        *p++ = PN532_STARTCODE1;
+        *p++ = PN532_STARTCODE2;
+        *p++ = rlen + 1;
+        *p++ = ~(rlen + 1) + 1;
+        *p++ = PN532_PN532TOHOST;
+        for (uint8_t i = 0; i < rlen; i++)
+        {
+            *p++ = resp[i];
+            checksum += resp[i];
+        }
+        *p++ = ~checksum + 1;
+        *p++ = PN532_POSTAMBLE;
+        bus->rxlen = p - bus->rx;
+    }
+    return true;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Hands out the pending ACK, then the pending response
+*/
+/**************************************************************************/
+uint8_t pn532_loopback_readframe(pn532_t *obj, uint8_t *buff, uint8_t maxlen)
+{
+    pn532_loopback_t *bus = obj->_loopback;
+    uint8_t n = 0;
+
+    if (bus->ackpending)
+    {
+        n = sizeof(pn532_loopback_ack);
+        memcpy(buff, pn532_loopback_ack, n);
+        bus->ackpending = false;
+    }
+    else if (bus->rxlen)
+    {
+        n = bus->rxlen < maxlen ? bus->rxlen : maxlen;
+        memcpy(buff, bus->rx, n);
+        bus->rxlen = 0;
+    }
+    return n;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Ready while an ACK or a response is queued
+*/
+/**************************************************************************/
+bool pn532_loopback_isready(pn532_t *obj)
+{
+    return obj->_loopback->ackpending || obj->_loopback->rxlen;
+}
+
+/**************************************************************************/
+/*!
+    @brief  Nothing to wake
+*/
+/**************************************************************************/
+void pn532_loopback_wakeup(pn532_t *obj)
+{
+}
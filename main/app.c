@@ -15,6 +15,10 @@
 
 #include "pn532.h"
 #include "NFC_reader.h"
+#include "NFC_crc.h"
+#include "NFC_mac.h"
+#include "NFC_watch.h"
+#include "NFC_ring.h"
 
 
 typedef unsigned char byte;
@@ -29,49 +33,166 @@ typedef unsigned char byte;
 
 static const char *TAG = "APP";
 
+#ifdef CONFIG_NFC_RADIO_CORE
+#define RADIOCORE CONFIG_NFC_RADIO_CORE
+#define APPCORE (1 - CONFIG_NFC_RADIO_CORE)
+#else
+#define RADIOCORE 0
+#define APPCORE 0
+#endif
+#ifdef CONFIG_NFC_RING_SLOTS
+#define RINGSLOTS CONFIG_NFC_RING_SLOTS
+#else
+#define RINGSLOTS 4
+#endif
+#define RINGBLOCKS (256 * 4 / sizeof(TDataNFC)) // cela karta, 256 stranek po 4 B
+#define RADIOPOLL 20                             // ms, jak casto radio prebira zapisy od aplikace
+
 static pn532_t nfc;
+static TNFCSession session;
+static TNFCWatch watch;
+static TNFCRing toApp;   // karty a jejich obsah: radio -> aplikace
+static TNFCRing toRadio; // zmeneny obsah k zapisu: aplikace -> radio
 
 bool authenticated = false;
 
 
+/*
+  Zapise na kartu obsah, ktery poslala aplikace, pokud je karta stale prilozena
+*/
+static void radio_write(TCardInfo *aCard)
+{
+  TNFCRecord *record;
+  while ((record = NFC_RingPeek(&toRadio)) != NULL)
+  {
+    NFC_WatchLock(&watch, portMAX_DELAY);
+    if (aCard->sDataNFC != NULL && session.sUidLength == record->sEvent.sUidLength && memcmp(session.sUid, record->sEvent.sUid, session.sUidLength) == 0)
+    {
+      size_t blocks = record->sNumOfBlocks < aCard->sNumOfBlocks ? record->sNumOfBlocks : aCard->sNumOfBlocks;
+      memcpy(aCard->sDataNFC, record->sData, blocks * sizeof(TDataNFC));
+      if(NFC_MarkDirty(aCard) != 0)
+      {
+        ESP_LOGI(TAG,"Hodnoty jsou jiné, zapisuji");
+        NFC_Flush(&session, aCard);
+      }
+    }
+    else
+    {
+      ESP_LOGW(TAG,"Karta uz neni prilozena, zapis se zahazuje");
+    }
+    NFC_WatchUnlock(&watch);
+    NFC_RingRelease(&toRadio);
+  }
+}
 
-
-
-void nfc_task(void *pvParameter)
+/*
+  Radio: sbernice, protokol a obsah karty, na jadre RADIOCORE
+*/
+void radio_task(void *pvParameter)
 {
   TCardInfo Karta1;
-  NFC_init(&nfc, 20, &Karta1,PN532_SCK, PN532_MISO, PN532_MOSI, PN532_SS);
-  NFC_LoadNFC(&nfc, &Karta1);
-  
+  TNFCEvent event;
+  // kapacita 0: velikost dat se urci podle prilozene karty
+  NFC_init(&nfc, 0, &Karta1,PN532_SCK, PN532_MISO, PN532_MOSI, PN532_SS);
+  // prilozeni a odebrani karty hlida PN532 sam, uloha spi ve fronte
+  NFC_WatchStart(&watch, &session, &nfc, 4, 6, RADIOCORE);
+
   while (1)
   {
-   
-    if(NFC_CheckStructIsSame(&nfc,&Karta1,1) != 0)
+    radio_write(&Karta1);
+    if (xQueueReceive(watch.sEvents, &event, pdMS_TO_TICKS(RADIOPOLL)) != pdTRUE)
     {
-      ESP_LOGI(TAG,"Hodnoty jsou jiné, zapisuji");
-
-      NFC_WriteAndCheck(&nfc,&Karta1,1);
-      
+      continue;
     }
-    else
+    TNFCRecord *record = NFC_RingReserve(&toApp);
+    if (record == NULL)
     {
-      if(Karta1.sDataNFC[1].AA >= 0x10)
-      {ESP_LOGI(TAG,"Hodnota je 10, nuluju");
-        Karta1.sDataNFC[1].AA = 0x0;
+      // aplikace nestiha, radio na ni neceka
+      ESP_LOGW(TAG,"Fronta do aplikace je plna, udalost se zahazuje");
+      continue;
+    }
+    record->sEvent = event;
+    record->sLoaded = false;
+    record->sNumOfBlocks = 0;
+    if (event.sType == NFC_EVENT_ARRIVED)
+    {
+      NFC_WatchLock(&watch, portMAX_DELAY);
+      if (NFC_LoadNFC(&session, &Karta1))
+      {
+#ifdef CONFIG_NFC_BENCHMARK
+        // jednou, na prvni nactene karte; zapise se, co se prave precetlo
+        static bool benchmarked = false;
+        if (!benchmarked)
+        {
+          benchmarked = true;
+          NFC_WriteBenchmark(&session, &Karta1);
+        }
+#endif
+        record->sNumOfBlocks = Karta1.sNumOfBlocks < toApp.sMaxBlocks ? Karta1.sNumOfBlocks : toApp.sMaxBlocks;
+        memcpy(record->sData, Karta1.sDataNFC, record->sNumOfBlocks * sizeof(TDataNFC));
+        record->sLoaded = true;
       }
-      else
+      NFC_WatchUnlock(&watch);
+    }
+    NFC_RingCommit(&toApp);
+  }
+}
+
+/*
+  Aplikace: zpracovani obsahu karet, na jadre APPCORE
+*/
+void app_task(void *pvParameter)
+{
+  TNFCRecord *record;
+  while (1)
+  {
+    record = NFC_RingPeek(&toApp);
+    if (record == NULL)
+    {
+      ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+      continue;
+    }
+    if (record->sEvent.sType == NFC_EVENT_REMOVED)
+    {
+      ESP_LOGI(TAG,"Karta odebrana");
+    }
+    else if (record->sLoaded && record->sNumOfBlocks > 1)
+    {
+      TNFCRecord *out = NFC_RingReserve(&toRadio);
+      if (out != NULL)
       {
-        ESP_LOGI(TAG,"Zvetsuji hodnotu o 1. Aktualní hodnota: %x",Karta1.sDataNFC[1].AA);
-        Karta1.sDataNFC[1].AA = Karta1.sDataNFC[1].AA +1;
+        out->sEvent = record->sEvent;
+        out->sNumOfBlocks = record->sNumOfBlocks;
+        memcpy(out->sData, record->sData, record->sNumOfBlocks * sizeof(TDataNFC));
+        if(out->sData[1].AA >= 0x10)
+        {ESP_LOGI(TAG,"Hodnota je 10, nuluju");
+          out->sData[1].AA = 0x0;
+        }
+        else
+        {
+          ESP_LOGI(TAG,"Zvetsuji hodnotu o 1. Aktualní hodnota: %x",out->sData[1].AA);
+          out->sData[1].AA = out->sData[1].AA +1;
+        }
+        NFC_RingCommit(&toRadio);
       }
     }
-    vTaskDelay(1000 / portTICK_PERIOD_MS);
+    NFC_RingRelease(&toApp);
   }
-  // configure board to read RFID tags
-  
 }
 
 void app_main()
 {
-  xTaskCreate(&nfc_task, "nfc_task", 4096, NULL, 4, NULL);
+  TaskHandle_t appTask;
+#ifdef CONFIG_NFC_BENCHMARK
+  NFC_CrcBenchmark();
+  NFC_MacBenchmark();
+#endif
+  if (!NFC_RingInit(&toApp, RINGSLOTS, RINGBLOCKS) || !NFC_RingInit(&toRadio, RINGSLOTS, RINGBLOCKS))
+  {
+    ESP_LOGE(TAG,"Nedostatek pameti pro fronty");
+    return;
+  }
+  xTaskCreatePinnedToCore(&app_task, "app_task", 4096, NULL, 4, &appTask, APPCORE);
+  toApp.sConsumer = appTask;
+  xTaskCreatePinnedToCore(&radio_task, "radio_task", 4096, NULL, 5, NULL, RADIOCORE);
 }
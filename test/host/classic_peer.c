@@ -0,0 +1,104 @@
+#include <string.h>
+
+#include "classic_peer.h"
+
+#define STATUS_OK 0x00
+#define STATUS_AUTH 0x14 // MIFARE authentication error
+
+static const uint8_t sFactoryKey[6] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+
+void ClassicPeerInit(TClassicPeer *aPeer)
+{
+  memset(aPeer, 0, sizeof(*aPeer));
+  aPeer->sUid[0] = 0xDE;
+  aPeer->sUid[1] = 0xAD;
+  aPeer->sUid[2] = 0xBE;
+  aPeer->sUid[3] = 0xEF;
+  memcpy(aPeer->sMem, aPeer->sUid, 4);
+  for (int iSector = 0; iSector < CLASSIC_PEER_BLOCKS / 4; iSector++)
+  {
+    uint8_t *iTrailer = aPeer->sMem + (iSector * 4 + 3) * 16;
+    memcpy(iTrailer, sFactoryKey, 6);
+    iTrailer[6] = 0xFF;
+    iTrailer[7] = 0x07;
+    iTrailer[8] = 0x80;
+    iTrailer[9] = 0x69;
+    memcpy(iTrailer + 10, sFactoryKey, 6);
+  }
+  aPeer->sAuthSector = -1;
+  aPeer->sWatchBlock = -1;
+}
+
+uint8_t ClassicPeer(void *aCtx, const uint8_t *aCmd, uint8_t aCmdLen, uint8_t *aResp)
+{
+  TClassicPeer *peer = (TClassicPeer *)aCtx;
+
+  aResp[0] = aCmd[0] + 1;
+  switch (aCmd[0])
+  {
+  case 0x02: // GetFirmwareVersion
+    aResp[1] = 0x32;
+    aResp[2] = 0x01;
+    aResp[3] = 0x06;
+    aResp[4] = 0x07;
+    return 5;
+  case 0x14: // SAMConfiguration
+  case 0x32: // RFConfiguration
+    return 1;
+  case 0x44: // InDeselect
+  case 0x52: // InRelease
+    peer->sAuthSector = -1;
+    aResp[1] = STATUS_OK;
+    return 2;
+  case 0x4A: // InListPassiveTarget: selecting the tag again drops the authentication
+    peer->sAuthSector = -1;
+    aResp[1] = 1;
+    aResp[2] = 1;    // Tg
+    aResp[3] = 0x00; // ATQA
+    aResp[4] = 0x04;
+    aResp[5] = 0x08; // SAK: Classic 1K
+    aResp[6] = sizeof(peer->sUid);
+    memcpy(aResp + 7, peer->sUid, sizeof(peer->sUid));
+    return 7 + sizeof(peer->sUid);
+  case 0x40: // InDataExchange: Tg, tag command, block
+    if (aCmdLen < 4 || aCmd[3] >= CLASSIC_PEER_BLOCKS)
+    {
+      aResp[1] = STATUS_AUTH;
+      return 2;
+    }
+    if (aCmd[2] == 0x60 || aCmd[2] == 0x61)
+    {
+      bool iOk = aCmdLen >= 10 && memcmp(aCmd + 4, sFactoryKey, 6) == 0;
+      peer->sAuthSector = iOk ? aCmd[3] / 4 : -1;
+      aResp[1] = iOk ? STATUS_OK : STATUS_AUTH;
+      return 2;
+    }
+    if (peer->sAuthSector != aCmd[3] / 4)
+    {
+      aResp[1] = STATUS_AUTH;
+      return 2;
+    }
+    if (aCmd[2] == 0x30)
+    {
+      aResp[1] = STATUS_OK;
+      memcpy(aResp + 2, peer->sMem + aCmd[3] * 16, 16);
+      return 18;
+    }
+    if (aCmd[2] == 0xA0 && aCmdLen >= 20 && !peer->sReadOnly)
+    {
+      static const uint8_t iZero[4] = {0};
+      if (aCmd[3] == peer->sWatchBlock && memcmp(aCmd + 4 + 12, iZero, 4) == 0)
+      {
+        peer->sWatchZero++;
+      }
+      memcpy(peer->sMem + aCmd[3] * 16, aCmd + 4, 16);
+      peer->sWrites++;
+      aResp[1] = STATUS_OK;
+      return 2;
+    }
+    aResp[1] = STATUS_AUTH;
+    return 2;
+  default:
+    return 0;
+  }
+}
@@ -0,0 +1,27 @@
+/*
+    PN532 stand-in with one MIFARE Classic 1K in the field, for the
+    loopback transport. Every sector opens with the factory key
+    FF FF FF FF FF FF (A or B); READ and WRITE need the sector of the
+    block to be authenticated, otherwise the PN532 reports an error as
+    for a real tag.
+*/
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define CLASSIC_PEER_BLOCKS 64
+
+typedef struct
+{
+  uint8_t sMem[CLASSIC_PEER_BLOCKS * 16];
+  uint8_t sUid[4];
+  int sAuthSector;  // -1 none
+  bool sReadOnly;   // access bits forbid writing, WRITE is refused
+  uint32_t sWrites; // blocks written
+  int sWatchBlock;  // block whose last page is watched, -1 none
+  uint32_t sWatchZero; // writes that left the last page of sWatchBlock zero
+} TClassicPeer;
+
+void ClassicPeerInit(TClassicPeer *aPeer);
+uint8_t ClassicPeer(void *aCtx, const uint8_t *aCmd, uint8_t aCmdLen, uint8_t *aResp);
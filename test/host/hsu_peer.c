@@ -0,0 +1,148 @@
+#include <string.h>
+
+#include "hsu_peer.h"
+#include "host_uart.h"
+
+static const uint32_t sRates[] = {9600, 19200, 38400, 57600, 115200, 230400, 460800, 921600, 1288000};
+static const uint8_t sAck[] = {0x00, 0x00, 0xFF, 0x00, 0xFF, 0x00};
+
+// ACK and the answer in one go, at the current rate
+static void HsuPeerAnswer(THsuPeer *aPeer, const uint8_t *aCmd, uint8_t aCmdLen)
+{
+  uint8_t iResp[PN532_PACKBUFFSIZ];
+  uint8_t iOut[sizeof(sAck) + PN532_PACKBUFFSIZ + 8];
+  uint8_t iLen;
+
+  if (aCmd[0] == PN532_COMMAND_SETSERIALBAUDRATE)
+  {
+    if (aCmdLen < 2 || aCmd[1] >= sizeof(sRates) / sizeof(sRates[0]))
+    {
+      return;
+    }
+    aPeer->sPendingBaud = sRates[aCmd[1]];
+    iResp[0] = PN532_COMMAND_SETSERIALBAUDRATE + 1;
+    iLen = 1;
+  }
+  else
+  {
+    iLen = aPeer->sPeer(aPeer->sCtx, aCmd, aCmdLen, iResp);
+  }
+
+  uint8_t *p = iOut;
+  memcpy(p, sAck, sizeof(sAck));
+  p += sizeof(sAck);
+  if (iLen)
+  {
+    uint8_t iSum = PN532_PN532TOHOST;
+    *p++ = PN532_PREAMBLE;
+    *p++ = PN532_STARTCODE1;
+    *p++ = PN532_STARTCODE2;
+    *p++ = iLen + 1;
+    *p++ = ~(iLen + 1) + 1;
+    *p++ = PN532_PN532TOHOST;
+    for (uint8_t i = 0; i < iLen; i++)
+    {
+      *p++ = iResp[i];
+      iSum += iResp[i];
+    }
+    *p++ = ~iSum + 1;
+    *p++ = PN532_POSTAMBLE;
+  }
+  host_uart_send(aPeer->sFd, aPeer->sBaud, iOut, p - iOut);
+}
+
+// takes the complete frames out of sIn, start code 00 FF
+static void HsuPeerParse(THsuPeer *aPeer)
+{
+  uint8_t *b = aPeer->sIn;
+
+  while (1)
+  {
+    size_t i = 0;
+    while (i + 1 < aPeer->sInLen && !(b[i] == 0x00 && b[i + 1] == 0xFF))
+    {
+      i++;
+    }
+    memmove(b, b + i, aPeer->sInLen - i);
+    aPeer->sInLen -= i;
+    if (aPeer->sInLen < 4)
+    {
+      return;
+    }
+    uint8_t iLen = b[2];
+    if (iLen == 0x00 && b[3] == 0xFF)
+    {
+      // host ACK: a pending rate change applies now
+      if (aPeer->sPendingBaud)
+      {
+        aPeer->sBaud = aPeer->sPendingBaud;
+        aPeer->sPendingBaud = 0;
+        aPeer->sSwitches++;
+      }
+      memmove(b, b + 4, aPeer->sInLen - 4);
+      aPeer->sInLen -= 4;
+      continue;
+    }
+    if ((uint8_t)(iLen + b[3]) != 0 || iLen < 2)
+    {
+      memmove(b, b + 1, aPeer->sInLen - 1);
+      aPeer->sInLen -= 1;
+      continue;
+    }
+    if (aPeer->sInLen < 4u + iLen + 1)
+    {
+      return;
+    }
+    uint8_t iSum = 0;
+    for (uint8_t k = 0; k <= iLen; k++)
+    {
+      iSum += b[4 + k];
+    }
+    if (iSum == 0 && b[4] == PN532_HOSTTOPN532)
+    {
+      HsuPeerAnswer(aPeer, b + 5, iLen - 1);
+    }
+    memmove(b, b + 4 + iLen + 1, aPeer->sInLen - (4 + iLen + 1));
+    aPeer->sInLen -= 4 + iLen + 1;
+  }
+}
+
+static void *HsuPeerTask(void *aArg)
+{
+  THsuPeer *iPeer = (THsuPeer *)aArg;
+  uint8_t iData[512];
+  uint32_t iBaud;
+  int n;
+
+  while ((n = host_uart_recv(iPeer->sFd, &iBaud, iData, sizeof(iData))) >= 0)
+  {
+    if (iBaud != iPeer->sBaud)
+    {
+      iPeer->sGarbled++;
+      continue;
+    }
+    if (iPeer->sInLen + n > sizeof(iPeer->sIn))
+    {
+      iPeer->sInLen = 0;
+    }
+    memcpy(iPeer->sIn + iPeer->sInLen, iData, n);
+    iPeer->sInLen += n;
+    HsuPeerParse(iPeer);
+  }
+  return NULL;
+}
+
+bool HsuPeerStart(THsuPeer *aPeer, int aFd, uint32_t aBaud, pn532_loopback_peer_t aDevice, void *aCtx)
+{
+  memset(aPeer, 0, sizeof(*aPeer));
+  aPeer->sFd = aFd;
+  aPeer->sBaud = aBaud;
+  aPeer->sPeer = aDevice;
+  aPeer->sCtx = aCtx;
+  if (pthread_create(&aPeer->sThread, NULL, HsuPeerTask, aPeer) != 0)
+  {
+    return false;
+  }
+  pthread_detach(aPeer->sThread);
+  return true;
+}
@@ -0,0 +1,31 @@
+/*
+    PN532 at the other end of a host_uart line, speaking HSU: it finds the
+    frames in the byte stream (the 0x55 wake-up and long preambles
+    included), ACKs every command and answers through a loopback peer such
+    as TagPeer. SetSerialBaudRate is handled here: the answer goes out at
+    the old rate and the new one applies once the host ACKs it, as on the
+    chip.
+*/
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#include "pn532.h"
+
+typedef struct
+{
+  int sFd;
+  uint32_t sBaud;           // rate the PN532 listens and answers at
+  uint32_t sPendingBaud;    // SetSerialBaudRate waiting for the host ACK, 0 none
+  pn532_loopback_peer_t sPeer;
+  void *sCtx;
+  uint8_t sIn[PN532_PACKBUFFSIZ + 64];
+  size_t sInLen;
+  uint32_t sGarbled;        // messages lost to a rate mismatch
+  uint32_t sSwitches;       // rate changes applied
+  pthread_t sThread;
+} THsuPeer;
+
+bool HsuPeerStart(THsuPeer *aPeer, int aFd, uint32_t aBaud, pn532_loopback_peer_t aDevice, void *aCtx);
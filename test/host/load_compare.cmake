@@ -0,0 +1,18 @@
+# Runs test_load against the current and the legacy SPI timing and
+# reports both NFC_LoadNFC times. Fails if either run fails or the
+# current code is not faster.
+foreach(variant CURRENT LEGACY)
+  execute_process(COMMAND ${${variant}} OUTPUT_VARIABLE out RESULT_VARIABLE rc)
+  message("${out}")
+  if(NOT rc EQUAL 0)
+    message(FATAL_ERROR "${${variant}} failed")
+  endif()
+  string(REGEX MATCH "NFC_LoadNFC [a-z]+: ([0-9]+) us" match "${out}")
+  set(${variant}_US ${CMAKE_MATCH_1})
+endforeach()
+
+math(EXPR speedup "${LEGACY_US} / ${CURRENT_US}")
+message("NFC_LoadNFC: ${LEGACY_US} us with the tick delays, ${CURRENT_US} us without, ${speedup}x faster")
+if(NOT CURRENT_US LESS LEGACY_US)
+  message(FATAL_ERROR "no speed-up")
+endif()
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_rom_gpio.h"
+
+// no pins on the host: levels read back as 1, interrupts never fire
+typedef int gpio_num_t;
+typedef enum { GPIO_MODE_INPUT, GPIO_MODE_OUTPUT } gpio_mode_t;
+typedef enum { GPIO_INTR_DISABLE, GPIO_INTR_POSEDGE, GPIO_INTR_NEGEDGE, GPIO_INTR_ANYEDGE } gpio_int_type_t;
+typedef enum { GPIO_PULLUP_ONLY, GPIO_FLOATING } gpio_pull_mode_t;
+typedef void (*gpio_isr_t)(void *);
+
+esp_err_t gpio_set_level(gpio_num_t pin, uint32_t level);
+int gpio_get_level(gpio_num_t pin);
+esp_err_t gpio_set_direction(gpio_num_t pin, gpio_mode_t mode);
+esp_err_t gpio_set_pull_mode(gpio_num_t pin, gpio_pull_mode_t pull);
+esp_err_t gpio_set_intr_type(gpio_num_t pin, gpio_int_type_t type);
+esp_err_t gpio_install_isr_service(int flags);
+esp_err_t gpio_isr_handler_add(gpio_num_t pin, gpio_isr_t isr, void *arg);
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+// one fake bus with a PN532 on it, see host_spi.c
+typedef int spi_host_device_t;
+#define SPI2_HOST 1
+#define SPI3_HOST 2
+#define SPI_DMA_CH_AUTO 3
+#define SPI_DEVICE_BIT_LSBFIRST (1 << 4)
+
+typedef struct
+{
+    int mosi_io_num, miso_io_num, sclk_io_num, quadwp_io_num, quadhd_io_num;
+    int max_transfer_sz;
+    uint32_t flags;
+} spi_bus_config_t;
+
+typedef struct
+{
+    uint8_t mode;
+    int clock_speed_hz;
+    int spics_io_num;
+    uint32_t flags;
+    int queue_size;
+} spi_device_interface_config_t;
+
+typedef struct
+{
+    uint32_t flags;
+    size_t length;
+    size_t rxlength;
+    const void *tx_buffer;
+    void *rx_buffer;
+} spi_transaction_t;
+
+typedef struct spi_device_t *spi_device_handle_t;
+
+esp_err_t spi_bus_initialize(spi_host_device_t host, const spi_bus_config_t *cfg, int dma);
+esp_err_t spi_bus_add_device(spi_host_device_t host, const spi_device_interface_config_t *cfg, spi_device_handle_t *handle);
+esp_err_t spi_bus_remove_device(spi_device_handle_t handle);
+esp_err_t spi_device_acquire_bus(spi_device_handle_t handle, uint32_t wait);
+void spi_device_release_bus(spi_device_handle_t handle);
+esp_err_t spi_device_polling_transmit(spi_device_handle_t handle, spi_transaction_t *trans);
@@ -0,0 +1,5 @@
+#pragma once
+
+#include <stdint.h>
+
+void esp_rom_gpio_pad_select_gpio(uint32_t pin);
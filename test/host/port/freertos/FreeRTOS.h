@@ -0,0 +1,26 @@
+/*
+    Host port: the part of the FreeRTOS API the PN532 and NFC_Reader
+    components use, on top of pthreads (host_port.c). One tick is 1 ms.
+*/
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS 1
+#define pdFAIL 0
+#define portMAX_DELAY 0xFFFFFFFFu
+#define configTICK_RATE_HZ 1000
+#define portTICK_PERIOD_MS 1
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+#define portYIELD_FROM_ISR(x) (void)(x)
+#define tskNO_AFFINITY 0x7FFFFFFF
+#define IRAM_ATTR
+#define DRAM_ATTR
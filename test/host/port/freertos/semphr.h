@@ -0,0 +1,12 @@
+#pragma once
+
+#include "queue.h"
+
+// semaphores are queues of empty items, as in FreeRTOS
+typedef QueueHandle_t SemaphoreHandle_t;
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void);
+SemaphoreHandle_t xSemaphoreCreateBinary(void);
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem);
+#define vSemaphoreDelete(sem) vQueueDelete(sem)
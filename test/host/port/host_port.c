@@ -0,0 +1,326 @@
+/*
+    Host port of the FreeRTOS/ESP-IDF calls used by the PN532 and NFC_Reader
+    components. Tasks are pthreads, queues and semaphores are a mutex and a
+    condition variable, ticks are milliseconds of CLOCK_MONOTONIC. There is
+    no hardware: GPIO reads 1, mbedtls calls fail. SPI goes to the fake
+    PN532 bus in host_spi.c, UART to the socket line in host_uart.c.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "driver/gpio.h"
+#include "esp_heap_caps.h"
+#include "esp_rom_sys.h"
+#include "esp_timer.h"
+#include "mbedtls/md.h"
+
+struct host_task
+{
+    pthread_t thread;
+    TaskFunction_t fn;
+    void *arg;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint32_t notify;
+};
+
+struct host_queue
+{
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint8_t *items;
+    UBaseType_t length;
+    UBaseType_t itemsize;
+    UBaseType_t head;
+    UBaseType_t count;
+};
+
+static __thread struct host_task *sCurrent;
+
+/* ---- time ---- */
+
+int64_t esp_timer_get_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    return (TickType_t)(esp_timer_get_time() / 1000);
+}
+
+void esp_rom_delay_us(uint32_t us)
+{
+    usleep(us);
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    usleep((useconds_t)ticks * 1000);
+}
+
+// absolute deadline for pthread_cond_timedwait
+static struct timespec host_deadline(TickType_t ticks)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += ticks / 1000;
+    ts.tv_nsec += (long)(ticks % 1000) * 1000000;
+    if (ts.tv_nsec >= 1000000000)
+    {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000;
+    }
+    return ts;
+}
+
+// false once the deadline passed
+static int host_wait(pthread_cond_t *cond, pthread_mutex_t *lock, TickType_t ticks, const struct timespec *deadline)
+{
+    if (ticks == portMAX_DELAY)
+        return pthread_cond_wait(cond, lock) == 0;
+    return pthread_cond_timedwait(cond, lock, deadline) != ETIMEDOUT;
+}
+
+/* ---- tasks ---- */
+
+static struct host_task *host_task_new(void)
+{
+    struct host_task *task = calloc(1, sizeof(*task));
+    pthread_mutex_init(&task->lock, NULL);
+    pthread_cond_init(&task->cond, NULL);
+    return task;
+}
+
+static void *host_task_entry(void *arg)
+{
+    struct host_task *task = arg;
+    sCurrent = task;
+    task->fn(task->arg);
+    return NULL;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack, void *arg, UBaseType_t prio, TaskHandle_t *handle, BaseType_t core)
+{
+    struct host_task *task = host_task_new();
+    task->fn = fn;
+    task->arg = arg;
+    if (handle != NULL)
+        *handle = task;
+    if (pthread_create(&task->thread, NULL, host_task_entry, task) != 0)
+        return pdFAIL;
+    pthread_detach(task->thread);
+    return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack, void *arg, UBaseType_t prio, TaskHandle_t *handle)
+{
+    return xTaskCreatePinnedToCore(fn, name, stack, arg, prio, handle, tskNO_AFFINITY);
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+    if (task == NULL || task == sCurrent)
+        pthread_exit(NULL);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    // the main thread becomes a task the first time it asks
+    if (sCurrent == NULL)
+        sCurrent = host_task_new();
+    return sCurrent;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+    pthread_mutex_lock(&task->lock);
+    task->notify++;
+    pthread_cond_signal(&task->cond);
+    pthread_mutex_unlock(&task->lock);
+    return pdPASS;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *woken)
+{
+    xTaskNotifyGive(task);
+    if (woken != NULL)
+        *woken = pdFALSE;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t ticks)
+{
+    struct host_task *task = xTaskGetCurrentTaskHandle();
+    struct timespec deadline = host_deadline(ticks);
+    uint32_t value;
+
+    pthread_mutex_lock(&task->lock);
+    while (task->notify == 0 && ticks != 0)
+    {
+        if (!host_wait(&task->cond, &task->lock, ticks, &deadline))
+            break;
+    }
+    value = task->notify;
+    if (value != 0)
+        task->notify = clear ? 0 : value - 1;
+    pthread_mutex_unlock(&task->lock);
+    return value;
+}
+
+/* ---- queues and semaphores ---- */
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemsize)
+{
+    struct host_queue *queue = calloc(1, sizeof(*queue));
+    if (queue == NULL)
+        return NULL;
+    queue->items = calloc(length, itemsize ? itemsize : 1);
+    queue->length = length;
+    queue->itemsize = itemsize;
+    pthread_mutex_init(&queue->lock, NULL);
+    pthread_cond_init(&queue->cond, NULL);
+    return queue;
+}
+
+void vQueueDelete(QueueHandle_t queue)
+{
+    pthread_mutex_destroy(&queue->lock);
+    pthread_cond_destroy(&queue->cond);
+    free(queue->items);
+    free(queue);
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks)
+{
+    struct timespec deadline = host_deadline(ticks);
+    BaseType_t ok = pdFALSE;
+
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == queue->length && ticks != 0)
+    {
+        if (!host_wait(&queue->cond, &queue->lock, ticks, &deadline))
+            break;
+    }
+    if (queue->count < queue->length)
+    {
+        UBaseType_t tail = (queue->head + queue->count) % queue->length;
+        if (queue->itemsize)
+            memcpy(queue->items + tail * queue->itemsize, item, queue->itemsize);
+        queue->count++;
+        pthread_cond_broadcast(&queue->cond);
+        ok = pdTRUE;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return ok;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks)
+{
+    struct timespec deadline = host_deadline(ticks);
+    BaseType_t ok = pdFALSE;
+
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == 0 && ticks != 0)
+    {
+        if (!host_wait(&queue->cond, &queue->lock, ticks, &deadline))
+            break;
+    }
+    if (queue->count != 0)
+    {
+        if (queue->itemsize && item != NULL)
+            memcpy(item, queue->items + queue->head * queue->itemsize, queue->itemsize);
+        queue->head = (queue->head + 1) % queue->length;
+        queue->count--;
+        pthread_cond_broadcast(&queue->cond);
+        ok = pdTRUE;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return ok;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue)
+{
+    UBaseType_t count;
+    pthread_mutex_lock(&queue->lock);
+    count = queue->count;
+    pthread_mutex_unlock(&queue->lock);
+    return count;
+}
+
+BaseType_t xQueueReset(QueueHandle_t queue)
+{
+    pthread_mutex_lock(&queue->lock);
+    queue->head = 0;
+    queue->count = 0;
+    pthread_cond_broadcast(&queue->cond);
+    pthread_mutex_unlock(&queue->lock);
+    return pdPASS;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void)
+{
+    return xQueueCreate(1, 0);
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    SemaphoreHandle_t sem = xQueueCreate(1, 0);
+    if (sem != NULL)
+        xQueueSend(sem, NULL, 0);
+    return sem;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks)
+{
+    return xQueueReceive(sem, NULL, ticks);
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem)
+{
+    return xQueueSend(sem, NULL, 0);
+}
+
+/* ---- heap ---- */
+
+void *heap_caps_malloc(size_t size, uint32_t caps)
+{
+    return malloc(size);
+}
+
+void heap_caps_free(void *ptr)
+{
+    free(ptr);
+}
+
+/* ---- GPIO ---- */
+
+esp_err_t gpio_set_level(gpio_num_t pin, uint32_t level) { return ESP_OK; }
+int gpio_get_level(gpio_num_t pin) { return 1; }
+esp_err_t gpio_set_direction(gpio_num_t pin, gpio_mode_t mode) { return ESP_OK; }
+esp_err_t gpio_set_pull_mode(gpio_num_t pin, gpio_pull_mode_t pull) { return ESP_OK; }
+esp_err_t gpio_set_intr_type(gpio_num_t pin, gpio_int_type_t type) { return ESP_OK; }
+esp_err_t gpio_install_isr_service(int flags) { return ESP_ERR_NOT_SUPPORTED; }
+esp_err_t gpio_isr_handler_add(gpio_num_t pin, gpio_isr_t isr, void *arg) { return ESP_ERR_NOT_SUPPORTED; }
+void esp_rom_gpio_pad_select_gpio(uint32_t pin) {}
+
+/* ---- mbedtls ---- */
+
+const mbedtls_md_info_t *mbedtls_md_info_from_type(mbedtls_md_type_t type) { return NULL; }
+void mbedtls_md_init(mbedtls_md_context_t *ctx) { ctx->info = NULL; }
+void mbedtls_md_free(mbedtls_md_context_t *ctx) {}
+int mbedtls_md_setup(mbedtls_md_context_t *ctx, const mbedtls_md_info_t *info, int hmac) { return MBEDTLS_ERR_MD_FEATURE_UNAVAILABLE; }
+int mbedtls_md_hmac_starts(mbedtls_md_context_t *ctx, const unsigned char *key, size_t keylen) { return MBEDTLS_ERR_MD_FEATURE_UNAVAILABLE; }
+int mbedtls_md_hmac_update(mbedtls_md_context_t *ctx, const unsigned char *input, size_t len) { return MBEDTLS_ERR_MD_FEATURE_UNAVAILABLE; }
+int mbedtls_md_hmac_finish(mbedtls_md_context_t *ctx, unsigned char *output) { return MBEDTLS_ERR_MD_FEATURE_UNAVAILABLE; }
+int mbedtls_md_hmac_reset(mbedtls_md_context_t *ctx) { return MBEDTLS_ERR_MD_FEATURE_UNAVAILABLE; }
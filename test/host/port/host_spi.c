@@ -0,0 +1,241 @@
+/*
+    Fake spi_master bus with one PN532 on it. The device has to be set up
+    the way the PN532 wants it: with SPI_DEVICE_BIT_LSBFIRST missing every
+    byte reaches the chip (and comes back) bit-reversed, as on the wire.
+
+    One spi_device_acquire_bus / spi_device_release_bus pair is one SS low
+    window. Its first byte is the direction: DW takes a command frame, which
+    is checked and handed to the peer when the window closes; SR clocks back
+    the status byte; DR clocks back the pending ACK, then in the next DR
+    window the pending response, across as many transactions as the host
+    needs. Bytes beyond the frame read as 0.
+*/
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "driver/spi_master.h"
+#include "host_spi.h"
+
+#define HOST_SPI_DW 0x01
+#define HOST_SPI_SR 0x02
+#define HOST_SPI_DR 0x03
+#define HOST_SPI_MAXFRAME 300
+
+struct spi_device_t
+{
+    uint32_t flags;
+};
+
+static pthread_mutex_t sBus = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t sStatsLock = PTHREAD_MUTEX_INITIALIZER;
+static int sBusUp;
+static host_spi_peer_t sPeer;
+static void *sCtx;
+static host_spi_stats_t sStats;
+
+// chip side, only touched while the bus is held
+static int sDir;            // direction of the open window, -1 none yet
+static uint32_t sWindowTx;  // transactions in the open window
+static uint8_t sIn[HOST_SPI_MAXFRAME];
+static size_t sInLen;
+static int sAckPending;
+static uint8_t sResp[HOST_SPI_MAXFRAME];
+static size_t sRespLen;
+static const uint8_t *sOut; // frame clocked back in this DR window
+static size_t sOutLen;
+static size_t sOutPos;
+
+static const uint8_t sAck[] = {0x00, 0x00, 0xFF, 0x00, 0xFF, 0x00};
+
+void host_spi_attach(host_spi_peer_t peer, void *ctx)
+{
+    pthread_mutex_lock(&sBus);
+    sPeer = peer;
+    sCtx = ctx;
+    sAckPending = 0;
+    sRespLen = 0;
+    pthread_mutex_unlock(&sBus);
+
+    pthread_mutex_lock(&sStatsLock);
+    memset(&sStats, 0, sizeof(sStats));
+    pthread_mutex_unlock(&sStatsLock);
+}
+
+host_spi_stats_t host_spi_stats(void)
+{
+    host_spi_stats_t stats;
+    pthread_mutex_lock(&sStatsLock);
+    stats = sStats;
+    pthread_mutex_unlock(&sStatsLock);
+    return stats;
+}
+
+// a byte as it crosses the wire: the PN532 sends and expects LSB first
+static uint8_t host_spi_wire(const struct spi_device_t *dev, uint8_t b)
+{
+    if (dev->flags & SPI_DEVICE_BIT_LSBFIRST)
+        return b;
+    uint8_t r = 0;
+    for (int i = 0; i < 8; i++)
+    {
+        if (b & (1 << i))
+            r |= 0x80 >> i;
+    }
+    return r;
+}
+
+// the frame of a closed DW window: 00 00 FF LEN LCS D4 cmd... DCS 00
+static void host_spi_command(void)
+{
+    uint8_t resp[HOST_SPI_MAXFRAME];
+    const uint8_t *f = sIn;
+    size_t len = sInLen;
+    uint8_t sum = 0;
+
+    if (len < 8 || f[0] != 0x00 || f[1] != 0x00 || f[2] != 0xFF || (uint8_t)(f[3] + f[4]) != 0 || f[3] + 7u != len || f[5] != 0xD4)
+    {
+        sStats.badframes++;
+        return;
+    }
+    for (size_t i = 5; i < len - 1; i++)
+        sum += f[i];
+    if (sum != 0)
+    {
+        sStats.badframes++;
+        return;
+    }
+
+    uint8_t rlen = sPeer ? sPeer(sCtx, f + 6, f[3] - 1, resp) : 0;
+    sAckPending = 1;
+    sRespLen = 0;
+    if (rlen)
+    {
+        uint8_t checksum = 0xD5;
+        uint8_t *p = sResp;
+
+        *p++ = 0x00;
+        *p++ = 0x00;
+        *p++ = 0xFF;
+        *p++ = rlen + 1;
+        *p++ = ~(rlen + 1) + 1;
+        *p++ = 0xD5;
+        for (uint8_t i = 0; i < rlen; i++)
+        {
+            *p++ = resp[i];
+            checksum += resp[i];
+        }
+        *p++ = ~checksum + 1;
+        *p++ = 0x00;
+        sRespLen = p - sResp;
+    }
+}
+
+// byte the chip shifts out while b comes in
+static uint8_t host_spi_clock(uint8_t b)
+{
+    if (sDir < 0)
+    {
+        sDir = b;
+        if (sDir == HOST_SPI_DR)
+        {
+            // ACK first, the response in the next window
+            sOut = sAckPending ? sAck : sResp;
+            sOutLen = sAckPending ? sizeof(sAck) : sRespLen;
+            sOutPos = 0;
+        }
+        return 0x00;
+    }
+    switch (sDir)
+    {
+    case HOST_SPI_DW:
+        if (sInLen < sizeof(sIn))
+            sIn[sInLen++] = b;
+        return 0x00;
+    case HOST_SPI_SR:
+        return (sAckPending || sRespLen) ? 0x01 : 0x00;
+    case HOST_SPI_DR:
+        return sOutPos < sOutLen ? sOut[sOutPos++] : 0x00;
+    default:
+        return 0x00;
+    }
+}
+
+esp_err_t spi_bus_initialize(spi_host_device_t host, const spi_bus_config_t *cfg, int dma)
+{
+    if (sBusUp)
+        return ESP_ERR_INVALID_STATE;
+    sBusUp = 1;
+    return ESP_OK;
+}
+
+esp_err_t spi_bus_add_device(spi_host_device_t host, const spi_device_interface_config_t *cfg, spi_device_handle_t *handle)
+{
+    if (!sBusUp || cfg->mode != 0)
+        return ESP_ERR_INVALID_ARG;
+    struct spi_device_t *dev = calloc(1, sizeof(*dev));
+    if (dev == NULL)
+        return ESP_ERR_NO_MEM;
+    dev->flags = cfg->flags;
+    *handle = dev;
+    return ESP_OK;
+}
+
+esp_err_t spi_bus_remove_device(spi_device_handle_t handle)
+{
+    free(handle);
+    return ESP_OK;
+}
+
+esp_err_t spi_device_acquire_bus(spi_device_handle_t handle, uint32_t wait)
+{
+    pthread_mutex_lock(&sBus);
+    sDir = -1;
+    sWindowTx = 0;
+    sInLen = 0;
+    return ESP_OK;
+}
+
+void spi_device_release_bus(spi_device_handle_t handle)
+{
+    pthread_mutex_lock(&sStatsLock);
+    sStats.windows++;
+    if (sDir == HOST_SPI_DW)
+    {
+        sStats.frames++;
+        if (sWindowTx > 1)
+            sStats.splitframes++;
+        host_spi_command();
+    }
+    else if (sDir == HOST_SPI_DR && sOutPos != 0)
+    {
+        // whatever was started is gone, as on the chip
+        if (sOut == sAck)
+            sAckPending = 0;
+        else
+            sRespLen = 0;
+    }
+    pthread_mutex_unlock(&sStatsLock);
+    pthread_mutex_unlock(&sBus);
+}
+
+esp_err_t spi_device_polling_transmit(spi_device_handle_t handle, spi_transaction_t *trans)
+{
+    const uint8_t *tx = trans->tx_buffer;
+    uint8_t *rx = trans->rx_buffer;
+    size_t n = trans->length / 8;
+
+    if (trans->length % 8 != 0)
+        return ESP_ERR_INVALID_ARG;
+    pthread_mutex_lock(&sStatsLock);
+    sStats.transactions++;
+    pthread_mutex_unlock(&sStatsLock);
+    sWindowTx++;
+    for (size_t i = 0; i < n; i++)
+    {
+        uint8_t out = host_spi_clock(host_spi_wire(handle, tx ? tx[i] : 0x00));
+        if (rx != NULL)
+            rx[i] = host_spi_wire(handle, out);
+    }
+    return ESP_OK;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+    Fake spi_master bus with a PN532 on it (host_spi.c). peer() plays the
+    chip as for the loopback transport: it gets the command (starting with
+    the command code) and writes the response data, returning its length.
+*/
+typedef uint8_t (*host_spi_peer_t)(void *ctx, const uint8_t *cmd, uint8_t cmdlen, uint8_t *resp);
+
+typedef struct
+{
+    uint32_t transactions; // spi_device_polling_transmit calls
+    uint32_t windows;      // acquire/release pairs (SS low windows)
+    uint32_t frames;       // command frames taken
+    uint32_t splitframes;  // command frames clocked in more than one transaction
+    uint32_t badframes;    // command frames with a bad header or checksum
+} host_spi_stats_t;
+
+void host_spi_attach(host_spi_peer_t peer, void *ctx);
+host_spi_stats_t host_spi_stats(void);
@@ -0,0 +1,205 @@
+/*
+    UART driver port on a socket (see host_uart.h). A reader thread plays
+    the driver ISR: it moves every message that arrives at the rate the
+    port is set to into the RX buffer and posts UART_DATA, one event per
+    frame as with the RX timeout on the chip. Messages at another rate
+    are lost and posted as UART_FRAME_ERR.
+*/
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "host_uart.h"
+
+#define HOST_UART_MAXMSG 512
+
+struct host_uart
+{
+    int fd;
+    volatile uint32_t baud;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    QueueHandle_t events;
+    uint8_t *rx;
+    size_t rxsize;
+    size_t head;
+    size_t count;
+};
+
+static struct host_uart sPorts[UART_NUM_MAX] = {
+    {.fd = -1, .lock = PTHREAD_MUTEX_INITIALIZER, .cond = PTHREAD_COND_INITIALIZER},
+    {.fd = -1, .lock = PTHREAD_MUTEX_INITIALIZER, .cond = PTHREAD_COND_INITIALIZER},
+    {.fd = -1, .lock = PTHREAD_MUTEX_INITIALIZER, .cond = PTHREAD_COND_INITIALIZER},
+};
+
+void host_uart_attach(uart_port_t port, int fd)
+{
+    sPorts[port].fd = fd;
+}
+
+uint32_t host_uart_baud(uart_port_t port)
+{
+    return sPorts[port].baud;
+}
+
+int host_uart_send(int fd, uint32_t baud, const void *data, size_t len)
+{
+    uint8_t msg[4 + HOST_UART_MAXMSG];
+
+    if (len > HOST_UART_MAXMSG || baud == 0)
+        return -1;
+    memcpy(msg, &baud, 4);
+    memcpy(msg + 4, data, len);
+    usleep((useconds_t)((uint64_t)len * 10 * 1000000 / baud));
+    if (send(fd, msg, len + 4, 0) != (ssize_t)(len + 4))
+        return -1;
+    return (int)len;
+}
+
+int host_uart_recv(int fd, uint32_t *baud, void *data, size_t max)
+{
+    uint8_t msg[4 + HOST_UART_MAXMSG];
+    ssize_t n = recv(fd, msg, sizeof(msg), 0);
+
+    if (n < 4)
+        return -1;
+    memcpy(baud, msg, 4);
+    n -= 4;
+    if ((size_t)n > max)
+        n = max;
+    memcpy(data, msg + 4, n);
+    return (int)n;
+}
+
+static void *host_uart_reader(void *arg)
+{
+    struct host_uart *uart = arg;
+    uint8_t data[HOST_UART_MAXMSG];
+    uint32_t baud;
+    int n;
+
+    while ((n = host_uart_recv(uart->fd, &baud, data, sizeof(data))) >= 0)
+    {
+        uart_event_t event = {.type = UART_DATA, .size = n, .timeout_flag = true};
+
+        pthread_mutex_lock(&uart->lock);
+        if (baud != uart->baud)
+        {
+            event.type = UART_FRAME_ERR;
+        }
+        else if (uart->count + n > uart->rxsize)
+        {
+            event.type = UART_BUFFER_FULL;
+        }
+        else
+        {
+            for (int i = 0; i < n; i++)
+                uart->rx[(uart->head + uart->count + i) % uart->rxsize] = data[i];
+            uart->count += n;
+            pthread_cond_broadcast(&uart->cond);
+        }
+        pthread_mutex_unlock(&uart->lock);
+        xQueueSend(uart->events, &event, 0);
+    }
+    return NULL;
+}
+
+esp_err_t uart_driver_install(uart_port_t port, int rx_buffer_size, int tx_buffer_size, int queue_size, QueueHandle_t *uart_queue, int intr_alloc_flags)
+{
+    struct host_uart *uart = &sPorts[port];
+
+    if (uart->fd < 0 || uart->rx != NULL)
+        return ESP_FAIL;
+    uart->rx = malloc(rx_buffer_size);
+    uart->rxsize = rx_buffer_size;
+    uart->events = xQueueCreate(queue_size, sizeof(uart_event_t));
+    if (uart->rx == NULL || uart->events == NULL)
+        return ESP_ERR_NO_MEM;
+    if (uart_queue != NULL)
+        *uart_queue = uart->events;
+    if (pthread_create(&uart->thread, NULL, host_uart_reader, uart) != 0)
+        return ESP_FAIL;
+    pthread_detach(uart->thread);
+    return ESP_OK;
+}
+
+esp_err_t uart_param_config(uart_port_t port, const uart_config_t *config)
+{
+    sPorts[port].baud = config->baud_rate;
+    return ESP_OK;
+}
+
+esp_err_t uart_set_baudrate(uart_port_t port, uint32_t baudrate)
+{
+    sPorts[port].baud = baudrate;
+    return ESP_OK;
+}
+
+esp_err_t uart_set_pin(uart_port_t port, int tx, int rx, int rts, int cts) { return ESP_OK; }
+esp_err_t uart_set_rx_timeout(uart_port_t port, uint8_t tout_thresh) { return ESP_OK; }
+esp_err_t uart_set_rx_full_threshold(uart_port_t port, int threshold) { return ESP_OK; }
+
+// writes are synchronous, the line time is already spent
+esp_err_t uart_wait_tx_done(uart_port_t port, TickType_t ticks) { return ESP_OK; }
+
+esp_err_t uart_flush_input(uart_port_t port)
+{
+    struct host_uart *uart = &sPorts[port];
+
+    pthread_mutex_lock(&uart->lock);
+    uart->head = 0;
+    uart->count = 0;
+    pthread_mutex_unlock(&uart->lock);
+    return ESP_OK;
+}
+
+esp_err_t uart_get_buffered_data_len(uart_port_t port, size_t *size)
+{
+    struct host_uart *uart = &sPorts[port];
+
+    pthread_mutex_lock(&uart->lock);
+    *size = uart->count;
+    pthread_mutex_unlock(&uart->lock);
+    return ESP_OK;
+}
+
+int uart_write_bytes(uart_port_t port, const void *src, size_t size)
+{
+    return host_uart_send(sPorts[port].fd, sPorts[port].baud, src, size);
+}
+
+int uart_read_bytes(uart_port_t port, void *buf, uint32_t length, TickType_t ticks)
+{
+    struct host_uart *uart = &sPorts[port];
+    struct timespec deadline;
+    uint8_t *out = buf;
+    uint32_t n;
+
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += ticks / 1000;
+    deadline.tv_nsec += (long)(ticks % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000)
+    {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+
+    pthread_mutex_lock(&uart->lock);
+    while (uart->count < length && ticks != 0)
+    {
+        if (pthread_cond_timedwait(&uart->cond, &uart->lock, &deadline) == ETIMEDOUT)
+            break;
+    }
+    n = uart->count < length ? uart->count : length;
+    for (uint32_t i = 0; i < n; i++)
+        out[i] = uart->rx[(uart->head + i) % uart->rxsize];
+    uart->head = (uart->head + n) % uart->rxsize;
+    uart->count -= n;
+    pthread_mutex_unlock(&uart->lock);
+    return (int)n;
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "driver/uart.h"
+
+/*
+    UART line between a host_uart.c port and the device playing the other
+    end, over a SOCK_SEQPACKET socketpair. Every message carries the baud
+    rate it was sent at; a receiver set to another rate gets nothing
+    usable, as on a real line. The sender spends the line time (10 bits a
+    byte) before the message goes out.
+*/
+void host_uart_attach(uart_port_t port, int fd);
+uint32_t host_uart_baud(uart_port_t port);
+
+int host_uart_send(int fd, uint32_t baud, const void *data, size_t len);
+int host_uart_recv(int fd, uint32_t *baud, void *data, size_t max);
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <stddef.h>
+
+/*
+    No mbedtls on the host: setup fails, so NFC_MacSetKey reports no key
+    and the MAC stays off. The host tests do not enable CONFIG_NFC_MAC.
+*/
+typedef enum { MBEDTLS_MD_NONE = 0, MBEDTLS_MD_SHA256 = 6 } mbedtls_md_type_t;
+typedef struct mbedtls_md_info_t mbedtls_md_info_t;
+typedef struct { const mbedtls_md_info_t *info; } mbedtls_md_context_t;
+
+#define MBEDTLS_ERR_MD_FEATURE_UNAVAILABLE -0x5080
+
+const mbedtls_md_info_t *mbedtls_md_info_from_type(mbedtls_md_type_t type);
+void mbedtls_md_init(mbedtls_md_context_t *ctx);
+void mbedtls_md_free(mbedtls_md_context_t *ctx);
+int mbedtls_md_setup(mbedtls_md_context_t *ctx, const mbedtls_md_info_t *info, int hmac);
+int mbedtls_md_hmac_starts(mbedtls_md_context_t *ctx, const unsigned char *key, size_t keylen);
+int mbedtls_md_hmac_update(mbedtls_md_context_t *ctx, const unsigned char *input, size_t len);
+int mbedtls_md_hmac_finish(mbedtls_md_context_t *ctx, unsigned char *output);
+int mbedtls_md_hmac_reset(mbedtls_md_context_t *ctx);
@@ -0,0 +1,5 @@
+/*
+    Host build: bit-banged SPI transport selected, none of the optional
+    NFC features. Test targets add CONFIG_ definitions of their own.
+*/
+#pragma once
@@ -0,0 +1,138 @@
+#include <string.h>
+
+#include "tag_peer.h"
+
+#define STATUS_OK 0x00
+#define STATUS_TIMEOUT 0x01
+#define STATUS_NOTARGET 0x27
+
+/*
+  Blank NTAG213: serial number, lock bytes, capability container with
+  144 bytes of user memory, everything else zero
+*/
+void TagPeerInit(TTagPeer *aPeer, uint8_t aUidSeed)
+{
+  memset(aPeer, 0, sizeof(*aPeer));
+  for (uint8_t i = 0; i < sizeof(aPeer->sUid); i++)
+  {
+    aPeer->sUid[i] = (uint8_t)(0x04 + i * 0x11 + aUidSeed);
+  }
+  aPeer->sUid[0] = 0x04; // NXP
+  memcpy(aPeer->sMem, aPeer->sUid, 3);
+  memcpy(aPeer->sMem + 4, aPeer->sUid + 3, 4);
+  aPeer->sMem[12] = 0xE1;
+  aPeer->sMem[13] = 0x10;
+  aPeer->sMem[14] = 0x12;
+  aPeer->sPresent = true;
+  aPeer->sWritesLeft = TAG_PEER_UNLIMITED;
+}
+
+// READ returns 4 pages and wraps around at the end of memory
+static void TagPeerRead(TTagPeer *aPeer, uint8_t aPage, uint8_t *aOut)
+{
+  for (uint8_t i = 0; i < 16; i++)
+  {
+    aOut[i] = aPeer->sMem[((aPage * 4) + i) % sizeof(aPeer->sMem)];
+  }
+}
+
+static uint8_t TagPeerWrite(TTagPeer *aPeer, uint8_t aPage, const uint8_t *aData)
+{
+  if (aPeer->sWritesLeft == 0)
+  {
+    return STATUS_TIMEOUT;
+  }
+  if (aPage < 2 || aPage >= TAG_PEER_PAGES)
+  {
+    return 0x14; // tag NAK, the PN532 reports a CRC / framing error
+  }
+  memcpy(aPeer->sMem + aPage * 4, aData, 4);
+  aPeer->sWrites++;
+  if (aPeer->sWritesLeft > 0 && --aPeer->sWritesLeft == 0 && aPeer->sLoseAck)
+  {
+    return STATUS_TIMEOUT;
+  }
+  return STATUS_OK;
+}
+
+uint8_t TagPeer(void *aCtx, const uint8_t *aCmd, uint8_t aCmdLen, uint8_t *aResp)
+{
+  TTagPeer *peer = (TTagPeer *)aCtx;
+  bool field = peer->sPresent && peer->sWritesLeft != 0;
+
+  peer->sExchanges++;
+  aResp[0] = aCmd[0] + 1;
+  switch (aCmd[0])
+  {
+  case 0x02: // GetFirmwareVersion: PN532 v1.6, all protocols
+    aResp[1] = 0x32;
+    aResp[2] = 0x01;
+    aResp[3] = 0x06;
+    aResp[4] = 0x07;
+    return 5;
+  case 0x14: // SAMConfiguration
+  case 0x32: // RFConfiguration
+    return 1;
+  case 0x44: // InDeselect
+  case 0x52: // InRelease
+    aResp[1] = STATUS_OK;
+    return 2;
+  case 0x4A: // InListPassiveTarget
+    if (!field)
+    {
+      aResp[1] = 0;
+      return 2;
+    }
+    aResp[1] = 1;
+    aResp[2] = 1;    // Tg
+    aResp[3] = 0x00; // ATQA
+    aResp[4] = 0x44;
+    aResp[5] = 0x00; // SAK
+    aResp[6] = sizeof(peer->sUid);
+    memcpy(aResp + 7, peer->sUid, sizeof(peer->sUid));
+    return 7 + sizeof(peer->sUid);
+  case 0x40: // InDataExchange: Tg, tag command
+    if (aCmdLen < 4 || !field)
+    {
+      aResp[1] = field ? STATUS_NOTARGET : STATUS_TIMEOUT;
+      return 2;
+    }
+    if (aCmd[2] == 0x30)
+    {
+      aResp[1] = STATUS_OK;
+      TagPeerRead(peer, aCmd[3], aResp + 2);
+      return 18;
+    }
+    if (aCmd[2] == 0xA2 && aCmdLen >= 8)
+    {
+      aResp[1] = TagPeerWrite(peer, aCmd[3], aCmd + 4);
+      return 2;
+    }
+    aResp[1] = STATUS_NOTARGET;
+    return 2;
+  case 0x42: // InCommunicateThru: raw tag command
+    if (aCmdLen < 2 || !field)
+    {
+      aResp[1] = STATUS_TIMEOUT;
+      return 2;
+    }
+    if (aCmd[1] == 0x60)
+    {
+      static const uint8_t version[8] = {0x00, 0x04, 0x04, 0x02, 0x01, 0x00, 0x0F, 0x03};
+      aResp[1] = STATUS_OK;
+      memcpy(aResp + 2, version, sizeof(version));
+      return 2 + sizeof(version);
+    }
+    if (aCmd[1] == 0x3A && aCmdLen >= 4 && aCmd[2] <= aCmd[3] && aCmd[3] < TAG_PEER_PAGES)
+    {
+      uint8_t len = (aCmd[3] - aCmd[2] + 1) * 4;
+      aResp[1] = STATUS_OK;
+      memcpy(aResp + 2, peer->sMem + aCmd[2] * 4, len);
+      return 2 + len;
+    }
+    aResp[1] = STATUS_TIMEOUT;
+    return 2;
+  default:
+    return 0;
+  }
+}
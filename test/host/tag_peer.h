@@ -0,0 +1,33 @@
+/*
+    PN532 stand-in with one NTAG213 in the field, for the loopback
+    transport. Answers the commands the component uses: firmware version,
+    SAM / RF configuration, InListPassiveTarget, InDataExchange READ and
+    WRITE, InCommunicateThru GET_VERSION and FAST_READ, InRelease and
+    InDeselect.
+
+    Writes can be cut off to play a tag pulled from the field: after
+    sWritesLeft page writes the tag stops answering (the PN532 reports a
+    timeout) and writes no more pages. With sLoseAck the page that
+    exhausts sWritesLeft is still written but its answer is lost.
+*/
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define TAG_PEER_PAGES 45 // NTAG213
+#define TAG_PEER_UNLIMITED -1
+
+typedef struct
+{
+  uint8_t sMem[TAG_PEER_PAGES * 4];
+  uint8_t sUid[7];
+  bool sPresent;         // InListPassiveTarget finds the tag
+  int sWritesLeft;       // page writes until the tag drops, TAG_PEER_UNLIMITED
+  bool sLoseAck;         // the last write lands but its answer does not
+  uint32_t sExchanges;   // commands answered
+  uint32_t sWrites;      // pages written to sMem
+} TTagPeer;
+
+void TagPeerInit(TTagPeer *aPeer, uint8_t aUidSeed);
+uint8_t TagPeer(void *aCtx, const uint8_t *aCmd, uint8_t aCmdLen, uint8_t *aResp);
@@ -0,0 +1,161 @@
+/*
+    Asynchronous request queue over the loopback transport. An exec
+    request holds the driver task until four more requests are queued: a
+    GetFirmwareVersion, a command the PN532 never answers, an
+    InDataExchange READ and a second exec request. They must complete in
+    queue order with their own status and data, the unanswered command
+    must be aborted before the READ goes out, and the frames must have
+    been built in alternating slots.
+*/
+#include <stdio.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "pn532.h"
+#include "tag_peer.h"
+
+#define REQUESTS 5
+#define SILENTCMD 0x99 // TagPeer does not answer it
+
+static int sFailed;
+
+#define CHECK(cond)                                          \
+  do                                                         \
+  {                                                          \
+    if (!(cond))                                             \
+    {                                                        \
+      printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+      sFailed++;                                             \
+    }                                                        \
+  } while (0)
+
+typedef struct
+{
+  int sIndex;
+  SemaphoreHandle_t sGate; // exec waits for it, NULL none
+  bool sRan;
+} TReqCtx;
+
+static TTagPeer sTag;
+static uint8_t sCmds[16]; // command codes as the PN532 got them
+static uint8_t sCmdCount;
+static int sOrder[REQUESTS];
+static int sDone;
+
+static uint8_t Peer(void *aCtx, const uint8_t *aCmd, uint8_t aCmdLen, uint8_t *aResp)
+{
+  if (sCmdCount < sizeof(sCmds))
+  {
+    sCmds[sCmdCount++] = aCmd[0];
+  }
+  return TagPeer(aCtx, aCmd, aCmdLen, aResp);
+}
+
+static bool Exec(pn532_t *aNFC, void *aCtx)
+{
+  TReqCtx *iCtx = (TReqCtx *)aCtx;
+  if (iCtx->sGate != NULL)
+  {
+    xSemaphoreTake(iCtx->sGate, portMAX_DELAY);
+  }
+  iCtx->sRan = true;
+  return true;
+}
+
+static void Done(pn532_request_t *aReq, void *aCtx)
+{
+  sOrder[sDone++] = ((TReqCtx *)aCtx)->sIndex;
+}
+
+int main(void)
+{
+  pn532_t nfc;
+  pn532_loopback_t bus;
+  pn532_async_t drv;
+  pn532_request_t req[REQUESTS];
+  TReqCtx ctx[REQUESTS];
+  uint8_t version[8];
+  uint8_t page[24];
+  uint8_t frame[PN532_FRAMESIZ];
+
+  memset(&nfc, 0, sizeof(nfc));
+  TagPeerInit(&sTag, 0);
+  pn532_loopback_init(&nfc, &bus, Peer, &sTag);
+  pn532_begin(&nfc);
+  CHECK(pn532_SAMConfig(&nfc));
+  sCmdCount = 0;
+
+  memset(req, 0, sizeof(req));
+  memset(ctx, 0, sizeof(ctx));
+  for (int i = 0; i < REQUESTS; i++)
+  {
+    ctx[i].sIndex = i;
+    req[i].ctx = &ctx[i];
+    req[i].done = Done;
+    req[i].notify = xTaskGetCurrentTaskHandle();
+    req[i].timeout = 50;
+  }
+  ctx[0].sGate = xSemaphoreCreateBinary();
+  req[0].exec = Exec;
+  req[1].cmd[0] = PN532_COMMAND_GETFIRMWAREVERSION;
+  req[1].cmdlen = 1;
+  req[1].response = version;
+  req[1].responsemax = sizeof(version);
+  req[2].cmd[0] = SILENTCMD;
+  req[2].cmdlen = 1;
+  req[3].cmd[0] = PN532_COMMAND_INDATAEXCHANGE;
+  req[3].cmd[1] = 1;
+  req[3].cmd[2] = MIFARE_CMD_READ;
+  req[3].cmd[3] = 3;
+  req[3].cmdlen = 4;
+  req[3].response = page;
+  req[3].responsemax = sizeof(page);
+  req[4].exec = Exec;
+
+  CHECK(pn532_async_start(&drv, &nfc, REQUESTS, 5));
+  for (int i = 0; i < REQUESTS; i++)
+  {
+    CHECK(pn532_async_submit(&drv, &req[i], 0));
+  }
+  xSemaphoreGive(ctx[0].sGate);
+  for (int i = 0; i < REQUESTS; i++)
+  {
+    pn532_async_wait(&req[i], pdMS_TO_TICKS(1000));
+  }
+
+  CHECK(sDone == REQUESTS);
+  for (int i = 0; i < sDone; i++)
+  {
+    CHECK(sOrder[i] == i);
+  }
+  CHECK(ctx[0].sRan && ctx[4].sRan);
+  CHECK(req[0].status == PN532_REQ_DONE);
+  CHECK(req[1].status == PN532_REQ_DONE);
+  CHECK(req[1].responselen == 5 && version[0] == PN532_COMMAND_GETFIRMWAREVERSION + 1 && version[1] == 0x32);
+  CHECK(req[2].status == PN532_REQ_FAILED);
+  CHECK(req[3].status == PN532_REQ_DONE);
+  CHECK(req[3].responselen == 18 && page[0] == PN532_COMMAND_INDATAEXCHANGE + 1 && page[1] == 0x00 && page[2] == 0xE1);
+  CHECK(req[4].status == PN532_REQ_DONE);
+
+  // the silent command was stopped before the READ went out
+  CHECK(sCmdCount == 3 && sCmds[0] == PN532_COMMAND_GETFIRMWAREVERSION && sCmds[1] == SILENTCMD && sCmds[2] == PN532_COMMAND_INDATAEXCHANGE);
+  CHECK(bus.aborts == 1);
+
+  // frames alternate slots: the exec request took slot 0, the commands
+  // 1, 0, 1; each was built while the one before was in flight
+  uint8_t len = pn532_buildframe(req[2].cmd, req[2].cmdlen, frame);
+  CHECK(memcmp(drv._frames[0], frame, len) == 0);
+  len = pn532_buildframe(req[3].cmd, req[3].cmdlen, frame);
+  CHECK(memcmp(drv._frames[1], frame, len) == 0);
+
+  printf("%d requests, completion order", sDone);
+  for (int i = 0; i < sDone; i++)
+  {
+    printf(" %d", sOrder[i]);
+  }
+  printf(", %u aborted\n", (unsigned)bus.aborts);
+  printf("%s\n", sFailed ? "FAILED" : "OK");
+  return sFailed != 0;
+}
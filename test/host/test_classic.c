@@ -0,0 +1,90 @@
+/*
+    MIFARE Classic writes with the image CRC (CONFIG_NFC_IMAGE_CRC) over
+    the loopback transport. The CRC page shares the last block with data,
+    so rewriting that block must keep the CRC read from the card, and a
+    write the tag refuses must be reported as failed, even without
+    verification.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pn532.h"
+#include "NFC_reader.h"
+#include "classic_peer.h"
+
+#define LASTBLOCK 62 // 45th data block: sector 15, block 2
+
+static int sFailed;
+
+#define CHECK(cond)                                          \
+  do                                                         \
+  {                                                          \
+    if (!(cond))                                             \
+    {                                                        \
+      printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+      sFailed++;                                             \
+    }                                                        \
+  } while (0)
+
+static pn532_t sNFC;
+static pn532_loopback_t sBus;
+static TClassicPeer sTag;
+static TNFCSession sSession;
+static TCardInfo *sCard;
+
+// reader restarted and the card presented again
+static bool Load(void)
+{
+  if (sCard != NULL)
+  {
+    NFC_DeAlloc(sCard);
+  }
+  sCard = (TCardInfo *)calloc(1, sizeof(TCardInfo));
+  pn532_loopback_init(&sNFC, &sBus, ClassicPeer, &sTag);
+  pn532_begin(&sNFC);
+  return NFC_SessionOpen(&sSession, &sNFC, 100) && NFC_LoadNFC(&sSession, sCard);
+}
+
+int main(void)
+{
+  TPageStatus iStatus[256];
+
+  ClassicPeerInit(&sTag);
+  CHECK(Load());
+  CHECK(sSession.sTag.type == PN532_TAG_CLASSIC_1K);
+  size_t iLast = sCard->sNumOfBlocks - 1;
+  printf("%zu structs, last one in block %d with the CRC\n", sCard->sNumOfBlocks, LASTBLOCK);
+
+  // valid image with its CRC on the card
+  for (size_t i = 0; i < sCard->sNumOfBlocks; i++)
+  {
+    memset(&sCard->sDataNFC[i], (int)(i + 1), sizeof(TDataNFC));
+  }
+  CHECK(NFC_WriteStructs(&sSession, sCard, 0, sCard->sNumOfBlocks, NULL) == 0);
+  CHECK(Load() && sCard->sCrcValid);
+
+  // changing the last struct rewrites the block that carries the CRC
+  sTag.sWatchBlock = LASTBLOCK;
+  sCard->sDataNFC[iLast].AA ^= 0xFF;
+  CHECK(NFC_WriteStruct(&sSession, sCard, iLast) == 0);
+  CHECK(sTag.sWatchZero == 0);
+  uint8_t iAA = sCard->sDataNFC[iLast].AA;
+  CHECK(Load() && sCard->sCrcValid && sCard->sDataNFC[iLast].AA == iAA);
+
+  // the tag refuses writes: failure reported per page, nothing written
+  sTag.sReadOnly = true;
+  uint32_t iWrites = sTag.sWrites;
+  sCard->sDataNFC[0].AA ^= 0xFF;
+  CHECK(NFC_WriteStructs(&sSession, sCard, 0, 1, iStatus) == 3);
+  CHECK(iStatus[0] == NFC_PAGE_NAK);
+  CHECK(NFC_WriteAndCheck(&sSession, sCard, 0, NFC_VERIFY_ACK) == 1);
+  CHECK(NFC_WriteAndCheck(&sSession, sCard, 0, NFC_VERIFY_NONE) == 1);
+  CHECK(sTag.sWrites == iWrites);
+  sTag.sReadOnly = false;
+  CHECK(Load() && sCard->sCrcValid && sCard->sDataNFC[0].AA == 1);
+
+  NFC_DeAlloc(sCard);
+  printf("%s\n", sFailed ? "FAILED" : "OK");
+  return sFailed != 0;
+}
@@ -0,0 +1,96 @@
+/*
+    HSU transport on a host_uart line with a PN532 stand-in: negotiates
+    every rate of the SETSERIALBAUDRATE table with pn532_hsu_setbaudrate
+    and reports the time of a GetFirmwareVersion and an InDataExchange
+    READ exchange at each rate. The line spends 10 bits a byte, the
+    stand-in answers at once, so the numbers are the bus share of an
+    exchange.
+*/
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <sys/socket.h>
+
+#include "esp_timer.h"
+#include "pn532.h"
+#include "host_uart.h"
+#include "hsu_peer.h"
+#include "tag_peer.h"
+
+#define RUNS 10
+
+static int sFailed;
+
+#define CHECK(cond)                                          \
+  do                                                         \
+  {                                                          \
+    if (!(cond))                                             \
+    {                                                        \
+      printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+      sFailed++;                                             \
+    }                                                        \
+  } while (0)
+
+static const uint32_t sRates[] = {9600, 19200, 38400, 57600, 115200, 230400, 460800, 921600, 1288000};
+
+int main(void)
+{
+  pn532_t nfc;
+  TTagPeer tag;
+  THsuPeer peer;
+  int fds[2];
+  uint8_t uid[7];
+  uint8_t uidLen = 0;
+  uint8_t page[16];
+
+  CHECK(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fds) == 0);
+  memset(&nfc, 0, sizeof(nfc));
+  TagPeerInit(&tag, 0);
+  host_uart_attach(UART_NUM_1, fds[0]);
+  CHECK(HsuPeerStart(&peer, fds[1], PN532_HSU_BAUDRATE, TagPeer, &tag));
+  CHECK(pn532_hsu_init(&nfc, UART_NUM_1, 17, 16));
+  pn532_begin(&nfc);
+
+  CHECK(pn532_getFirmwareVersion(&nfc) == 0x32010607);
+  CHECK(pn532_SAMConfig(&nfc));
+  CHECK(pn532_readPassiveTargetID(&nfc, PN532_MIFARE_ISO14443A, uid, &uidLen, 100));
+  CHECK(uidLen == 7 && memcmp(uid, tag.sUid, 7) == 0);
+
+  printf("%8s  %22s  %22s\n", "baud", "GetFirmwareVersion", "InDataExchange READ");
+  for (size_t r = 0; r < sizeof(sRates) / sizeof(sRates[0]); r++)
+  {
+    CHECK(pn532_hsu_setbaudrate(&nfc, sRates[r]));
+    CHECK(peer.sBaud == sRates[r] && nfc._baud == sRates[r]);
+
+    int64_t start = esp_timer_get_time();
+    for (uint32_t i = 0; i < RUNS; i++)
+    {
+      CHECK(pn532_getFirmwareVersion(&nfc) == 0x32010607);
+    }
+    int64_t version = esp_timer_get_time() - start;
+
+    start = esp_timer_get_time();
+    for (uint32_t i = 0; i < RUNS; i++)
+    {
+      CHECK(pn532_mifareultralight_ReadPage(&nfc, 3, page) && page[0] == 0xE1);
+    }
+    int64_t read = esp_timer_get_time() - start;
+    printf("%8" PRIu32 "  %13.0f us/exchange  %13.0f us/exchange\n", sRates[r], (double)version / RUNS, (double)read / RUNS);
+  }
+  CHECK(peer.sSwitches == sizeof(sRates) / sizeof(sRates[0]));
+  CHECK(peer.sGarbled == 0);
+
+  // not in the table: refused without touching the line
+  CHECK(!pn532_hsu_setbaudrate(&nfc, 12345));
+  CHECK(pn532_getFirmwareVersion(&nfc) == 0x32010607);
+
+  // host moved without the PN532: nothing gets through until it is back
+  uart_set_baudrate(UART_NUM_1, PN532_HSU_BAUDRATE);
+  CHECK(pn532_getFirmwareVersion(&nfc) == 0);
+  CHECK(peer.sGarbled > 0);
+  uart_set_baudrate(UART_NUM_1, nfc._baud);
+  CHECK(pn532_getFirmwareVersion(&nfc) == 0x32010607);
+
+  printf("%s\n", sFailed ? "FAILED" : "OK");
+  return sFailed != 0;
+}
@@ -0,0 +1,76 @@
+/*
+    Wall time of NFC_LoadNFC on an NTAG213 over hardware SPI (fake
+    spi_master bus). Built twice: against the current SPI code and with
+    CONFIG_PN532_SPI_LEGACY_TIMING, the tick sleeps at every SS select and
+    before every byte read that the original code had; load_compare.cmake
+    runs both and reports the speed-up.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_timer.h"
+#include "pn532.h"
+#include "NFC_reader.h"
+#include "tag_peer.h"
+#include "host_spi.h"
+
+#ifdef CONFIG_PN532_SPI_LEGACY_TIMING
+#define VARIANT "legacy"
+#else
+#define VARIANT "current"
+#endif
+#define RUNS 2
+#define DATASTART (8 * 4) // OFFSETDATA of NFC_reader.c, in bytes
+
+static int sFailed;
+
+#define CHECK(cond)                                          \
+  do                                                         \
+  {                                                          \
+    if (!(cond))                                             \
+    {                                                        \
+      printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+      sFailed++;                                             \
+    }                                                        \
+  } while (0)
+
+int main(void)
+{
+  pn532_t nfc;
+  TTagPeer tag;
+  TNFCSession session;
+  int64_t best = 0;
+
+  memset(&nfc, 0, sizeof(nfc));
+  TagPeerInit(&tag, 0);
+  for (size_t i = DATASTART; i < sizeof(tag.sMem); i++)
+  {
+    tag.sMem[i] = (uint8_t)i;
+  }
+  host_spi_attach(TagPeer, &tag);
+  CHECK(pn532_spi_init_hw(&nfc, SPI2_HOST, 18, 19, 23, 5, 5000000));
+  pn532_begin(&nfc);
+  CHECK(pn532_SAMConfig(&nfc));
+  CHECK(NFC_SessionOpen(&session, &nfc, 100));
+
+  for (int r = 0; r < RUNS; r++)
+  {
+    TCardInfo *card = (TCardInfo *)calloc(1, sizeof(TCardInfo));
+    int64_t start = esp_timer_get_time();
+    CHECK(NFC_LoadNFC(&session, card));
+    int64_t time = esp_timer_get_time() - start;
+    CHECK(card->sNumOfBlocks > 0 && memcmp(card->sDataNFC, tag.sMem + DATASTART, card->sNumOfBlocks * sizeof(TDataNFC)) == 0);
+    if (r == 0 || time < best)
+    {
+      best = time;
+    }
+    NFC_DeAlloc(card);
+  }
+
+  host_spi_stats_t stats = host_spi_stats();
+  printf("NFC_LoadNFC " VARIANT ": %lld us\n", (long long)best);
+  printf("%u SS windows, %u transactions in total\n", (unsigned)stats.windows, (unsigned)stats.transactions);
+  printf("%s\n", sFailed ? "FAILED" : "OK");
+  return sFailed != 0;
+}
@@ -0,0 +1,106 @@
+/*
+    Command layer over the loopback transport and over the hardware SPI
+    transport on the fake spi_master bus: checks the answers of the tag
+    stand-in and times GetFirmwareVersion, READ and WRITE exchanges.
+*/
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "esp_timer.h"
+#include "pn532.h"
+#include "tag_peer.h"
+#include "host_spi.h"
+
+#define RUNS 2000
+#define SPIRUNS 200 // every SS low window busy waits the setup time
+
+static int sFailed;
+
+#define CHECK(cond)                                          \
+  do                                                         \
+  {                                                          \
+    if (!(cond))                                             \
+    {                                                        \
+      printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+      sFailed++;                                             \
+    }                                                        \
+  } while (0)
+
+static void Report(const char *aName, uint32_t aRuns, int64_t aTime)
+{
+  printf("%-22s %6" PRIu32 " exchanges  %8.2f us/exchange  %10.0f exchanges/s\n", aName, aRuns,
+         (double)aTime / aRuns, aRuns * 1e6 / (aTime ? aTime : 1));
+}
+
+// the same checks and timings for any transport, nfc set up on a fresh tag
+static void Run(pn532_t *nfc, TTagPeer *tag, uint32_t aRuns)
+{
+  uint8_t uid[7];
+  uint8_t uidLen = 0;
+  uint8_t page[16];
+  uint8_t data[4] = {0xDE, 0xAD, 0xBE, 0xEF};
+  int64_t start;
+
+  pn532_begin(nfc);
+
+  CHECK(pn532_getFirmwareVersion(nfc) == 0x32010607);
+  CHECK(pn532_SAMConfig(nfc));
+  CHECK(pn532_readPassiveTargetID(nfc, PN532_MIFARE_ISO14443A, uid, &uidLen, 100));
+  CHECK(uidLen == 7 && memcmp(uid, tag->sUid, 7) == 0);
+  CHECK(pn532_mifareultralight_ReadPage(nfc, 3, page) && page[0] == 0xE1);
+  CHECK(pn532_mifareultralight_WritePageStatus(nfc, 4, data) == PN532_WRITE_ACK);
+  CHECK(memcmp(tag->sMem + 16, data, 4) == 0);
+  CHECK(pn532_mifareultralight_WritePageStatus(nfc, 200, data) == PN532_WRITE_NAK);
+
+  start = esp_timer_get_time();
+  for (uint32_t i = 0; i < aRuns; i++)
+  {
+    CHECK(pn532_getFirmwareVersion(nfc) != 0);
+  }
+  Report("GetFirmwareVersion", aRuns, esp_timer_get_time() - start);
+
+  start = esp_timer_get_time();
+  for (uint32_t i = 0; i < aRuns; i++)
+  {
+    CHECK(pn532_mifareultralight_ReadPage(nfc, 4 + i % 36, page));
+  }
+  Report("InDataExchange READ", aRuns, esp_timer_get_time() - start);
+
+  start = esp_timer_get_time();
+  for (uint32_t i = 0; i < aRuns; i++)
+  {
+    data[0] = (uint8_t)i;
+    CHECK(pn532_mifareultralight_WritePageStatus(nfc, 4 + i % 36, data) == PN532_WRITE_ACK);
+  }
+  Report("InDataExchange WRITE", aRuns, esp_timer_get_time() - start);
+}
+
+int main(void)
+{
+  pn532_t nfc;
+  pn532_loopback_t bus;
+  TTagPeer tag;
+
+  printf("loopback\n");
+  memset(&nfc, 0, sizeof(nfc));
+  TagPeerInit(&tag, 0);
+  pn532_loopback_init(&nfc, &bus, TagPeer, &tag);
+  Run(&nfc, &tag, RUNS);
+
+  // spi_master path: DW/SR/DR windows, LSB first, each frame one DMA transaction
+  printf("hardware SPI\n");
+  memset(&nfc, 0, sizeof(nfc));
+  TagPeerInit(&tag, 0);
+  host_spi_attach(TagPeer, &tag);
+  CHECK(pn532_spi_init_hw(&nfc, SPI2_HOST, 18, 19, 23, 5, 5000000));
+  Run(&nfc, &tag, SPIRUNS);
+  host_spi_stats_t stats = host_spi_stats();
+  printf("%" PRIu32 " frames, %" PRIu32 " transactions in %" PRIu32 " SS windows\n", stats.frames, stats.transactions, stats.windows);
+  CHECK(stats.frames == tag.sExchanges);
+  CHECK(stats.splitframes == 0);
+  CHECK(stats.badframes == 0);
+
+  printf("%s\n", sFailed ? "FAILED" : "OK");
+  return sFailed != 0;
+}
@@ -0,0 +1,79 @@
+/*
+    NFC_MultiBenchmark on four loopback readers in two RF slots, readers
+    0 and 2 in slot 0, 1 and 3 in slot 1. Reader 3 has no card in its
+    field. For every reader count 1..4 each reader with a card must find
+    it once per round, with its own UID in the session; NFC_MultiReport
+    prints the aggregate and per-reader cards/s.
+*/
+#include <stdio.h>
+#include <string.h>
+
+#include "pn532.h"
+#include "NFC_multi.h"
+#include "tag_peer.h"
+
+#define READERS 4
+#define ROUNDS 50
+
+static int sFailed;
+
+#define CHECK(cond)                                          \
+  do                                                         \
+  {                                                          \
+    if (!(cond))                                             \
+    {                                                        \
+      printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+      sFailed++;                                             \
+    }                                                        \
+  } while (0)
+
+static TNFCMulti sMulti;
+static TTagPeer sTags[READERS];
+static uint32_t sFound[READERS + 1]; // cards found, by reader count
+static uint32_t sWrongUid;
+
+static void OnCard(uint8_t aReader, TNFCSession *aSession, void *aCtx)
+{
+  TNFCMulti *iMulti = (TNFCMulti *)aCtx;
+  sFound[iMulti->sUsed]++;
+  if (aReader >= iMulti->sUsed || !aSession->sActive || aSession->sUidLength != sizeof(sTags[aReader].sUid) ||
+      memcmp(aSession->sUid, sTags[aReader].sUid, aSession->sUidLength) != 0)
+  {
+    sWrongUid++;
+  }
+}
+
+int main(void)
+{
+  pn532_t nfc[READERS];
+  pn532_loopback_t bus[READERS];
+
+  NFC_MultiInit(&sMulti, OnCard, &sMulti);
+  for (int i = 0; i < READERS; i++)
+  {
+    memset(&nfc[i], 0, sizeof(nfc[i]));
+    TagPeerInit(&sTags[i], i + 1);
+    sTags[i].sPresent = i != 3;
+    pn532_loopback_init(&nfc[i], &bus[i], TagPeer, &sTags[i]);
+    pn532_begin(&nfc[i]);
+    CHECK(pn532_SAMConfig(&nfc[i]));
+    CHECK(NFC_MultiAdd(&sMulti, &nfc[i], i % 2) == i);
+  }
+  CHECK(sMulti.sCount == READERS && sMulti.sSlots == 2);
+
+  NFC_MultiBenchmark(&sMulti, ROUNDS);
+
+  for (int iUsed = 1; iUsed <= READERS; iUsed++)
+  {
+    uint32_t iCards = iUsed < READERS ? iUsed : READERS - 1;
+    CHECK(sFound[iUsed] == iCards * ROUNDS);
+  }
+  CHECK(sWrongUid == 0);
+  // the benchmark ends with all readers in use and their counts
+  CHECK(sMulti.sUsed == READERS && sMulti.sRounds == ROUNDS);
+  CHECK(sMulti.sReaders[0].sCards == ROUNDS && sMulti.sReaders[3].sCards == 0);
+  CHECK(sMulti.sCards == (READERS - 1) * ROUNDS);
+
+  printf("%s\n", sFailed ? "FAILED" : "OK");
+  return sFailed != 0;
+}
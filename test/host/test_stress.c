@@ -0,0 +1,101 @@
+/*
+    N tasks, each with its own pn532_t and tag stand-in on the loopback
+    transport, read pages concurrently. Every answer must carry the
+    serial number of the task's own tag; a shared packet buffer would mix
+    them up. Reports exchanges/s for N = 1..STRESS_MAXTASKS.
+*/
+#include <stdio.h>
+#include <string.h>
+#include <stdatomic.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "pn532.h"
+#include "tag_peer.h"
+
+#define STRESS_MAXTASKS 8
+#define STRESS_TIME_US 200000
+
+typedef struct
+{
+  pn532_t sNFC;
+  pn532_loopback_t sBus;
+  TTagPeer sTag;
+  TaskHandle_t sMain;
+  atomic_bool *sStop;
+  uint32_t sExchanges;
+  uint32_t sErrors;
+} TStressTask;
+
+static void StressTask(void *aArg)
+{
+  TStressTask *task = (TStressTask *)aArg;
+  uint8_t page[16];
+
+  while (!atomic_load(task->sStop))
+  {
+    uint8_t n = (uint8_t)(task->sExchanges & 1);
+    // pages 0..1 hold the serial number of this task's tag
+    if (!pn532_mifareultralight_ReadPage(&task->sNFC, n, page) || memcmp(page, task->sTag.sMem + 4 * n, 16) != 0)
+    {
+      task->sErrors++;
+    }
+    task->sExchanges++;
+  }
+  xTaskNotifyGive(task->sMain);
+  vTaskDelete(NULL);
+}
+
+static bool StressRun(TStressTask *aTasks, int aCount)
+{
+  atomic_bool stop = false;
+  uint32_t exchanges = 0;
+  uint32_t errors = 0;
+
+  for (int i = 0; i < aCount; i++)
+  {
+    TStressTask *task = &aTasks[i];
+    memset(task, 0, sizeof(*task));
+    TagPeerInit(&task->sTag, (uint8_t)(i + 1));
+    pn532_loopback_init(&task->sNFC, &task->sBus, TagPeer, &task->sTag);
+    pn532_begin(&task->sNFC);
+    task->sMain = xTaskGetCurrentTaskHandle();
+    task->sStop = &stop;
+  }
+
+  int64_t start = esp_timer_get_time();
+  for (int i = 0; i < aCount; i++)
+  {
+    xTaskCreate(StressTask, "stress", 4096, &aTasks[i], 5, NULL);
+  }
+  vTaskDelay(pdMS_TO_TICKS(STRESS_TIME_US / 1000));
+  atomic_store(&stop, true);
+  for (int i = 0; i < aCount; i++)
+  {
+    ulTaskNotifyTake(pdFALSE, portMAX_DELAY);
+  }
+  int64_t time = esp_timer_get_time() - start;
+
+  for (int i = 0; i < aCount; i++)
+  {
+    exchanges += aTasks[i].sExchanges;
+    errors += aTasks[i].sErrors;
+  }
+  printf("N=%d  %8u exchanges  %10.0f exchanges/s  %u errors\n", aCount, (unsigned)exchanges, exchanges * 1e6 / time,
+         (unsigned)errors);
+  return errors == 0 && exchanges != 0;
+}
+
+int main(void)
+{
+  static TStressTask tasks[STRESS_MAXTASKS];
+  bool ok = true;
+
+  for (int n = 1; n <= STRESS_MAXTASKS; n *= 2)
+  {
+    ok &= StressRun(tasks, n);
+  }
+  printf("%s\n", ok ? "OK" : "FAILED");
+  return !ok;
+}
@@ -0,0 +1,148 @@
+/*
+    Tear-proof A/B slots (CONFIG_NFC_TEARPROOF) against a tag that leaves
+    the field during NFC_WriteStructs. For every k the tag stops answering
+    after k page writes; a fresh NFC_LoadNFC must then return either the
+    previous or the new image, never a mix, with the sequence number of
+    the image it returned. The lost-ACK variant writes page k but drops
+    its answer, which for the last write is a header that reached the tag
+    while the reader saw a failure.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pn532.h"
+#include "NFC_reader.h"
+#include "tag_peer.h"
+
+static int sFailed;
+
+#define CHECK(cond)                                          \
+  do                                                         \
+  {                                                          \
+    if (!(cond))                                             \
+    {                                                        \
+      printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+      sFailed++;                                             \
+    }                                                        \
+  } while (0)
+
+typedef struct
+{
+  pn532_t sNFC;
+  pn532_loopback_t sBus;
+  TTagPeer sTag;
+  TNFCSession sSession;
+  TCardInfo *sCard;
+} TRig;
+
+// reader restarted and the card presented again: nothing is known about it
+static bool RigLoad(TRig *aRig)
+{
+  if (aRig->sCard != NULL)
+  {
+    NFC_DeAlloc(aRig->sCard);
+  }
+  aRig->sCard = (TCardInfo *)calloc(1, sizeof(TCardInfo));
+  aRig->sTag.sWritesLeft = TAG_PEER_UNLIMITED;
+  aRig->sTag.sLoseAck = false;
+  pn532_loopback_init(&aRig->sNFC, &aRig->sBus, TagPeer, &aRig->sTag);
+  pn532_begin(&aRig->sNFC);
+  return NFC_SessionOpen(&aRig->sSession, &aRig->sNFC, 100) && NFC_LoadNFC(&aRig->sSession, aRig->sCard);
+}
+
+static void FillImage(uint8_t *aImage, size_t aLen, uint8_t aGeneration)
+{
+  for (size_t i = 0; i < aLen; i++)
+  {
+    aImage[i] = (uint8_t)(aGeneration * 0x40 + i + 1);
+  }
+}
+
+/*
+  Writes generation aGen over the card holding generation aGen - 1, cut
+  off after k = 0, 1, ... page writes until the write goes through.
+  With aLoseAck the k-th write lands but its answer is lost, aTotal is
+  then the number of writes of a complete commit. Leaves the card as it
+  was and returns the number of writes of a complete commit.
+*/
+static uint32_t TearGeneration(TRig *aRig, uint8_t aGen, bool aLoseAck, uint32_t aTotal)
+{
+  uint8_t iCard[sizeof(aRig->sTag.sMem)];
+  uint8_t iOld[256];
+  uint8_t iNew[256];
+  uint32_t iTotal = 0;
+
+  CHECK(RigLoad(aRig));
+  size_t iLen = aRig->sCard->sNumOfBlocks * sizeof(TDataNFC);
+  uint16_t iSeq = aRig->sCard->sSeq;
+  memcpy(iCard, aRig->sTag.sMem, sizeof(iCard));
+  memcpy(iOld, aRig->sCard->sDataNFC, iLen);
+  FillImage(iNew, iLen, aGen);
+
+  for (uint32_t k = aLoseAck ? 1 : 0; iTotal == 0 && k <= 64; k++)
+  {
+    memcpy(aRig->sTag.sMem, iCard, sizeof(iCard));
+    CHECK(RigLoad(aRig));
+    CHECK(memcmp(aRig->sCard->sDataNFC, iOld, iLen) == 0);
+
+    memcpy(aRig->sCard->sDataNFC, iNew, iLen);
+    aRig->sTag.sWritesLeft = (int)k;
+    aRig->sTag.sLoseAck = aLoseAck;
+    uint32_t iWrites = aRig->sTag.sWrites;
+    uint8_t iResult = NFC_WriteStructs(&aRig->sSession, aRig->sCard, 0, aRig->sCard->sNumOfBlocks, NULL);
+    iWrites = aRig->sTag.sWrites - iWrites;
+    CHECK(iWrites == k || iResult == 0);
+    CHECK(iResult == 0 || iResult == 3);
+
+    CHECK(RigLoad(aRig));
+    bool iIsOld = memcmp(aRig->sCard->sDataNFC, iOld, iLen) == 0;
+    bool iIsNew = memcmp(aRig->sCard->sDataNFC, iNew, iLen) == 0;
+    CHECK(iIsOld != iIsNew);
+    CHECK(aRig->sCard->sCrcValid);
+    if (aLoseAck)
+    {
+      // the lost answer fails the write, the header decides what is loaded
+      CHECK(iResult == 3);
+      CHECK(iIsNew == (k == aTotal));
+      iTotal = k == aTotal ? k : 0;
+    }
+    else
+    {
+      CHECK(iIsNew == (iResult == 0));
+      iTotal = iResult == 0 ? iWrites : 0;
+    }
+    CHECK(aRig->sCard->sSeq == (uint16_t)(iIsNew ? iSeq + 1 : iSeq));
+  }
+  CHECK(iTotal != 0);
+  printf("generation %u%s: cut after each of %u page writes, old image with sequence %u or new with %u\n", aGen,
+         aLoseAck ? " (lost answer)" : "", (unsigned)iTotal, iSeq, iSeq + 1);
+  memcpy(aRig->sTag.sMem, iCard, sizeof(iCard));
+  return iTotal;
+}
+
+int main(void)
+{
+  static TRig rig;
+
+  TagPeerInit(&rig.sTag, 0);
+  CHECK(RigLoad(&rig));
+  CHECK(!rig.sCard->sCrcValid); // blank card, no valid slot
+  CHECK(rig.sCard->sNumOfBlocks > 0);
+
+  // generation 1 onto a blank card
+  FillImage((uint8_t *)rig.sCard->sDataNFC, rig.sCard->sNumOfBlocks * sizeof(TDataNFC), 1);
+  CHECK(NFC_WriteStructs(&rig.sSession, rig.sCard, 0, rig.sCard->sNumOfBlocks, NULL) == 0);
+  CHECK(RigLoad(&rig) && rig.sCard->sSeq == 1);
+
+  // 2 goes to slot 1, 3 back to slot 0 over generation 1
+  TearGeneration(&rig, 2, true, TearGeneration(&rig, 2, false, 0));
+  CHECK(RigLoad(&rig));
+  FillImage((uint8_t *)rig.sCard->sDataNFC, rig.sCard->sNumOfBlocks * sizeof(TDataNFC), 2);
+  CHECK(NFC_WriteStructs(&rig.sSession, rig.sCard, 0, rig.sCard->sNumOfBlocks, NULL) == 0);
+  TearGeneration(&rig, 3, true, TearGeneration(&rig, 3, false, 0));
+
+  NFC_DeAlloc(rig.sCard);
+  printf("%s\n", sFailed ? "FAILED" : "OK");
+  return sFailed != 0;
+}